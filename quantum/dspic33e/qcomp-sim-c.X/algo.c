@@ -8,7 +8,7 @@
 
 /// gate routine
 /// \todo not sure if the breaks are needed here, I don't think they are.
-int op_routine(int select_op, Complex state[]){
+int op_routine(int select_op, StateVector * state){
     int targ = 0;
     int select_qubit = 0;
     switch(select_op) {
@@ -16,19 +16,19 @@ int op_routine(int select_op, Complex state[]){
             /// X
             select_qubit = check_qubit();
             if(select_qubit == -2) return -2;
-            gate_display(X, select_qubit, state);
+            if(gate_display(X, select_qubit, state) == -2) return -2;
             break;
         case 1:
             /// Z
             select_qubit = check_qubit();
             if(select_qubit == -2) return -2;
-            gate_display(Z, select_qubit, state);
+            if(gate_display(Z, select_qubit, state) == -2) return -2;
             break;
         case 2:
             /// H
             select_qubit = check_qubit();
             if(select_qubit == -2) return -2;
-            gate_display(H, select_qubit, state);
+            if(gate_display(H, select_qubit, state) == -2) return -2;
             break;
         case 3:         
             /// SWAP
@@ -38,12 +38,16 @@ int op_routine(int select_op, Complex state[]){
             ///@todo need a check for zero button 
             targ = check_qubit(); // The target
             if(targ == -2) return -2;
-            two_gate_display(X, select_qubit, targ, state);
+            if(two_gate_display(X, select_qubit, targ, state) == -2) return -2;
             
             //swap_test(state);
             break;
-            /*
         case 4:
+            /// Switch between the average and cycling displays
+            toggle_cycle(state);
+            break;
+            /*
+        case 5:
             /// SWAP
             select_qubit = check_qubit(); // One qubit
              if(select_qubit == -2) return -2;
@@ -62,120 +66,147 @@ int op_routine(int select_op, Complex state[]){
     return 0;
 }
 
+/**
+ * @brief Wait for the reset button to be released (with the green LED on)
+ * @return -2 (which means reset)
+ */
+static int wait_reset(void) {
+    InputEvent event;
+    set_led(green, on); /// Turn LED on to signify reset
+    do {
+        input_wait(&event);
+    } while(event.button != INPUT_RESET || event.pressed);
+    set_led(green, off); /// Turn LED off and return
+    return -2; /// -2 means reset
+}
+
 // Check whether a qubit has been selected
 int check_qubit(){
-    // clear previous val of select_qubit
-    int select_qubit=-1;
-    /// \bug this probably shouldn't be an infinite loop.
-    /// the counter lets the loop exit after some time to check if the 
-    /// 'reset' button is pressed 
-    while(select_qubit == -1) {
+    /// Wait for button events (the CPU idles in between, see input.h).
+    /// A qubit is selected when its button is pressed; the releases are
+    /// ignored. The amber LED flashes while waiting (see strobe_task)
+    InputEvent event;
+    set_strobe(amber, on);
+    while(1) {
+        input_wait(&event);
+        if(!event.pressed) continue;
         /// Check for the reset button
-        if (read_btn(sw3) == 1) {
-            while (read_btn(sw3) == 1) {
-                set_led(green, on); /// Turn LED on to signify reset
-            }
-            set_led(green, off); /// Turn LED off and return
-            return -2; /// -2 means reset
+        if(event.button == INPUT_RESET) {
+            set_strobe(amber, off);
+            return wait_reset();
         }
-        // Read all the button state
-        read_external_buttons();
         // check if any of the qubits are selected
-        for (int n = 0; n < NUM_QUBITS; n++) {
-            if (read_qubit_btn(n) == 1) {
-                select_qubit = n;
-            }
+        if(event.button < NUM_QUBITS) {
+            set_strobe(amber, off);
+            return event.button;
         }
     }
-    int release = 0;
-    while (1) {
-        release = 0; //     
-        // Read all the button states
-        read_external_buttons();
-        // check if any of the qubits are selected
-        for (int n = 0; n < NUM_QUBITS; n++) {
-            if (read_qubit_btn(n) == 1) {
-                release = 1;
-            }
-        }
-        // Break if all the buttons are released.
-        if(release == 0) break;
-        ///@todo we need button debouncing here
-    }
-    return select_qubit;
 } /// End of qubit select 
 
 
-// Check whether a qubit has been selected
+// Check whether an op has been selected
 int check_op(){
-    int select_op=-1;
-    /// \todo this is a temp fix to avoid getting stuck waiting for a user input.
-    while(select_op == -1) {
+    InputEvent event;
+    while(1) {
+        input_wait(&event);
+        if(!event.pressed) continue;
         /// Check for the reset button
-        if (read_btn(sw3) == 1) {
-            while (read_btn(sw3) == 1) {
-                set_led(green, on); /// Turn LED on to signify reset
-            }
-            set_led(green, off); /// Turn LED off and return
-            return -2; /// -2 means reset
-        }
-        read_external_buttons();
-        for (int n = 0; n < 4; n++) {
-            if (read_func_btn(n) == 1) {
-                select_op = n;
-            }
+        if(event.button == INPUT_RESET) return wait_reset();
+        for (int n = 0; n < NUM_BTNS - NUM_QUBITS; n++) {
+            if (event.button == INPUT_FUNC(n)) return n;
         }
     }
-return select_op;
+}
+
+/// @brief Switch between the average and cycling displays
+/// (a gate or a reset goes back to the average display, see display.h)
+void toggle_cycle(StateVector * state) {
+    if(!display_cycling()) {
+        display_cycle(state);
+    } else {
+        display_cycle_stop();
+        display_average(state);
+    }
 }
 
 /// @brief single qubit gate 
-void gate(const Complex op[2][2], int qubit, Complex state[]){
+void gate(const Complex op[2][2], int qubit, StateVector * state){
     /// does 2x2 operator on state vector
     single_qubit_op(op, qubit, state);
 }
 
+/// @brief Apply a gate and display the new state, a slice at a time for
+/// large states
+int sliced_gate_display(const Complex op[2][2], size_t ctrl_mask, int targ,
+        StateVector * state){
+    /// Small states are no more work than one slice, and only the changed
+    /// amplitudes are measured again (see display_gate)
+    if(state->length <= 2 * GATE_SLICE) {
+        if(display_gate(op, ctrl_mask, targ, state) != 0) return -1;
+        return input_pending(INPUT_RESET) ? wait_reset() : 0;
+    }
+    GateJob job;
+    if(gate_job_init(&job, op, ctrl_mask, targ, state) != 0) return -1;
+    while(gate_job_step(&job, GATE_SLICE) != 0) {
+        sched_run(); // Keep the LEDs going
+        /// The rest of the gate is not needed after a reset
+        if(input_pending(INPUT_RESET)) return wait_reset();
+    }
+    /// Then the display, a slice (of as many amplitudes) at a time
+    MeasureJob display;
+    display_job_init(&display, state);
+    while(display_job_step(&display, 2 * GATE_SLICE) != 0) {
+        sched_run();
+        if(input_pending(INPUT_RESET)) return wait_reset();
+    }
+    return 0;
+}
+
 /// @brief single qubit gate with display  
-void gate_display(const Complex op[2][2], int qubit, Complex state[]){
+int gate_display(const Complex op[2][2], int qubit, StateVector * state){
     /// does 2x2 operator on state vector
     /// displays the average state of the qubit by tracing over all 
     /// waits to let the user see the state (LEDs)
-    single_qubit_op(op, qubit, state);
-    display_average(state);
-    ///delay();
+    return sliced_gate_display(op, 0, qubit, state);
+    ///sched_sleep(SCHED_DELAY);
 }
 
 /// @brief two-qubit gate 
-void two_gate(const Complex op[2][2], int ctrl, int targ, Complex state[]){
+int two_gate(const Complex op[2][2], int ctrl, int targ, StateVector * state){
     /// does controlled 2x2 operator 
-    controlled_qubit_op(op, ctrl, targ, state);
+    return controlled_qubit_op(op, ctrl, targ, state);
+}
+
+/// @brief multi-controlled gate (one pass over the state)
+int multi_gate(const Complex op[2][2], size_t ctrl_mask, int targ, StateVector * state){
+    /// does 2x2 operator controlled on all the qubits in ctrl_mask
+    return multi_controlled_qubit_op(op, ctrl_mask, targ, state);
 }
 
 /// @brief two-qubit gate with display
-void two_gate_display(const Complex op[2][2], int ctrl, int targ, Complex state[]){
+int two_gate_display(const Complex op[2][2], int ctrl, int targ, StateVector * state){
     /// does controlled 2x2 operator 
     /// displays the state 
-    /// waits to let the user see the state 
-    controlled_qubit_op(op, ctrl, targ, state);
-    display_average(state);
-    delay();
+    /// waits to let the user see the state (running the scheduled tasks)
+    int result = sliced_gate_display(op, (size_t)1 << ctrl, targ, state);
+    if(result == -2) return -2;
+    sched_sleep(SCHED_DELAY);
+    return 0;
 }
 
 
 
-void swap(int q1, int q2, Complex state[]){
-   
-    controlled_qubit_op(X, q1, q2, state);
-    controlled_qubit_op(X, q2, q1, state);
-    controlled_qubit_op(X, q1, q2, state);
+void swap(int q1, int q2, StateVector * state){
+    /// Same as three cNots, but done in one pass by moving amplitudes
+    swap_qubits(q1, q2, state);
     display_average(state);
 }
 
-void swap_test(Complex state[]) {
+void swap_test(StateVector * state) {
 /*
         zero_state(state); // Set the state to the vacuum
         display_average(state); // Display the state for four qubits
-        delay();
+        sched_sleep(SCHED_DELAY);
 
     
         gate(X, 0, state);
@@ -184,13 +215,13 @@ void swap_test(Complex state[]) {
      */
     /// swap for ever!
     swap(0, 1, state);
-    delay();
+    sched_sleep(SCHED_DELAY);
     swap(1, 2, state);
-    delay();
+    sched_sleep(SCHED_DELAY);
     swap(2, 3, state);
-    delay();
+    sched_sleep(SCHED_DELAY);
     swap(3, 0, state);
-    delay();
+    sched_sleep(SCHED_DELAY);
 }
 
 /// QFT
@@ -230,17 +261,18 @@ void swap_test(Complex state[]) {
 /// q1 ctrl 1
 /// q2 ctrl 2
 /// q3 target
-void toffoli_gate(int q1, int q2, int q3, Complex state[]){
+///
+/// The decomposition above took five passes over the state. Now the X is
+/// applied directly to the quarter of the state where q1 and q2 are ONE.
+int toffoli_gate(int q1, int q2, int q3, StateVector * state){
 
-    controlled_qubit_op(rX, q2, q3, state);     ///< a
-    controlled_qubit_op(X, q1, q2, state);      ///< b 
-    controlled_qubit_op(rXT, q2, q3, state);    ///< c
-    controlled_qubit_op(X, q1, q2, state);      ///< d
-    controlled_qubit_op(rX, q1, q3, state);     ///< e
-    display_average(state);
+    /// Only the quarter of the state the gate changes is displayed again
+    int result = sliced_gate_display(X, ((size_t)1 << q1) | ((size_t)1 << q2),
+            q3, state);
+    return (result == -2) ? -2 : 0;
 }
 
-void toffoli_test(Complex state[]){
+void toffoli_test(StateVector * state){
 
     while(1){
     zero_state(state);
@@ -269,7 +301,7 @@ void toffoli_test(Complex state[]){
 ///       |  |  |     |  |  |  |
 /// |q0> -o--o--|-----|--o--o--X-- |q0>
 /// \endverbatim
-void repetition_code(int q0, Complex state[]){
+void repetition_code(int q0, StateVector * state){
     int q1;
     int q2;
     
@@ -281,7 +313,7 @@ void repetition_code(int q0, Complex state[]){
     }
     /// check if q0 is the last qubit then wrap so q1 is (q0-1)
     /// q2 is (q0-2)
-    else if (q0 == (NUM_QUBITS-1)){
+    else if (q0 == (state->num_qubits-1)){
         q1=q0-1;
         q2=q0-2;
     }
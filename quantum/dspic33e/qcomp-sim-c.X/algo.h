@@ -15,48 +15,69 @@ extern "C" {
 
 #include "quantum.h"
 #include "display.h"
+#include "input.h"
+#include "sched.h"
 
 
 /// functions for performing gate routines, takes qubit & button ints
-int op_routine(int select_op, Complex state[]);
+int op_routine(int select_op, StateVector * state);
 
 
 /// function returns the integer for the label of which qubit is selected
-/// @returns int select_qubit (-1 if no qubit is selected)
-/// \bug problem with sampling, will cause the program to hang while waiting
-/// for qubit input
+/// @returns int select_qubit, or -2 if the reset button was pressed
+/// @note Waits for button events (see input.h), idling the CPU in between
 int check_qubit();
 
 /// function returns integer label used in switch statement in main
-/// \bug same as above^
+/// @returns the function button (0 - 4), or -2 for reset
 int check_op();
 
+/// switch between display_average and display_cycle (function button 4)
+void toggle_cycle(StateVector * state);
+
 /// perform single qubit gate 
-void gate(const Complex op[2][2], int qubit, Complex state[]);
+void gate(const Complex op[2][2], int qubit, StateVector * state);
 
 /// perform controlled single qubit gate 
-void two_gate(const Complex op[2][2], int ctrl, int targ, Complex state[]);
+/// @returns 0, or -1 if the qubits are not valid (see controlled_qubit_op)
+int two_gate(const Complex op[2][2], int ctrl, int targ, StateVector * state);
+
+/// perform single qubit gate controlled on every qubit in ctrl_mask
+/// (bit n set for qubit n)
+int multi_gate(const Complex op[2][2], size_t ctrl_mask, int targ, StateVector * state);
+
+/// The most pairs a gate does between checks of the reset button (see
+/// sliced_gate_display). States with fewer pairs are done in one go
+#define GATE_SLICE 256
+
+/// Display gates!!! They return -2 if the reset button was pressed 
+/// while the gate was being applied, or 0
+int gate_display(const Complex op[2][2], int qubit, StateVector * state);
+int two_gate_display(const Complex op[2][2], int ctrl, int targ, StateVector * state);
 
-/// Display gates!!!
-void gate_display(const Complex op[2][2], int qubit, Complex state[]);
-void two_gate_display(const Complex op[2][2], int ctrl, int targ, Complex state[]);
+/// Apply a gate and display the new state. Large states are done a slice
+/// of GATE_SLICE pairs at a time, with the scheduled tasks run and the 
+/// reset button checked in between (see GateJob in quantum.h)
+/// @returns 0 if successful, -1 if the qubits are not valid, or -2 for reset
+int sliced_gate_display(const Complex op[2][2], size_t ctrl_mask, int targ,
+        StateVector * state);
 
     
-/// swap using 3 cNots
-void swap(int q1, int q2, Complex state[]);
+/// swap two qubits (the same as 3 cNots, but in one pass)
+void swap(int q1, int q2, StateVector * state);
 
 /// from tests.c
-void swap_test(Complex state[]);
+void swap_test(StateVector * state);
 
-/// Toffoli gate
-void toffoli_gate(int q1, int q2, int q3, Complex state[]);
+/// Toffoli gate (a single pass X controlled on q1 and q2)
+int toffoli_gate(int q1, int q2, int q3, StateVector * state);
     
-void toffoli_test(Complex state[]);
+void toffoli_test(StateVector * state);
 
 /// added repetition_code for bit flip errors, currently only shows a fixed
 /// error which is a failed X on one of the ancillas. 
 /// todo.
-void repetition_code(int q0, Complex state[]);
+void repetition_code(int q0, StateVector * state);
 
 
 #ifdef	__cplusplus
@@ -0,0 +1,1316 @@
+/**
+ * @file bench.c
+ *
+ * @brief Description: Checks and benchmarks for the gate kernels
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (`make host-bench', then run build/host/bench). The program
+ * first checks the fast kernels against the simple reference versions on
+ * small random states, and exits with status 1 if they disagree. Then it
+ * times them on a larger state.
+ *
+ * Usage: bench [qubits]    (default 20)
+ *        bench -r [qubits] (default 16)
+ *
+ * With -r, the micro-benchmarks in benchmark.h are run on 1 up to qubits
+ * qubits instead, and printed as CSV: the function, the number of qubits,
+ * the number of calls, the total time and the time per call (in ns).
+ *
+ * The last table runs one random circuit with each of the scalar types in
+ * precision.h, to show what the fixed point types cost.
+ *
+ * The times come from the timer functions in time.h, which count
+ * nanoseconds on the host. Each timing run starts from the same random
+ * state and only applies unitary gates, so the amplitudes never become
+ * small enough to be denormal (which would slow down the arithmetic).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quantum.h"
+#include "simd.h"
+#include "queue.h"
+#include "benchmark.h"
+#include "precision.h"
+#include "paged.h"
+#include "sram.h"
+#include "hal.h"
+#include "time.h"
+#include "io.h"
+#include "display.h"
+#include "input.h"
+#include "sched.h"
+#include "algo.h"
+
+/// The largest difference allowed between a kernel and its reference
+#define TOLERANCE 1e-5
+
+/// The number of times each gate is repeated in the timing runs
+#define REPEATS 5
+
+/// The fewest qubits display_gate is timed with. The pass over the state
+/// it saves only costs anything once the state (32 MB of floats here) is
+/// out of the CPU's own caches, and on a smaller state it is only as fast
+#define FUSED_QUBITS 22
+
+/// The runs display_gate is timed over. With doubles the measurement is 
+/// slow enough that the pass saved is only about a tenth of the time, 
+/// which the noise on a busy machine can hide in any one run
+#define FUSED_RUNS 9
+
+/// @brief Fill the state with random amplitudes (not normalised)
+static void random_state(StateVector * state, unsigned seed) {
+    srand(seed);
+    for (size_t i = 0; i < state->length; i++) {
+        AMP_RE(state, i) = rand() / (Q15)RAND_MAX - 0.5;
+        AMP_IM(state, i) = rand() / (Q15)RAND_MAX - 0.5;
+    }
+    state->changes++;
+}
+
+/// @brief The largest difference between two states of the same size
+static double max_difference(StateVector * a, StateVector * b) {
+    double max = 0;
+    for (size_t i = 0; i < a->length; i++) {
+        double d = fabs(AMP_RE(a, i) - AMP_RE(b, i))
+                + fabs(AMP_IM(a, i) - AMP_IM(b, i));
+        if (d > max) max = d;
+    }
+    return max;
+}
+
+/// A 2x2 matrix with no special structure
+static const Complex U[2][2] = {
+    {{0.3, 0.1}, {-0.2, 0.7}},
+    {{0.5, -0.4}, {0.1, 0.9}},
+};
+
+/**
+ * @brief Check controlled_qubit_op against controlled_qubit_op_old
+ * @return 0 if every ctrl/targ combination agrees, -1 otherwise
+ */
+static int check_controlled(void) {
+    double max = 0;
+    int failed = 0;
+    for (int n = 2; n <= 10; n++) {
+        StateVector a, b;
+        state_alloc(&a, n);
+        state_alloc(&b, n);
+        /// Invalid combinations must be refused, and leave the state alone
+        const int bad[][2] = {{0, 0}, {n - 1, n - 1}, {-1, 0}, {0, -1}, 
+                {n, 0}, {0, n}};
+        unsigned long changes = a.changes;
+        for (int k = 0; k < 6; k++) {
+            if (controlled_qubit_op(U, bad[k][0], bad[k][1], &a) != -1) failed = 1;
+        }
+        if (a.changes != changes) failed = 1;
+        for (int ctrl = 0; ctrl < n; ctrl++) {
+            for (int targ = 0; targ < n; targ++) {
+                if (ctrl == targ) continue;
+                random_state(&a, n * 100 + ctrl * 10 + targ);
+                random_state(&b, n * 100 + ctrl * 10 + targ);
+                controlled_qubit_op(U, ctrl, targ, &a);
+                controlled_qubit_op_old(U, ctrl, targ, &b);
+                double d = max_difference(&a, &b);
+                if (d > max) max = d;
+            }
+        }
+        state_free(&a);
+        state_free(&b);
+    }
+    int ok = !failed && max < TOLERANCE;
+    printf("check controlled_qubit_op: max difference %g %s\n", max,
+            ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief The reference multi-controlled op: visit every pair and test bits
+static void reference_multi(const Complex op[2][2], size_t ctrl_mask, int targ,
+        StateVector * state) {
+    size_t targ_bit = (size_t)1 << targ;
+    for (size_t i = 0; i < state->length; i++) {
+        if ((i & targ_bit) == 0 && (i & ctrl_mask) == ctrl_mask) {
+            mat_mul(op, state, i, i + targ_bit);
+        }
+    }
+}
+
+/**
+ * @brief Check multi_controlled_qubit_op against reference_multi
+ * @return 0 if every ctrl_mask/targ combination agrees, -1 otherwise
+ */
+static int check_multi(void) {
+    double max = 0;
+    int failed = 0;
+    for (int n = 1; n <= 8; n++) {
+        StateVector a, b;
+        state_alloc(&a, n);
+        state_alloc(&b, n);
+        for (int targ = 0; targ < n; targ++) {
+            for (size_t mask = 0; mask < a.length; mask++) {
+                if (mask & ((size_t)1 << targ)) {
+                    /// Invalid combinations must be refused
+                    if (multi_controlled_qubit_op(U, mask, targ, &a) != -1) failed = 1;
+                    continue;
+                }
+                random_state(&a, mask * 16 + targ);
+                random_state(&b, mask * 16 + targ);
+                multi_controlled_qubit_op(U, mask, targ, &a);
+                reference_multi(U, mask, targ, &b);
+                double d = max_difference(&a, &b);
+                if (d > max) max = d;
+            }
+        }
+        state_free(&a);
+        state_free(&b);
+    }
+    int ok = !failed && max < TOLERANCE;
+    printf("check multi_controlled_qubit_op: max difference %g %s\n", max,
+            ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// Matrices for each of the special kinds in classify_gate
+static const Complex S[2][2] = {{{1.0, 0.0}, {0.0, 0.0}}, {{0.0, 0.0}, {0.0, 1.0}}};
+static const Complex D[2][2] = {{{0.6, 0.8}, {0.0, 0.0}}, {{0.0, 0.0}, {0.8, -0.6}}};
+static const Complex I[2][2] = {{{1.0, 0.0}, {0.0, 0.0}}, {{0.0, 0.0}, {1.0, 0.0}}};
+
+/**
+ * @brief Check the fast paths for special matrices against mat_mul
+ * @return 0 if they all agree, -1 otherwise
+ * 
+ * X, Y and Z contain ONE_Q15, which the fast paths treat as exactly one,
+ * so the tolerance is ONE - ONE_Q15 larger here.
+ */
+static int check_special(void) {
+    const Complex (*ops[])[2] = {X, Y, Z, S, D, I, H};
+    const GateKind kinds[] = {GATE_SWAP, GATE_ANTIDIAGONAL, GATE_SIGN,
+        GATE_PHASE, GATE_DIAGONAL, GATE_IDENTITY, GATE_GENERAL};
+    double max = 0;
+    int failed = 0;
+    for (int g = 0; g < 7; g++) {
+        if (classify_gate(ops[g]) != kinds[g]) failed = 1;
+        for (int n = 1; n <= 7; n++) {
+            StateVector a, b;
+            state_alloc(&a, n);
+            state_alloc(&b, n);
+            for (int targ = 0; targ < n; targ++) {
+                /// No controls, and control on the qubit above the target
+                for (size_t mask = 0; mask <= 1; mask++) {
+                    size_t ctrl_mask = (n > 1) ? mask << ((targ + 1) % n) : 0;
+                    random_state(&a, g * 100 + targ);
+                    random_state(&b, g * 100 + targ);
+                    if (ctrl_mask == 0) single_qubit_op(ops[g], targ, &a);
+                    else multi_controlled_qubit_op(ops[g], ctrl_mask, targ, &a);
+                    reference_multi(ops[g], ctrl_mask, targ, &b);
+                    double d = max_difference(&a, &b);
+                    if (d > max) max = d;
+                }
+            }
+            state_free(&a);
+            state_free(&b);
+        }
+    }
+    int ok = !failed && max < TOLERANCE + (1.0 - ONE_Q15);
+    printf("check special gates: max difference %g %s\n", max, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Check swap_qubits against three cNots
+ * @return 0 if they all agree, -1 otherwise
+ */
+static int check_swap(void) {
+    double max = 0;
+    for (int n = 2; n <= 8; n++) {
+        StateVector a, b;
+        state_alloc(&a, n);
+        state_alloc(&b, n);
+        for (int q1 = 0; q1 < n; q1++) {
+            for (int q2 = 0; q2 < n; q2++) {
+                if (q1 == q2) continue;
+                random_state(&a, q1 * 10 + q2);
+                random_state(&b, q1 * 10 + q2);
+                swap_qubits(q1, q2, &a);
+                controlled_qubit_op_old(X, q1, q2, &b);
+                controlled_qubit_op_old(X, q2, q1, &b);
+                controlled_qubit_op_old(X, q1, q2, &b);
+                double d = max_difference(&a, &b);
+                if (d > max) max = d;
+            }
+        }
+        state_free(&a);
+        state_free(&b);
+    }
+    int ok = max < TOLERANCE + 3 * (1.0 - ONE_Q15);
+    printf("check swap_qubits: max difference %g %s\n", max, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief The time in ns for REPEATS single qubit gates, averaged over the
+/// target qubits
+static double time_single(const Complex op[2][2], StateVector * state) {
+    int n = state->num_qubits;
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    for (int r = 0; r < REPEATS; r++) {
+        for (int targ = 0; targ < n; targ++) {
+            single_qubit_op(op, targ, state);
+        }
+    }
+    stop_timer();
+    return (double)read_timer() / (REPEATS * n);
+}
+
+/// @brief The time in ns for REPEATS swaps, each as three cNots (cnots
+/// true) or one pass, averaged over neighbouring qubit pairs
+static double time_swap(bool cnots, StateVector * state) {
+    int n = state->num_qubits;
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    for (int r = 0; r < REPEATS; r++) {
+        for (int q = 0; q < n; q++) {
+            int q1 = q, q2 = (q + 1) % n;
+            if (cnots) {
+                controlled_qubit_op(X, q1, q2, state);
+                controlled_qubit_op(X, q2, q1, state);
+                controlled_qubit_op(X, q1, q2, state);
+            } else {
+                swap_qubits(q1, q2, state);
+            }
+        }
+    }
+    stop_timer();
+    return (double)read_timer() / (REPEATS * n);
+}
+
+/// Pauli gates with exact ones, so that the fast paths and mat_mul agree
+static const Complex X1[2][2] = {{{0.0, 0.0}, {1.0, 0.0}}, {{1.0, 0.0}, {0.0, 0.0}}};
+static const Complex Y1[2][2] = {{{0.0, 0.0}, {0.0, -1.0}}, {{0.0, 1.0}, {0.0, 0.0}}};
+static const Complex Z1[2][2] = {{{1.0, 0.0}, {0.0, 0.0}}, {{0.0, 0.0}, {-1.0, 0.0}}};
+
+/// The gates used in the random circuits
+static const Complex (* const circuit_ops[])[2] = {X1, Y1, Z1, H, rX, rXT, S, D};
+#define CIRCUIT_OPS 8
+
+/**
+ * @brief Apply a random circuit directly, or through a GateQueue
+ * @param state The state
+ * @param gates The number of gates
+ * @param controlled One gate in this many is controlled (0 for none)
+ * @param queue NULL to apply the gates directly
+ * @param seed The random seed for the circuit
+ */
+static void random_circuit(StateVector * state, int gates, int controlled,
+        GateQueue * queue, unsigned seed) {
+    int n = state->num_qubits;
+    srand(seed);
+    for (int g = 0; g < gates; g++) {
+        const Complex (*op)[2] = circuit_ops[rand() % CIRCUIT_OPS];
+        int targ = rand() % n;
+        size_t ctrl_mask = 0;
+        if (n > 1 && controlled > 0 && rand() % controlled == 0) {
+            ctrl_mask = (size_t)1 << ((targ + 1 + rand() % (n - 1)) % n);
+        }
+        if (queue != NULL) queue_controlled_gate(queue, op, ctrl_mask, targ);
+        else if (ctrl_mask == 0) single_qubit_op(op, targ, state);
+        else multi_controlled_qubit_op(op, ctrl_mask, targ, state);
+    }
+    if (queue != NULL) queue_flush(queue);
+}
+
+/**
+ * @brief Check that the gate queue gives the same state as applying the
+ * gates one at a time
+ * @return 0 if it does, -1 otherwise
+ */
+static int check_queue(void) {
+    double max = 0;
+    for (int n = 1; n <= 8; n++) {
+        StateVector a, b;
+        state_alloc(&a, n);
+        state_alloc(&b, n);
+        for (int controlled = 0; controlled <= 4; controlled++) {
+            GateQueue queue;
+            queue_init(&queue, &a);
+            random_state(&a, n);
+            random_state(&b, n);
+            /// Longer than the ordered list, so it fills up part way
+            random_circuit(&a, 3 * QUEUE_LENGTH, controlled, &queue, n * 10 + controlled);
+            random_circuit(&b, 3 * QUEUE_LENGTH, controlled, NULL, n * 10 + controlled);
+            double d = max_difference(&a, &b);
+            if (d > max) max = d;
+        }
+        state_free(&a);
+        state_free(&b);
+    }
+    int ok = max < TOLERANCE;
+    printf("check queue: max difference %g %s\n", max, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief Round a matrix to a fractional type with the given number of
+/// bits. ONE_Q15 in the constants is taken to mean one
+static void round_matrix(const Complex op[2][2], int bits, Complex out[2][2]) {
+    double scale = ldexp(1.0, bits);
+    double one = 1.0 - 1.0 / scale;
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            for (int n = 0; n < 2; n++) {
+                double x = op[r][c][n];
+                if (fabs(x) >= ONE_Q15) x = (x > 0) ? 1.0 : -1.0;
+                x = round(x * scale) / scale;
+                if (x > one) x = one;
+                if (x < -one) x = -one;
+                out[r][c][n] = x;
+            }
+        }
+    }
+}
+
+/**
+ * @brief The norm error after NORM_GATES random gates from the vacuum
+ * @param bits The gate constants are rounded to this many fractional bits
+ * @param renormalise true to use state_renormalise
+ * @return |norm - NORM_TARGET|
+ * 
+ * Rounding the constants (e.g. H to 0.70709 in Q15) is what makes the
+ * firmware drift, so this shows the drift for Q15 and Q31 on the host.
+ */
+#define NORM_GATES 1000
+static double norm_error(int bits, bool renormalise) {
+    const Complex (* const ops[])[2] = {X, Y, Z, H, rX, rXT};
+    Complex rounded[6][2][2];
+    for (int g = 0; g < 6; g++) round_matrix(ops[g], bits, rounded[g]);
+    StateVector state;
+    state_alloc(&state, 10);
+    state_renormalise(&state, renormalise);
+    srand(bits);
+    for (int g = 0; g < NORM_GATES; g++) {
+        const Complex (*op)[2] = rounded[rand() % 6];
+        int targ = rand() % state.num_qubits;
+        if (rand() % 4 == 0) {
+            int ctrl = (targ + 1 + rand() % (state.num_qubits - 1)) % state.num_qubits;
+            controlled_qubit_op(op, ctrl, targ, &state);
+        } else {
+            single_qubit_op(op, targ, &state);
+        }
+    }
+    double error = fabs(state_norm(&state) - NORM_TARGET);
+    state_free(&state);
+    return error;
+}
+
+/**
+ * @brief Report the norm error for Q15 and Q31 gate constants, with and
+ * without the renormalisation mode
+ * @return 0 if renormalising keeps the error small, -1 otherwise
+ */
+static int check_norm(void) {
+    int ok = 1;
+    printf("check norm after %d gates (%s amplitudes):\n", NORM_GATES,
+            sizeof(Q15) == sizeof(float) ? "float" : "double");
+    const int bits[] = {15, 31};
+    for (int b = 0; b < 2; b++) {
+        double plain = norm_error(bits[b], false);
+        double renorm = norm_error(bits[b], true);
+        printf("  Q%d constants: error %g, renormalised %g\n", bits[b], 
+                plain, renorm);
+        if (renorm > 1e-4) ok = 0;
+    }
+    printf("check norm: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// The gates for compare_precisions, exactly in double
+static const Matrix2 exact_ops[] = {
+    {{{0, 0}, {1, 0}}, {{1, 0}, {0, 0}}}, // X
+    {{{0, 0}, {0, -1}}, {{0, 1}, {0, 0}}}, // Y
+    {{{1, 0}, {0, 0}}, {{0, 0}, {-1, 0}}}, // Z
+    {{{M_SQRT1_2, 0}, {M_SQRT1_2, 0}}, {{M_SQRT1_2, 0}, {-M_SQRT1_2, 0}}}, // H
+    {{{0.5, 0.5}, {0.5, -0.5}}, {{0.5, -0.5}, {0.5, 0.5}}}, // rX
+    {{{1, 0}, {0, 0}}, {{0, 0}, {M_SQRT1_2, M_SQRT1_2}}}, // T
+};
+#define EXACT_OPS 6
+
+/// The number of gates in the circuit for compare_precisions
+#define PRECISION_GATES 200
+
+/**
+ * @brief Run the same random circuit with every scalar type in precision.h
+ * and print the time per gate and the largest difference from double
+ * @param qubits The size of the state
+ */
+static void compare_precisions(int qubits) {
+    void * states[NUM_PRECISIONS];
+    double times[NUM_PRECISIONS];
+    for (int p = 0; p < NUM_PRECISIONS; p++) {
+        states[p] = precisions[p]->alloc(qubits);
+        if (states[p] == NULL) {
+            fprintf(stderr, "bench: cannot make a %d qubit state\n", qubits);
+            for (int q = 0; q < p; q++) precisions[q]->free(states[q]);
+            return;
+        }
+        srand(7);
+        reset_timer();
+        start_timer();
+        for (int g = 0; g < PRECISION_GATES; g++) {
+            const double (*op)[2][2] = exact_ops[rand() % EXACT_OPS];
+            int targ = rand() % qubits;
+            size_t ctrl_mask = 0;
+            if (rand() % 4 == 0) {
+                ctrl_mask = (size_t)1 << ((targ + 1 + rand() % (qubits - 1)) % qubits);
+            }
+            precisions[p]->gate(states[p], op, ctrl_mask, targ);
+        }
+        stop_timer();
+        times[p] = (double)read_timer() / PRECISION_GATES;
+    }
+    /// Compare with double (the second entry)
+    printf("\n%d random gates on %d qubits, ns per gate, difference from double\n",
+            PRECISION_GATES, qubits);
+    for (int p = 0; p < NUM_PRECISIONS; p++) {
+        double max = 0;
+        for (size_t i = 0; i < ((size_t)1 << qubits); i++) {
+            double a[2], b[2];
+            precisions[p]->amplitude(states[p], i, a);
+            precisions[1]->amplitude(states[1], i, b);
+            double d = fabs(a[0] - b[0]) + fabs(a[1] - b[1]);
+            if (d > max) max = d;
+        }
+        printf("%-28s %12.0f  %g\n", precisions[p]->name, times[p], max);
+    }
+    for (int p = 0; p < NUM_PRECISIONS; p++) precisions[p]->free(states[p]);
+}
+
+/// @brief sum |a|^2 of a state made with a precision.h model
+static double model_norm(const Precision * p, const void * state, int qubits) {
+    double norm = 0;
+    for (size_t i = 0; i < ((size_t)1 << qubits); i++) {
+        double a[2];
+        p->amplitude(state, i, a);
+        norm += a[0] * a[0] + a[1] * a[1];
+    }
+    return norm;
+}
+
+/**
+ * @brief The norm error after some random gates from the vacuum, in a 
+ * fixed point model from precision.h
+ * @param p The model (Q15 or Q31)
+ * @param bits Its fractional bits
+ * @param gates The number of gates
+ * @param renormalise true to scale the single qubit gates by 
+ * norm_correction, as state_renormalise does
+ * @return |norm - NORM_TARGET|
+ * 
+ * Unlike norm_error, the amplitudes are really rounded and saturated (X 
+ * is 1 - 2^-bits, so each X shrinks the state a little). The running norm
+ * is measured exactly here, where the firmware adds up the changes.
+ */
+static double model_norm_error(const Precision * p, int bits, int gates,
+        bool renormalise) {
+    const int qubits = 10;
+    void * state = p->alloc(qubits);
+    if (state == NULL) return INFINITY;
+    double one = 1 - ldexp(1.0, -bits);
+    srand(bits);
+    for (int g = 0; g < gates; g++) {
+        const double (*op)[2][2] = exact_ops[rand() % EXACT_OPS];
+        int targ = rand() % qubits;
+        size_t ctrl_mask = 0;
+        if (rand() % 4 == 0) {
+            ctrl_mask = (size_t)1 << ((targ + 1 + rand() % (qubits - 1)) % qubits);
+        }
+        Matrix2 scaled;
+        double s = norm_correction(model_norm(p, state, qubits));
+        if (renormalise && ctrl_mask == 0 && s != 1) {
+            /// As in renormalise_gate, it waits if the matrix would not fit
+            bool fits = true;
+            for (int r = 0; r < 2; r++) {
+                for (int c = 0; c < 2; c++) {
+                    for (int n = 0; n < 2; n++) {
+                        scaled[r][c][n] = s * op[r][c][n];
+                        fits &= fabs(scaled[r][c][n]) <= one;
+                    }
+                }
+            }
+            if (fits) op = scaled;
+        }
+        p->gate(state, op, ctrl_mask, targ);
+    }
+    double error = fabs(model_norm(p, state, qubits) - NORM_TARGET);
+    p->free(state);
+    return error;
+}
+
+/**
+ * @brief Check the renormalisation with the rounding of the fixed point
+ * type the build stands for (the Q31 model for AMP_Q31, else Q15)
+ * @return 0 if it makes the norm error smaller, and small, -1 otherwise
+ */
+static int check_model_norm(void) {
+    /// Q31 drifts slowly, so it is given longer. It should end up within 
+    /// twice the smallest correction norm_correction makes
+#ifdef AMP_Q31
+    const Precision * p = precisions[3];
+    const int bits = 31, gates = 10 * NORM_GATES;
+    const double limit = ldexp(1.0, -28);
+#else
+    const Precision * p = precisions[2];
+    const int bits = 15, gates = NORM_GATES;
+    const double limit = 1e-4;
+#endif
+    double plain = model_norm_error(p, bits, gates, false);
+    double renorm = model_norm_error(p, bits, gates, true);
+    int ok = renorm < plain && renorm < limit;
+    printf("check norm in the %s model after %d gates: error %g, "
+            "renormalised %g %s\n", p->name, gates, plain, renorm, 
+            ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Check the paged state in the (emulated) SRAM against an ordinary
+ * state, and that each gate reads and writes every page once
+ * @return 0 if they agree, -1 otherwise
+ */
+static int check_paged(void) {
+    double max = 0;
+    int max_qubits = 0;
+    while (((size_t)2 << max_qubits) * sizeof(Complex) <= SRAM_SIZE) max_qubits++;
+    sram_setup();
+    for (int n = 1; n <= max_qubits; n++) {
+        StateVector a, b;
+        PagedState paged;
+        state_alloc(&a, n);
+        state_alloc(&b, n);
+        paged_init(&paged, n, 0);
+        random_state(&a, n);
+        paged_store(&paged, &a);
+        srand(n);
+        for (int g = 0; g < 40; g++) {
+            const Complex (*op)[2] = circuit_ops[rand() % CIRCUIT_OPS];
+            int targ = rand() % n;
+            size_t ctrl_mask = 0;
+            for (int c = 0; c < n; c++) {
+                if (c != targ && rand() % 3 == 0) ctrl_mask |= (size_t)1 << c;
+            }
+            multi_controlled_qubit_op(op, ctrl_mask, targ, &a);
+            paged_multi_controlled_qubit_op(op, ctrl_mask, targ, &paged);
+        }
+        paged_load(&paged, &b);
+        double d = max_difference(&a, &b);
+        if (d > max) max = d;
+        state_free(&a);
+        state_free(&b);
+    }
+    /// Every amplitude should cross the bus twice per gate (read and
+    /// write), plus the instruction and address for each transfer
+    PagedState paged;
+    paged_init(&paged, max_qubits, 0);
+    double ratio = 0;
+    for (int targ = 0; targ < max_qubits; targ++) {
+        unsigned long before = host_get_sram_bytes();
+        paged_single_qubit_op(H, targ, &paged);
+        double moved = host_get_sram_bytes() - before;
+        double r = moved / (2.0 * paged.length * sizeof(Complex));
+        if (r > ratio) ratio = r;
+    }
+    int ok = max < TOLERANCE && ratio < 1.05;
+    printf("check paged state (up to %d qubits): max difference %g, "
+            "bus traffic %.3fx one read and write %s\n", max_qubits, max, 
+            ratio, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief Run the display interrupt for a few frames and check that each
+/// LED line is on for the right fraction of the time
+static int check_display(void) {
+    const UQ16 levels[3] = {0.0, 0.3, 0.75};
+    setup_external_leds();
+    for (int i = 0; i < LED_NUM; i++) {
+        set_external_led(i, levels[i % 3], levels[(i + 1) % 3],
+                levels[(i + 2) % 3]);
+    }
+    /// Time each line of the display drivers spends on
+    double lit[2][8] = {{0}};
+    double total = 0;
+    int writes = 0;
+    while (total < 4 * 255 * 0x300) {
+        unsigned long period = host_fire_timer(HAL_TIMER_DISPLAY);
+        writes++;
+        for (int chip = 0; chip < 2; chip++) {
+            int byte = host_get_display_byte(1 - chip);
+            for (int line = 0; line < 8; line++) {
+                if (byte & (1 << line)) lit[chip][line] += period;
+            }
+        }
+        total += period;
+    }
+    /// Compare with the brightness set above (the 8 bit levels are
+    /// within 1/256 of it)
+    extern LED led[LED_NUM];
+    double max = 0;
+    for (int i = 0; i < LED_NUM; i++) {
+        const int * lines[3] = {led[i].R, led[i].G, led[i].B};
+        const UQ16 set[3] = {led[i].N_R, led[i].N_G, led[i].N_B};
+        for (int c = 0; c < 3; c++) {
+            double d = fabs(lit[lines[c][0]][lines[c][1]] / total - set[c]);
+            if (d > max) max = d;
+        }
+    }
+    int ok = max < 2.0 / 256;
+    printf("check display: %d writes per frame, max brightness error %g %s\n",
+            writes / 4, max, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief The reference measurements: visit every amplitude and pair
+static void reference_measure(const StateVector * state, size_t ctrl_mask,
+        int num_qubits, Marginals * m) {
+    m->num_qubits = num_qubits;
+    for (int k = 0; k < num_qubits; k++) {
+        size_t bit = (size_t)1 << k;
+        m->zero[k] = m->one[k] = 0;
+        m->phase[k] = 0;
+        for (size_t i = 0; i < state->length; i++) {
+            if ((i & ctrl_mask) != ctrl_mask) continue;
+            Q15 p = AMP_RE(state, i) * AMP_RE(state, i) 
+                    + AMP_IM(state, i) * AMP_IM(state, i);
+            if (i & bit) {
+                m->one[k] += p;
+                size_t z = i - bit;
+                m->phase[k] += AMP_RE(state, z) * AMP_RE(state, i) < (Q15)-0.01
+                        || AMP_IM(state, z) * AMP_IM(state, i) < (Q15)-0.01;
+            } else {
+                m->zero[k] += p;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Check measure_state against reference_measure, with each kernel
+ * @return 0 if the counts are the same and the sums agree, -1 otherwise
+ */
+static int check_measure(void) {
+    double max = 0;
+    int failed = 0;
+    for (int level = SIMD_SCALAR; level <= SIMD_AUTO; level++) {
+        simd_select((SIMD_LEVEL)level);
+        for (int n = 1; n <= 12; n++) {
+            StateVector state;
+            state_alloc(&state, n);
+            random_state(&state, n);
+            int num_qubits = (n < MEASURE_QUBITS) ? n : MEASURE_QUBITS;
+            for (int c = 0; c < 8; c++) {
+                /// No controls, then random ones (low and high)
+                size_t ctrl_mask = (c == 0) ? 0 : (size_t)rand() & (state.length - 1);
+                Marginals a, b;
+                measure_state(&state, ctrl_mask, num_qubits, &a);
+                reference_measure(&state, ctrl_mask, num_qubits, &b);
+                if (a.num_qubits != b.num_qubits) failed = 1;
+                for (int k = 0; k < b.num_qubits; k++) {
+                    double d = fabs(a.zero[k] - b.zero[k]) + fabs(a.one[k] - b.one[k]);
+                    d /= 1 + b.zero[k] + b.one[k];
+                    if (d > max) max = d;
+                    if (a.phase[k] != b.phase[k]) failed = 1;
+                }
+            }
+            state_free(&state);
+        }
+    }
+    simd_select(SIMD_AUTO);
+    int ok = !failed && max < TOLERANCE;
+    printf("check measure_state: max difference %g (relative) %s\n", max, 
+            ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief Check that the LEDs after display_gate match a display_average
+/// of the same state, and the state matches multi_controlled_qubit_op, for
+/// random gates with up to three ctrl qubits
+static int check_display_gate(void) {
+    extern LED led[LED_NUM];
+    StateVector state, reference;
+    state_alloc(&state, 13);
+    state_alloc(&reference, 13);
+    random_state(&state, 3);
+    /// Normalise it, so the LED values are the ones the display would show
+    double scale = 1 / sqrt(state_norm(&state));
+    for (size_t i = 0; i < state.length; i++) {
+        AMP_RE(&state, i) *= scale;
+        AMP_IM(&state, i) *= scale;
+        AMP_RE(&reference, i) = AMP_RE(&state, i);
+        AMP_IM(&reference, i) = AMP_IM(&state, i);
+    }
+    display_average(&state);
+    srand(3);
+    double max = 0;
+    for (int g = 0; g < 200; g++) {
+        const Complex (*op)[2] = circuit_ops[rand() % CIRCUIT_OPS];
+        int targ = rand() % state.num_qubits;
+        size_t ctrl_mask = 0;
+        for (int c = rand() % 4; c > 0; c--) {
+            int ctrl = rand() % state.num_qubits;
+            if (ctrl != targ) ctrl_mask |= (size_t)1 << ctrl;
+        }
+        display_gate(op, ctrl_mask, targ, &state);
+        multi_controlled_qubit_op(op, ctrl_mask, targ, &reference);
+        LED shown[LED_NUM];
+        memcpy(shown, led, sizeof(shown));
+        display_average(&state);
+        for (int k = 0; k < LED_NUM; k++) {
+            double d = fabs(shown[k].N_R - led[k].N_R);
+            if (fabs(shown[k].N_G - led[k].N_G) > d) d = fabs(shown[k].N_G - led[k].N_G);
+            if (fabs(shown[k].N_B - led[k].N_B) > d) d = fabs(shown[k].N_B - led[k].N_B);
+            if (d > max) max = d;
+        }
+    }
+    double d = max_difference(&state, &reference);
+    state_free(&state);
+    state_free(&reference);
+    int ok = max < TOLERANCE && d < TOLERANCE;
+    printf("check display_gate: max difference from display_average %g, "
+            "state %g %s\n", max, d, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief The time in ns for a random circuit (one gate in four
+/// controlled) of depth gates per qubit, applied directly or queued
+static double time_circuit(bool queued, int depth, StateVector * state,
+        unsigned long * passes) {
+    GateQueue queue;
+    queue_init(&queue, state);
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    random_circuit(state, depth * state->num_qubits, 4, queued ? &queue : NULL, 2);
+    stop_timer();
+    *passes = queued ? queue.passes : (unsigned long)depth * state->num_qubits;
+    return (double)read_timer();
+}
+
+/// @brief The old Toffoli: five controlled gates
+static void toffoli_decomposed(int q1, int q2, int q3, StateVector * state) {
+    controlled_qubit_op(rX, q2, q3, state);
+    controlled_qubit_op(X, q1, q2, state);
+    controlled_qubit_op(rXT, q2, q3, state);
+    controlled_qubit_op(X, q1, q2, state);
+    controlled_qubit_op(rX, q1, q3, state);
+}
+
+/// @brief The new Toffoli: one pass
+static void toffoli_single(int q1, int q2, int q3, StateVector * state) {
+    multi_controlled_qubit_op(X, ((size_t)1 << q1) | ((size_t)1 << q2), q3, state);
+}
+
+/// @brief A Toffoli gate followed by a full display_average
+static void toffoli_display_average(int q1, int q2, int q3, StateVector * state) {
+    toffoli_single(q1, q2, q3, state);
+    display_average(state);
+}
+
+/// @brief A Toffoli gate which only displays the amplitudes it changes
+static void toffoli_display_gate(int q1, int q2, int q3, StateVector * state) {
+    display_gate(X, ((size_t)1 << q1) | ((size_t)1 << q2), q3, state);
+}
+
+/// @brief The time in ns for a gate on each qubit followed by the 
+/// display, separately or fused (display_gate)
+static double time_gate_display(const Complex op[2][2], bool fused, 
+        StateVector * state) {
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    for (int targ = 0; targ < state->num_qubits; targ++) {
+        if (fused) {
+            display_gate(op, 0, targ, state);
+        } else {
+            single_qubit_op(op, targ, state);
+            display_average(state);
+        }
+    }
+    stop_timer();
+    return (double)read_timer() / state->num_qubits;
+}
+
+/// @brief The time in ns for REPEATS Toffoli gates, averaged over the
+/// target qubits
+static double time_toffoli(void (*fn)(int, int, int, StateVector *),
+        StateVector * state) {
+    int n = state->num_qubits;
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    for (int r = 0; r < REPEATS; r++) {
+        for (int targ = 0; targ < n; targ++) {
+            fn((targ + 1) % n, (targ + 2) % n, targ, state);
+        }
+    }
+    stop_timer();
+    return (double)read_timer() / (REPEATS * n);
+}
+
+/// @brief controlled_qubit_op without its result, to time alongside
+/// controlled_qubit_op_old
+static void controlled_op(const Complex op[2][2], int ctrl, int targ,
+        StateVector * state) {
+    controlled_qubit_op(op, ctrl, targ, state);
+}
+
+/// @brief The time in ns for REPEATS controlled rX gates, averaged over the
+/// target qubits with the ctrl qubit next to them
+static double time_controlled(void (*fn)(const Complex[2][2], int, int, StateVector *),
+        StateVector * state) {
+    int n = state->num_qubits;
+    random_state(state, 1);
+    reset_timer();
+    start_timer();
+    for (int r = 0; r < REPEATS; r++) {
+        for (int targ = 0; targ < n; targ++) {
+            fn(rX, (targ + 1) % n, targ, state);
+        }
+    }
+    stop_timer();
+    return (double)read_timer() / (REPEATS * n);
+}
+
+/// @brief Run the micro-benchmarks and print them as CSV
+static int report(int qubits) {
+    StateVector state;
+    if (qubits < 2 || state_alloc(&state, qubits) != 0) {
+        fprintf(stderr, "bench: cannot make a %d qubit state\n", qubits);
+        return 1;
+    }
+    int max_results = NUM_BENCHMARKS * qubits;
+    BenchResult * results = malloc(max_results * sizeof(BenchResult));
+    if (results == NULL) {
+        state_free(&state);
+        return 1;
+    }
+    int count = benchmark_suite(&state, REPEATS, results, max_results);
+    printf("kernel,qubits,calls,%s,%s_per_call\n", BENCH_UNIT, BENCH_UNIT);
+    for (int n = 0; n < count; n++) {
+        printf("%s,%d,%lu,%lu,%.1f\n", benchmark_name(results[n].kernel),
+                results[n].num_qubits, results[n].calls, results[n].ticks,
+                (double)results[n].ticks / results[n].calls);
+    }
+    free(results);
+    state_free(&state);
+    return 0;
+}
+
+/// @brief Press and release a qubit button and check the events from the
+/// button scanner, and that a short bounce makes none
+static int check_input(void) {
+    InputEvent event;
+    int ok = 1;
+    setup_external_buttons();
+    input_setup();
+    sched_setup();
+    /// Qubit 2 is chip 1, line 1 (see setup_external_buttons)
+    host_set_buttons(1, 1 << 1);
+    input_wait(&event);
+    ok &= event.button == 2 && event.pressed;
+    host_set_buttons(1, 0);
+    input_wait(&event);
+    ok &= event.button == 2 && !event.pressed;
+    /// Down for fewer than INPUT_DEBOUNCE scans
+    host_set_buttons(1, 1 << 1);
+    hal_idle();
+    hal_idle();
+    host_set_buttons(1, 0);
+    for (int n = 0; n < 2 * INPUT_DEBOUNCE; n++) hal_idle();
+    ok &= input_get(&event) != 0;
+    /// Function button 0
+    extern BTN btn_func[];
+    host_set_buttons(btn_func[0].chip, 1 << btn_func[0].line);
+    input_wait(&event);
+    ok &= event.button == INPUT_FUNC(0) && event.pressed;
+    host_set_buttons(btn_func[0].chip, 0);
+    input_wait(&event);
+    ok &= event.button == INPUT_FUNC(0) && !event.pressed;
+    ok &= input_dropped() == 0;
+    hal_timer_enable(HAL_TIMER_TICK, false);
+    printf("check input: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// The scheduler test tasks and the ticks each one ran on
+static Task tasks[3];
+static unsigned long task_ticks[3][8];
+static int task_runs[3];
+
+/// A scheduler test task. Task 2 takes itself out after three runs
+static void test_task(void * arg) {
+    int n = *(int *)arg;
+    if (task_runs[n] < 8) task_ticks[n][task_runs[n]] = sched_now();
+    task_runs[n]++;
+    if (n == 2 && task_runs[n] == 3) sched_remove(&tasks[2]);
+}
+
+/// @brief Check the scheduler runs the tasks on the right ticks while
+/// sched_sleep waits
+static int check_sched(void) {
+    static int numbers[3] = {0, 1, 2};
+    int ok = 1;
+    sched_setup();
+    sched_add(&tasks[0], test_task, &numbers[0], 0, 3); // 0, 3, 6, 9
+    sched_add(&tasks[1], test_task, &numbers[1], 5, 0); // 5
+    sched_add(&tasks[2], test_task, &numbers[2], 1, 2); // 1, 3, 5
+    sched_sleep(12);
+    ok &= task_runs[0] == 4 && task_runs[1] == 1 && task_runs[2] == 3;
+    for (int k = 0; k < 4 && k < task_runs[0]; k++) {
+        ok &= task_ticks[0][k] == 3UL * k;
+    }
+    ok &= task_ticks[1][0] == 5;
+    for (int k = 0; k < 3 && k < task_runs[2]; k++) {
+        ok &= task_ticks[2][k] == 1 + 2UL * k;
+    }
+    ok &= sched_remove(&tasks[1]) == -1 && sched_remove(&tasks[2]) == -1;
+    ok &= sched_remove(&tasks[0]) == 0;
+    sched_sleep(6);
+    ok &= task_runs[0] == 4 && task_runs[2] == 3;
+    hal_timer_enable(HAL_TIMER_TICK, false);
+    printf("check sched: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Check a GateJob done in odd sized slices against 
+ * multi_controlled_qubit_op (with and without the norm tracked), a 
+ * MeasureJob against measure_state, and that sliced_gate_display stops soon
+ * after the reset button is pressed
+ */
+static int check_gate_job(void) {
+    StateVector a, b;
+    state_alloc(&a, 12);
+    state_alloc(&b, 12);
+    const size_t masks[4] = {0, 0x1, 0x82, 0x111};
+    double max = 0, norm = 0;
+    int ok = 1;
+    for (int tracked = 0; tracked < 2; tracked++) {
+        for (int k = 0; k < 4; k++) {
+            int targ = 2 + k;
+            random_state(&a, k);
+            random_state(&b, k);
+            state_renormalise(&a, tracked);
+            state_renormalise(&b, tracked);
+            GateJob job;
+            ok &= gate_job_init(&job, U, masks[k], targ, &a) == 0;
+            int steps = 1;
+            while (gate_job_step(&job, 100) != 0) steps++;
+            ok &= gate_job_step(&job, 100) == 0;
+            ok &= steps == (int)((job.pairs + 99) / 100);
+            multi_controlled_qubit_op(U, masks[k], targ, &b);
+            double d = max_difference(&a, &b);
+            if (d > max) max = d;
+            /// The change in the norm is the difference of two float sums
+            /// (added up in a different order by the threads), so it only
+            /// agrees to about 1e-4 of their size
+            double e = fabs(a.norm - b.norm) / b.norm;
+            if (e > norm) norm = e;
+        }
+    }
+    /// The slices are not the blocks measure_state uses, so the sums are 
+    /// added up in a different order (the counts are the same)
+    Marginals whole, sliced;
+    MeasureJob measure;
+    measure_state(&a, 0, MEASURE_QUBITS, &whole);
+    measure_job_init(&measure, &a, MEASURE_QUBITS, &sliced);
+    int steps = 1;
+    while (measure_job_step(&measure, 100) != 0) steps++;
+    ok &= steps == (int)(a.length / 112 + 1) && sliced.num_qubits == whole.num_qubits;
+    for (int k = 0; k < whole.num_qubits; k++) {
+        ok &= fabs(sliced.zero[k] - whole.zero[k]) < 1e-5 * whole.zero[k]
+                && fabs(sliced.one[k] - whole.one[k]) < 1e-5 * whole.one[k]
+                && sliced.phase[k] == whole.phase[k];
+    }
+    GateJob job;
+    ok &= gate_job_init(&job, U, 0x2, 1, &a) == -1;
+    ok &= gate_job_init(&job, U, 0, 12, &a) == -1;
+    state_renormalise(&a, false);
+    state_renormalise(&b, false);
+
+    /// Press reset (sw3 is active low) for long enough to count, then let
+    /// go, and apply a gate
+    setup_external_buttons();
+    input_setup();
+    sched_setup();
+    random_state(&a, 7);
+    random_state(&b, 7);
+    host_set_portd(0xFFFF & ~(1 << sw3));
+    for (int n = 0; n < INPUT_DEBOUNCE; n++) hal_idle();
+    host_set_portd(0xFFFF);
+    int result = sliced_gate_display(H, 0, 11, &a);
+    /// Only the first slice should have been done
+    size_t changed = 0;
+    for (size_t i = 0; i < a.length; i++) {
+        if (AMP_RE(&a, i) != AMP_RE(&b, i) || AMP_IM(&a, i) != AMP_IM(&b, i)) {
+            changed++;
+        }
+    }
+    ok &= result == -2 && changed <= 2 * GATE_SLICE;
+    InputEvent event;
+    ok &= input_get(&event) != 0; // The reset was taken out of the buffer
+    hal_timer_enable(HAL_TIMER_TICK, false);
+    state_free(&a);
+    state_free(&b);
+    ok &= max < TOLERANCE && norm < 1e-3;
+    printf("check gate job: max difference %g, norm %g (relative), reset after %zu "
+            "amplitudes %s\n", max, norm, changed, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Check sort_states against the probabilities of every basis state
+ * sorted the slow way, with and without a threshold
+ */
+static int check_sort_states(void) {
+    StateVector state;
+    state_alloc(&state, 12);
+    random_state(&state, 3);
+    /// Five equal ones over the threshold, and the rest below it
+    for (size_t i = 0; i < state.length; i++) {
+        AMP_RE(&state, i) *= 0.1;
+        AMP_IM(&state, i) *= 0.1;
+    }
+    for (size_t i = 0; i < state.length; i += 997) {
+        AMP_RE(&state, i) = 0.7;
+        AMP_IM(&state, i) = 0;
+    }
+    size_t count[2] = {0};
+    int ok = 1;
+    for (int t = 0; t < 2; t++) {
+        float threshold = t ? 0.4f : 0;
+        BasisProb top[CYCLE_TOP_K];
+        int n = sort_states(&state, top, CYCLE_TOP_K, threshold);
+        count[t] = n;
+        /// The kth most likely has exactly k more likely than it (ties go
+        /// to the smaller index)
+        for (int k = 0; k < n; k++) {
+            int above = 0;
+            for (size_t i = 0; i < state.length; i++) {
+                float p = amp_square_magnitude(&state, i) / NORM_TARGET;
+                if (p > top[k].p || (p == top[k].p && i < top[k].index)) above++;
+            }
+            ok &= above == k && top[k].p >= threshold;
+        }
+        /// Too few above the threshold to fill top
+        size_t over = 0;
+        for (size_t i = 0; i < state.length; i++) {
+            if (amp_square_magnitude(&state, i) / NORM_TARGET >= threshold) over++;
+        }
+        ok &= n == (over < CYCLE_TOP_K ? (int)over : CYCLE_TOP_K);
+    }
+    state_free(&state);
+    printf("check sort_states: %zu found, %zu over 0.4 %s\n", count[0], 
+            count[1], ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+/// @brief Show the next cycling frame, and work out the basis state it
+/// shows from the LED colors (green for ZERO, blue for ONE)
+static size_t cycle_frame(unsigned long * dwell) {
+    extern LED led[LED_NUM];
+    /// The interrupt moves on to the next frame, and then the scheduler
+    /// task writes it to the LEDs and tops up the ring
+    *dwell = host_fire_timer(HAL_TIMER_CYCLE);
+    hal_idle();
+    while (sched_run() == 0);
+    size_t i = 0;
+    for (int j = 0; j < NUM_QUBITS; j++) {
+        if (led[j].N_B > led[j].N_G) i |= (size_t)1 << j;
+    }
+    return i;
+}
+
+/// @brief The next frame which is shown (the interrupt looks again after
+/// CYCLE_RETRY when it has only skipped the frames of an old state)
+static size_t next_frame(unsigned long * dwell) {
+    size_t i = cycle_frame(dwell);
+    while (*dwell == CYCLE_RETRY) i = cycle_frame(dwell);
+    return i;
+}
+
+/**
+ * @brief Check that display_cycle shows the most likely basis states in
+ * turn for a time which goes with |a|^2, including more states than fit
+ * in the ring, starts again when the state changes, and stops for a gate
+ */
+static int check_cycle(void) {
+    StateVector state;
+    state_alloc(&state, NUM_QUBITS);
+    for (size_t i = 0; i < state.length; i++) {
+        AMP_RE(&state, i) = 0;
+        AMP_IM(&state, i) = 0;
+    }
+    const size_t basis[3] = {1, 6, 15};
+    const double p[3] = {0.5, 0.25, 0.25};
+    for (int k = 0; k < 3; k++) AMP_RE(&state, basis[k]) = sqrt(p[k]) * ONE_Q15;
+    setup_external_leds();
+    sched_setup();
+    display_cycle(&state);
+    int ok = 1;
+    double max = 0;
+    unsigned long dwell;
+    for (int n = 0; n < 12; n++) {
+        ok &= cycle_frame(&dwell) == basis[n % 3];
+        double d = fabs((dwell - CYCLE_MIN_DWELL) / (double)CYCLE_WEIGHTED_DWELL
+                - p[n % 3]);
+        if (d > max) max = d;
+    }
+    /// X on qubit 0: the next frame is from the new state
+    single_qubit_op(X, 0, &state);
+    hal_idle();
+    while (sched_run() == 0); // The task sees the change
+    for (int n = 0; n < 6; n++) ok &= next_frame(&dwell) == (basis[n % 3] ^ 1);
+    /// Sixteen equally likely: the first CYCLE_TOP_K are shown
+    for (size_t i = 0; i < state.length; i++) AMP_RE(&state, i) = 0.25;
+    state.changes++;
+    hal_idle();
+    while (sched_run() == 0);
+    for (int n = 0; n < 4 * CYCLE_TOP_K; n++) {
+        ok &= next_frame(&dwell) == (size_t)(n % CYCLE_TOP_K);
+    }
+    /// A gate shown on the LEDs goes back to the average display, and the 
+    /// function button turns cycling on and off again
+    ok &= display_cycling();
+    display_gate(X, 0, 0, &state);
+    ok &= !display_cycling();
+    toggle_cycle(&state);
+    ok &= display_cycling();
+    toggle_cycle(&state);
+    ok &= !display_cycling();
+    hal_timer_enable(HAL_TIMER_TICK, false);
+    state_free(&state);
+    ok &= max < 1e-3;
+    printf("check cycle: max dwell error %g %s\n", max, ok ? "ok" : "FAILED");
+    return ok ? 0 : -1;
+}
+
+int main(int argc, char ** argv) {
+    setup_timer();
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        return report((argc > 2) ? atoi(argv[2]) : 16);
+    }
+
+    int qubits = (argc > 1) ? atoi(argv[1]) : 20;
+
+    if (check_controlled() != 0) return 1;
+    if (check_multi() != 0) return 1;
+    if (check_special() != 0) return 1;
+    if (check_swap() != 0) return 1;
+    if (check_queue() != 0) return 1;
+    if (check_norm() != 0) return 1;
+    if (check_model_norm() != 0) return 1;
+    if (check_paged() != 0) return 1;
+    if (check_display() != 0) return 1;
+    if (check_measure() != 0) return 1;
+    if (check_display_gate() != 0) return 1;
+    if (check_input() != 0) return 1;
+    if (check_sched() != 0) return 1;
+    if (check_gate_job() != 0) return 1;
+    if (check_sort_states() != 0) return 1;
+    if (check_cycle() != 0) return 1;
+
+    StateVector state;
+    if (qubits < 3 || state_alloc(&state, qubits) != 0) {
+        fprintf(stderr, "bench: cannot make a %d qubit state\n", qubits);
+        return 1;
+    }
+    printf("\n%d qubits, %s kernel, ns per gate\n", qubits, simd_name());
+    double t_old = time_controlled(controlled_qubit_op_old, &state);
+    double t_new = time_controlled(controlled_op, &state);
+    simd_select(SIMD_SCALAR);
+    double t_scalar = time_controlled(controlled_op, &state);
+    simd_select(SIMD_AUTO);
+    printf("controlled_qubit_op_old      %12.0f\n", t_old);
+    printf("controlled_qubit_op (scalar) %12.0f  x%.2f\n", t_scalar, t_old / t_scalar);
+    printf("controlled_qubit_op          %12.0f  x%.2f\n", t_new, t_old / t_new);
+
+    double t_five = time_toffoli(toffoli_decomposed, &state);
+    double t_one = time_toffoli(toffoli_single, &state);
+    printf("toffoli (five controlled)    %12.0f\n", t_five);
+    printf("toffoli (multi-controlled)   %12.0f  x%.2f\n", t_one, t_five / t_one);
+    /// A few runs, each timing the gates both ways in turn so that they 
+    /// see the same load on the machine. The best times are shown, and 
+    /// display_gate must be faster in most of the runs
+    StateVector large;
+    int fused_qubits = (qubits > FUSED_QUBITS) ? qubits : FUSED_QUBITS;
+    if (state_alloc(&large, fused_qubits) != 0) {
+        fprintf(stderr, "bench: cannot make a %d qubit state\n", fused_qubits);
+        return 1;
+    }
+    double t_average = 0, t_display = 0, t_separate = 0, t_fused = 0;
+    double t_phase_separate = 0, t_phase_fused = 0;
+    int wins = 0, toffoli_wins = 0; // The runs display_gate was faster in
+    for (int r = 0; r < FUSED_RUNS; r++) {
+        double t[6] = {time_toffoli(toffoli_display_average, &large),
+                time_toffoli(toffoli_display_gate, &large),
+                time_gate_display(H, false, &large),
+                time_gate_display(H, true, &large),
+                time_gate_display(S, false, &large),
+                time_gate_display(S, true, &large)};
+        if (r == 0 || t[0] < t_average) t_average = t[0];
+        if (r == 0 || t[1] < t_display) t_display = t[1];
+        if (r == 0 || t[2] < t_separate) t_separate = t[2];
+        if (r == 0 || t[3] < t_fused) t_fused = t[3];
+        if (r == 0 || t[4] < t_phase_separate) t_phase_separate = t[4];
+        if (r == 0 || t[5] < t_phase_fused) t_phase_fused = t[5];
+        wins += t[3] < t[2];
+        toffoli_wins += t[1] < t[0];
+    }
+    state_free(&large);
+    printf("display_gate on %d qubits:\n", fused_qubits);
+    printf("H + display_average          %12.0f\n", t_separate);
+    printf("H + display_gate             %12.0f  x%.2f\n", t_fused, t_separate / t_fused);
+    printf("S + display_average          %12.0f\n", t_phase_separate);
+    printf("S + display_gate             %12.0f  x%.2f\n", t_phase_fused, 
+            t_phase_separate / t_phase_fused);
+    printf("toffoli + display_average    %12.0f\n", t_average);
+    printf("toffoli + display_gate       %12.0f  x%.2f\n", t_display, t_average / t_display);
+    printf("display_gate faster in %d (H) and %d (toffoli) of %d runs\n", 
+            wins, toffoli_wins, FUSED_RUNS);
+    /// S is only shown: it only writes half of the state, so there is much
+    /// less for the fused pass to save
+    if (2 * wins <= FUSED_RUNS || 2 * toffoli_wins <= FUSED_RUNS) {
+        printf("check display_gate timing: FAILED (slower than the gate and "
+                "display_average in most runs)\n");
+        return 1;
+    }
+
+    /// The special kinds, compared with a general matrix
+    double t_general = time_single(H, &state);
+    printf("general single qubit gate    %12.0f\n", t_general);
+    const char * names[] = {"X (swap)", "Y (antidiagonal)", "Z (sign)", "S (phase)"};
+    const Complex (*ops[])[2] = {X, Y, Z, S};
+    for (int g = 0; g < 4; g++) {
+        double t = time_single(ops[g], &state);
+        printf("%-28s %12.0f  x%.2f\n", names[g], t, t_general / t);
+    }
+    double t_cnots = time_swap(true, &state);
+    double t_swap = time_swap(false, &state);
+    printf("swap (three cNots)           %12.0f\n", t_cnots);
+    printf("swap (one pass)              %12.0f  x%.2f\n", t_swap, t_cnots / t_swap);
+
+    /// Random circuit, 8 gates per qubit
+    unsigned long passes_direct, passes_queued;
+    double t_direct = time_circuit(false, 8, &state, &passes_direct);
+    double t_queued = time_circuit(true, 8, &state, &passes_queued);
+    printf("\nrandom circuit, 8 gates per qubit, ns in total\n");
+    printf("direct (%4lu passes)          %12.0f\n", passes_direct, t_direct);
+    printf("queued (%4lu passes)          %12.0f  x%.2f\n", passes_queued, t_queued,
+            t_direct / t_queued);
+
+    compare_precisions(qubits);
+
+    state_free(&state);
+    return 0;
+}
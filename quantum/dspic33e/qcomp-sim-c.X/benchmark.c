@@ -0,0 +1,150 @@
+/**
+ * @file benchmark.c
+ *
+ * @brief Description: Micro-benchmarks for the gate kernels
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "benchmark.h"
+#include "consts.h"
+#include "display.h"
+#include "time.h"
+
+static const char * const names[NUM_BENCHMARKS] = {
+    "mat_mul",
+    "mat_mul_old",
+    "single_qubit_op",
+    "single_qubit_op_new",
+    "controlled_qubit_op",
+    "controlled_qubit_op_old",
+    "display_average",
+};
+
+const char * benchmark_name(BENCHMARK kernel) {
+    if (kernel < 0 || kernel >= NUM_BENCHMARKS) return "unknown";
+    return names[kernel];
+}
+
+/**
+ * @brief Fill the state with small pseudo-random amplitudes
+ *
+ * Starting from the vacuum, layers of H gates cancel amplitudes back to
+ * nearly zero, and on the host the rounding left behind soon becomes
+ * denormal, which is many times slower and would swamp the timings. Random
+ * amplitudes never cancel like that. They are at most 1/4 so the Q15 type
+ * on the dsPIC cannot overflow.
+ */
+static void random_amplitudes(StateVector * state) {
+    srand(1);
+    for (size_t i = 0; i < state->length; i++) {
+        AMP_RE(state, i) = (Q15)(0.5 * rand() / RAND_MAX - 0.25);
+        AMP_IM(state, i) = (Q15)(0.5 * rand() / RAND_MAX - 0.25);
+    }
+    state->changes++;
+}
+
+/// @brief The time taken to start and stop the timer with nothing between
+static unsigned long timer_overhead(void) {
+    unsigned long min = 0;
+    for (int n = 0; n < 8; n++) {
+        reset_timer();
+        start_timer();
+        stop_timer();
+        unsigned long t = read_timer();
+        if (n == 0 || t < min) min = t;
+    }
+    return min;
+}
+
+int benchmark_run(BENCHMARK kernel, StateVector * state, int num_qubits,
+        int repeats, BenchResult * result) {
+    if (num_qubits < 1 || num_qubits > state->num_qubits) return -1;
+    if (kernel < 0 || kernel >= NUM_BENCHMARKS) return -1;
+    /// The controlled ops need two qubits
+    if (num_qubits < 2 && (kernel == BENCH_CONTROLLED_QUBIT_OP
+            || kernel == BENCH_CONTROLLED_QUBIT_OP_OLD)) return -1;
+
+    /// Use the start of the storage as a smaller state. The SoA layout
+    /// still works because the indices stay below the smaller length.
+    StateVector view = *state;
+    view.num_qubits = num_qubits;
+    view.length = (size_t)1 << num_qubits;
+    random_amplitudes(&view);
+
+    unsigned long overhead = timer_overhead();
+    unsigned long calls = 0;
+    reset_timer();
+    start_timer();
+    for (int r = 0; r < repeats; r++) {
+        switch (kernel) {
+            case BENCH_MAT_MUL: {
+                unsigned int dsp = mat_mul_begin();
+                for (size_t i = 0; i < view.length; i += 2) {
+                    mat_mul(H, &view, i, i + 1);
+                }
+                mat_mul_end(dsp);
+                calls += view.length / 2;
+                break;
+            }
+            case BENCH_MAT_MUL_OLD:
+                for (size_t i = 0; i < view.length; i += 2) {
+                    mat_mul_old(H, &view, i, i + 1);
+                }
+                calls += view.length / 2;
+                break;
+            case BENCH_SINGLE_QUBIT_OP:
+                for (int k = 0; k < num_qubits; k++) {
+                    single_qubit_op(H, k, &view);
+                }
+                calls += num_qubits;
+                break;
+            case BENCH_SINGLE_QUBIT_OP_NEW:
+                for (int k = 0; k < num_qubits; k++) {
+                    single_qubit_op_new(H, k, &view);
+                }
+                calls += num_qubits;
+                break;
+            case BENCH_CONTROLLED_QUBIT_OP:
+                for (int k = 0; k < num_qubits; k++) {
+                    controlled_qubit_op(H, k, (k + 1) % num_qubits, &view);
+                }
+                calls += num_qubits;
+                break;
+            case BENCH_CONTROLLED_QUBIT_OP_OLD:
+                for (int k = 0; k < num_qubits; k++) {
+                    controlled_qubit_op_old(H, k, (k + 1) % num_qubits, &view);
+                }
+                calls += num_qubits;
+                break;
+            case BENCH_DISPLAY_AVERAGE:
+                display_average(&view);
+                calls++;
+                break;
+            default:
+                break;
+        }
+    }
+    stop_timer();
+    unsigned long ticks = read_timer();
+
+    result->kernel = kernel;
+    result->num_qubits = num_qubits;
+    result->calls = calls;
+    result->ticks = (ticks > overhead) ? ticks - overhead : 0;
+    return 0;
+}
+
+int benchmark_suite(StateVector * state, int repeats, BenchResult results[],
+        int max_results) {
+    int count = 0;
+    for (int kernel = 0; kernel < NUM_BENCHMARKS; kernel++) {
+        for (int n = 1; n <= state->num_qubits && count < max_results; n++) {
+            if (benchmark_run((BENCHMARK)kernel, state, n, repeats,
+                    &results[count]) == 0) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
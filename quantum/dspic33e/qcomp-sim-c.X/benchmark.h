@@ -0,0 +1,89 @@
+/**
+ * @file benchmark.h
+ *
+ * @brief Description: Micro-benchmarks for the gate kernels
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Times the kernels in quantum.c and display_average with the 32 bit timer
+ * in time.h, so the results are in instruction cycles on the dsPIC and in
+ * nanoseconds on the host (see BENCH_UNIT). Each kernel is run on states
+ * of 1 qubit up to the size of the state passed in, which is used as
+ * storage. On the dsPIC, build with BENCHMARK defined to run the suite
+ * from main and leave the results in a table for the debugger. On the host
+ * run `build/host/bench -r', which prints them as CSV.
+ */
+
+#ifndef BENCHMARK_H
+#define	BENCHMARK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "quantum.h"
+
+#ifdef __XC16__
+    /// The unit of the timer (see time.c)
+#define BENCH_UNIT "cycles"
+#else
+#define BENCH_UNIT "ns"
+#endif
+
+    /// @brief The functions which are timed
+    typedef enum {
+        BENCH_MAT_MUL, ///< mat_mul on every pair of qubit 0
+        BENCH_MAT_MUL_OLD, ///< mat_mul_old on every pair of qubit 0
+        BENCH_SINGLE_QUBIT_OP, ///< single_qubit_op on each qubit
+        BENCH_SINGLE_QUBIT_OP_NEW, ///< single_qubit_op_new on each qubit
+        BENCH_CONTROLLED_QUBIT_OP, ///< controlled_qubit_op on each qubit
+        BENCH_CONTROLLED_QUBIT_OP_OLD, ///< controlled_qubit_op_old on each qubit
+        BENCH_DISPLAY_AVERAGE, ///< display_average
+        NUM_BENCHMARKS,
+    } BENCHMARK;
+
+    /// @brief The time taken by one kernel on one size of state
+    typedef struct {
+        BENCHMARK kernel; ///< The function timed
+        int num_qubits; ///< The size of the state
+        unsigned long calls; ///< The number of calls timed
+        unsigned long ticks; ///< The total time, in BENCH_UNIT
+    } BenchResult;
+
+    /// @brief The name of a benchmarked function
+    const char * benchmark_name(BENCHMARK kernel);
+
+    /**
+     * @brief Time one function on the first num_qubits qubits of a state
+     * @param kernel The function to time
+     * @param state The storage used for the state (it is overwritten)
+     * @param num_qubits The size of state to time it on (at most
+     * state->num_qubits)
+     * @param repeats The number of times to repeat the calls
+     * @param result The time taken
+     * @return 0 if successful, -1 if num_qubits is not valid
+     *
+     * The state starts with random amplitudes and only unitary gates are
+     * applied.
+     * The time taken to start and stop the timer is subtracted.
+     */
+    int benchmark_run(BENCHMARK kernel, StateVector * state, int num_qubits,
+            int repeats, BenchResult * result);
+
+    /**
+     * @brief Time every function on every size of state
+     * @param state The storage used for the state (it is overwritten)
+     * @param repeats The number of times to repeat the calls
+     * @param results Space for the results, in the order kernel, then qubits
+     * @param max_results The size of results
+     * @return The number of results filled in
+     */
+    int benchmark_suite(StateVector * state, int repeats, BenchResult results[],
+            int max_results);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* BENCHMARK_H */
+
@@ -0,0 +1,186 @@
+/**
+ * @file circuit.c
+ *
+ * @brief Description: A text format for circuits, and a runner
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "circuit.h"
+#include "queue.h"
+
+/// The longest line in a circuit file
+#define LINE_LENGTH 256
+
+/// S gate (quarter turn phase)
+static const Complex S[2][2] = {{{1.0, 0.0}, {0.0, 0.0}},
+                                {{0.0, 0.0}, {0.0, 1.0}}};
+
+/// T gate (eighth turn phase)
+static const Complex T[2][2] = {{{1.0, 0.0}, {0.0, 0.0}},
+                                {{0.0, 0.0}, {0.7071067812, 0.7071067812}}};
+
+/// @brief The gates which can be used in a circuit file
+static const struct {
+    const char * name;
+    const Complex (*op)[2];
+} gate_names[] = {
+    {"x", X}, {"y", Y}, {"z", Z}, {"h", H},
+    {"s", S}, {"t", T}, {"rx", rX}, {"rxt", rXT},
+};
+
+#define NUM_GATE_NAMES (sizeof(gate_names) / sizeof(gate_names[0]))
+
+/// Add a gate to the end of the circuit
+static int add_gate(Circuit * circuit, const CircuitGate * gate) {
+    if (circuit->count == circuit->capacity) {
+        size_t capacity = circuit->capacity ? 2 * circuit->capacity : 64;
+        CircuitGate * gates = realloc(circuit->gates, capacity * sizeof(CircuitGate));
+        if (gates == NULL) return -1;
+        circuit->gates = gates;
+        circuit->capacity = capacity;
+    }
+    circuit->gates[circuit->count++] = *gate;
+    return 0;
+}
+
+/// Read a qubit number, which must be less than num_qubits
+static int read_qubit(const char * word, int num_qubits) {
+    char * end;
+    long qubit = strtol(word, &end, 10);
+    if (end == word || *end != '\0') return -1;
+    if (qubit < 0 || qubit >= num_qubits) return -1;
+    return (int)qubit;
+}
+
+/// Read the lines of a circuit file into circuit (see circuit_read)
+static int read_lines(Circuit * circuit, FILE * file, char * error, 
+        size_t error_length) {
+    char line[LINE_LENGTH];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        /// Cut off the comment and split the line into words
+        char * comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+        char * words[MAX_QUBITS + 2];
+        int num_words = 0;
+        for (char * word = strtok(line, " \t\r\n"); word != NULL;
+                word = strtok(NULL, " \t\r\n")) {
+            if (num_words == MAX_QUBITS + 2) {
+                snprintf(error, error_length, "line %d: too many qubits", line_number);
+                return -1;
+            }
+            words[num_words++] = word;
+        }
+        if (num_words == 0) continue;
+
+        if (strcasecmp(words[0], "qubits") == 0) {
+            int n = (num_words == 2) ? read_qubit(words[1], MAX_QUBITS + 1) : -1;
+            if (circuit->num_qubits != 0 || n < 1) {
+                snprintf(error, error_length, "line %d: expected qubits 1 to %d"
+                        " (once)", line_number, MAX_QUBITS);
+                return -1;
+            }
+            circuit->num_qubits = n;
+            continue;
+        }
+        if (circuit->num_qubits == 0) {
+            snprintf(error, error_length, "line %d: the number of qubits must"
+                    " come first", line_number);
+            return -1;
+        }
+
+        CircuitGate gate = {NULL, 0, -1, -1};
+        if (strcasecmp(words[0], "swap") == 0) {
+            if (num_words != 3
+                    || (gate.targ = read_qubit(words[1], circuit->num_qubits)) < 0
+                    || (gate.other = read_qubit(words[2], circuit->num_qubits)) < 0) {
+                snprintf(error, error_length, "line %d: expected swap and two"
+                        " qubits", line_number);
+                return -1;
+            }
+        } else {
+            for (size_t n = 0; n < NUM_GATE_NAMES; n++) {
+                if (strcasecmp(words[0], gate_names[n].name) == 0) {
+                    gate.op = gate_names[n].op;
+                }
+            }
+            if (gate.op == NULL) {
+                snprintf(error, error_length, "line %d: unknown gate %s",
+                        line_number, words[0]);
+                return -1;
+            }
+            if (num_words < 2
+                    || (gate.targ = read_qubit(words[1], circuit->num_qubits)) < 0) {
+                snprintf(error, error_length, "line %d: expected a targ qubit",
+                        line_number);
+                return -1;
+            }
+            for (int w = 2; w < num_words; w++) {
+                int ctrl = read_qubit(words[w], circuit->num_qubits);
+                if (ctrl < 0 || ctrl == gate.targ 
+                        || (gate.ctrl_mask & ((size_t)1 << ctrl))) {
+                    snprintf(error, error_length, "line %d: bad ctrl qubit %s",
+                            line_number, words[w]);
+                    return -1;
+                }
+                gate.ctrl_mask |= (size_t)1 << ctrl;
+            }
+        }
+        if (add_gate(circuit, &gate) != 0) {
+            snprintf(error, error_length, "line %d: out of memory", line_number);
+            return -1;
+        }
+    }
+    if (circuit->num_qubits == 0) {
+        snprintf(error, error_length, "the number of qubits is missing");
+        return -1;
+    }
+    return 0;
+}
+
+int circuit_read(Circuit * circuit, FILE * file, char * error, 
+        size_t error_length) {
+    circuit->num_qubits = 0;
+    circuit->count = 0;
+    circuit->capacity = 0;
+    circuit->gates = NULL;
+    if (read_lines(circuit, file, error, error_length) == 0) return 0;
+    circuit_free(circuit); // The gates read before the error
+    return -1;
+}
+
+void circuit_free(Circuit * circuit) {
+    free(circuit->gates);
+    circuit->gates = NULL;
+    circuit->count = 0;
+    circuit->capacity = 0;
+}
+
+long circuit_run(const Circuit * circuit, StateVector * state, bool fuse) {
+    if (state->num_qubits != circuit->num_qubits) return -1;
+    GateQueue queue;
+    queue_init(&queue, state);
+    long passes = 0;
+    for (size_t n = 0; n < circuit->count; n++) {
+        const CircuitGate * gate = &circuit->gates[n];
+        if (gate->op == NULL) {
+            /// Swaps are not queued, so the gates before it must be applied
+            queue_flush(&queue);
+            swap_qubits(gate->targ, gate->other, state);
+            passes++;
+        } else if (fuse) {
+            queue_controlled_gate(&queue, gate->op, gate->ctrl_mask, gate->targ);
+        } else {
+            multi_controlled_qubit_op(gate->op, gate->ctrl_mask, gate->targ, state);
+            passes++;
+        }
+    }
+    queue_flush(&queue);
+    return passes + (long)queue.passes;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file circuit.h
+ *
+ * @brief Description: A text format for circuits, and a runner
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (not part of the MPLAB project). A circuit file has one 
+ * statement per line:
+ *
+ * \verbatim
+ *   # A comment runs to the end of the line
+ *   qubits 3         The number of qubits (must come before any gates)
+ *   h 0              A gate: the name, then the targ qubit
+ *   x 2 0 1          Controls follow the targ (here a Toffoli on 2)
+ *   swap 0 1         Swap two qubits
+ * \endverbatim
+ *
+ * The gate names are x, y, z, h, s, t, rx and rxt (see consts.h). Names are
+ * not case sensitive. The circuit runner in qcircuit.c loads a file and
+ * runs it through the kernels in quantum.c.
+ */
+
+#ifndef CIRCUIT_H
+#define	CIRCUIT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "quantum.h"
+
+    /// @brief A statement in a circuit
+    typedef struct {
+        const Complex (*op)[2]; ///< The matrix (NULL for a swap)
+        size_t ctrl_mask; ///< The ctrl qubits
+        int targ; ///< The targ qubit (the first qubit for a swap)
+        int other; ///< The second qubit for a swap
+    } CircuitGate;
+
+    /// @brief A circuit loaded from a file
+    typedef struct {
+        int num_qubits; ///< The number of qubits
+        size_t count; ///< The number of gates
+        size_t capacity; ///< The space allocated for gates
+        CircuitGate * gates; ///< The gates, in order
+    } Circuit;
+
+    /**
+     * @brief Read a circuit from a file
+     * @param circuit The circuit to fill in
+     * @param file The file to read
+     * @param error Space for an error message
+     * @param error_length The size of error
+     * @return 0 if successful, -1 otherwise (with a message in error)
+     *
+     * Free the circuit with circuit_free when it is finished with. If this
+     * fails, the gates read so far are freed here (and calling 
+     * circuit_free as well does no harm).
+     */
+    int circuit_read(Circuit * circuit, FILE * file, char * error, 
+            size_t error_length);
+
+    /// @brief Free the memory used by a circuit
+    void circuit_free(Circuit * circuit);
+
+    /**
+     * @brief Apply a circuit to a state
+     * @param circuit The circuit
+     * @param state A state with circuit->num_qubits qubits
+     * @param fuse true to run the gates through a GateQueue
+     * @return The number of passes over the state, or -1 if the state is
+     * the wrong size
+     */
+    long circuit_run(const Circuit * circuit, StateVector * state, bool fuse);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CIRCUIT_H */
+
@@ -16,14 +16,17 @@ extern "C" {
 #include <stdbool.h>
 #include <stdlib.h>
 
+/// The number of qubits on the board (one button and one LED each).
+/// The state vector itself can hold anywhere from 1 to MAX_QUBITS qubits
 #define NUM_QUBITS 4
 #define STATE_LENGTH 16 // 2^NUM_QUBITS
 
-// ONE_Q15 / 2^(NUM_QUBITS - 1) 
-// The unit used when averaging for phase calculations
-#define FULL_PHASE 0.124996185
-        // half of full phase
-#define HALF_PHASE 0.062498093
+/// The largest state vector that can be made
+#ifdef __XC16__
+#define MAX_QUBITS 14
+#else
+#define MAX_QUBITS 30
+#endif
 
 /// The number of external LEDs  
 #define LED_NUM 4 
@@ -31,13 +34,45 @@ extern "C" {
 /// number of total buttons
 #define NUM_BTNS 9 
 
+/// The largest amplitude (just below one for the fractional types)
+#ifdef AMP_Q31
+#define ONE_Q15 0.9999999995
+#else
 #define ONE_Q15 0.9999694824
+#endif
     
 // number of button drivers
 #define BTN_CHIP_NUM 2
     
+/// The amplitude type is Q15 unless AMP_Q31 is defined, in which case it
+/// is Q31 (still called Q15 in the code) for long circuits which would
+/// otherwise drift (see state_renormalise). Q15 is just the name of the 
+/// amplitude type: on the host it is float or double, so the host q31 
+/// build only checks the code at the higher precision. It tests none of the
+/// fixed point behaviour (rounding and saturation), which is modelled in 
+/// precision.h instead
+#ifdef __XC16__
+#ifdef AMP_Q31
+/// Long fractional type (1.31)
+typedef signed long _Fract Q15;
+#else
 /// Basic fractional time
 typedef signed _Fract Q15; 
+#endif
+
+/// Unsigned fractional type (used for LED brightnesses)
+typedef unsigned _Fract UQ16;
+#else
+/// The host compilers do not support the fixed point types, so the 
+/// fractional types are replaced by float in the host build (double 
+/// with AMP_Q31)
+#ifdef AMP_Q31
+typedef double Q15;
+#else
+typedef float Q15;
+#endif
+typedef float UQ16;
+#endif
     
 /// Complex type
 typedef Q15 Complex[2];
@@ -3,6 +3,51 @@
 
 #include "display.h"
 
+/// The number of display_gate updates between full passes (so that the
+/// rounding errors in the sums don't build up)
+#define DISPLAY_RESYNC 64
+
+/**
+ * @brief The values shown on the LEDs for each qubit, kept between gates
+ * 
+ * The measurements (see Marginals in quantum.h) are sums of |a|^2 over 
+ * the amplitudes where the qubit is ZERO or ONE, and the number of pairs
+ * with a phase difference. The LED for the qubit shows red if there are 
+ * any, so the number is kept rather than a flag, which lets display_gate 
+ * take pairs away and add them back.
+ */
+typedef struct {
+    Marginals values; ///< The measurements of the LED qubits
+    const StateVector * state; ///< The state the values are for
+    unsigned long changes; ///< state->changes when they were worked out
+    int updates; ///< The display_gate updates since the last full pass
+} DisplayModel;
+
+static DisplayModel model = {{0}, NULL, 0, 0};
+
+/// @brief Note that the model is up to date with the state
+static void model_valid(const StateVector * state, bool full) {
+    model.state = state;
+    model.changes = state->changes;
+    if (full) model.updates = 0;
+    else model.updates++;
+}
+
+/// @brief Show the model on the LEDs (which stops the cycling display)
+static void model_show(void) {
+    const Marginals * m = &model.values;
+    if (display_cycling()) display_cycle_stop();
+    /// The colors are shown together once they are all worked out
+    RGB colors[LED_NUM];
+    for (int k = 0; k < m->num_qubits; k++) {
+        /// update leds for each qubits average zero and one amps
+        colors[k].R = (m->phase[k] > 0) ? 0.99 : 0.0;
+        colors[k].G = 0.2 * m->one[k];
+        colors[k].B = 0.2 * m->zero[k];
+    }
+    set_external_leds(colors, m->num_qubits);
+}
+
 /**
  * @brief Display the state amplitudes on LEDs
  * @param state Pass in the state vector
@@ -10,132 +55,281 @@
  * @note Currently the function only displays superpositions using the
  * red and blue colors.
  * 
+ * All the LED qubits are measured in one pass over the state (see 
+ * measure_state), and the values are kept for display_gate.
  */
-void display_average(Complex state[]) {
-    /// @todo Bring all constants out of the loops. Don't use pow.
+void display_average(StateVector * state) {
     /// @bug there is a phase bug when cycling the gates 
-    /// Loop over all qubits k = 0, 1, 2, ... N-1
-    for (int k = 0; k < NUM_QUBITS; k ++) {
-        /// Compute powers of 2
-        int root_max = pow2(k);
-        int increment = 2 * root_max;
-        Q15 zero_amp = 0, one_amp = 0;
-        Q15 phase = 0;
-        Q15 tmp1 = 0;
-        Q15 tmp2 = 0;
-        int c = 0;
-        /// ROOT loop: starts at 0, increases in steps of 1
-        for(int root = 0; root < root_max; root ++) {
-            /// STEP loop: starts at 0, increases in steps of 2^(k+1)
-            for(int step = 0; step < STATE_LENGTH; step += increment) {
-
-                /// @bug The problem is with the sign function, which will
-                /// not distinguish between (e.g.) 1 and i. I think all the 
-                /// problems stem from that kind of error.
-                /// c = sign(state[root + step]) - sign(state[root + root_max + step]);
-                
-                
-                /// Compute two temporary variables to check real and imaj signs
-                tmp1 = state[root+step][0]*state[root + root_max + step][0];
-                tmp2 = state[root+step][1]*state[root + root_max + step][1];
-                c = 0;
-                /// Set c = 1 if there is a phase difference in either r or i
-                
-                if(tmp1 < -0.01) c = 1;
-                if(tmp2 < -0.01) c = 1;
-                /*
-                // Deal with zero cases
-                if (state[root + step][0] == 0.0 ||
-                        state[root + root_max + step][0] == 0.0) {
-                    if (state[root + step][0] < -0.001 ||
-                            state[root + root_max + step][0] < -0.01) {
-                        c = 1; /// Treat 0 and -ve as a difference in phase
-                    }
-                }
-                if (state[root + step][1] == 0.0 ||
-                        state[root + root_max + step][1] == 0.0) {
-                    if (state[root + step][1] < -0.001 ||
-                            state[root + root_max + step][1] < -0.01) {
-                        c = 1; /// Treat 0 and -ve as a difference in phase
-                    }
-                }
-                */
-                ///if(c==1 || c==3 || c==2)
-                if(c==1) phase += FULL_PHASE;
-                
-                /// Zeros are at the index root + step
-                /// @todo Rewrite pow for Q15 
-                zero_amp += square_magnitude(state[root + step]);
-                /// Ones are at the index root + 2^k + step
-                one_amp += square_magnitude(state[root + root_max + step]);
-                
-
-            }
+    /// Only the first LED_NUM qubits have an LED
+    measure_state(state, 0, LED_NUM, &model.values);
+    model_valid(state, true);
+    model_show();
+}
+
+/**
+ * The model is marked out of date until the last slice, so display_gate 
+ * starts from scratch if the job is given up.
+ */
+void display_job_init(MeasureJob * job, StateVector * state) {
+    model.state = NULL;
+    measure_job_init(job, state, LED_NUM, &model.values);
+}
+
+int display_job_step(MeasureJob * job, size_t max_amps) {
+    if (measure_job_step(job, max_amps) != 0) return 1;
+    model_valid(job->state, true);
+    model_show();
+    return 0;
+}
+
+/// @brief Whether the model is still up to date with the state (nothing
+/// else has changed it since the last display_average or display_gate)
+static bool model_current(const StateVector * state) {
+    return model.state == state && model.changes == state->changes 
+            && model.updates < DISPLAY_RESYNC;
+}
+
+/**
+ * A gate only mixes the pairs of amplitudes which differ in targ, so the 
+ * |a|^2 sums of the other qubits stay the same, and a gate which only 
+ * multiplies the amplitudes (a diagonal one, see classify_gate) changes
+ * none of them. Swapping the amplitudes (X, Y) swaps the ZERO and ONE sums
+ * of targ. So while the model is up to date the sums are only worked out
+ * again for a general gate on an LED qubit, and otherwise only the phase 
+ * differences are counted (see measure_qubit_op).
+ * 
+ * A gate with no ctrl qubits changes every amplitude, so the measurements
+ * are done again after it, in the same pass as the gate.
+ * 
+ * A gate with ctrl qubits only changes the amplitudes where they are all
+ * ONE. If the model is up to date, those amplitudes are measured before 
+ * and after the gate in the same pass, and the difference is added to the
+ * model. Otherwise (or if the controls are low enough that the pass goes
+ * over most of the state anyway, see measure_op_length) the model is 
+ * worked out from scratch after the gate.
+ */
+int display_gate(const Complex op[2][2], size_t ctrl_mask, int targ, 
+        StateVector * state) {
+    Marginals * m = &model.values;
+    GateKind kind = classify_gate(op);
+    bool diagonal = kind == GATE_IDENTITY || kind == GATE_DIAGONAL 
+            || kind == GATE_PHASE || kind == GATE_SIGN;
+    bool swap = kind == GATE_SWAP || kind == GATE_ANTIDIAGONAL;
+    bool led_targ = targ < m->num_qubits;
+    bool current = model_current(state);
+    /// Whether the sums have to be worked out again
+    bool sums = led_targ && !diagonal;
+    if (ctrl_mask == 0) {
+        if (!current || (sums && !swap)) {
+            int result = measure_qubit_op(op, 0, targ, state, LED_NUM, true,
+                    NULL, m);
+            if (result != 0) return result;
+            model_valid(state, true);
+            model_show();
+            return 0;
         }
-        /// write phase
-        /// update leds for each qubits average zero and one amps
-        one_amp = 0.2 * one_amp;
-        zero_amp = 0.2 * zero_amp;
-        if (phase != 0.0) phase = 0.99;
-        else phase = 0.0;
-        set_external_led(k, phase, one_amp, zero_amp);
+        Marginals after;
+        int result = measure_qubit_op(op, 0, targ, state, LED_NUM, false,
+                NULL, &after);
+        if (result != 0) return result;
+        if (sums) {
+            Q15 zero = m->zero[targ];
+            m->zero[targ] = m->one[targ];
+            m->one[targ] = zero;
+        }
+        for (int k = 0; k < m->num_qubits; k++) m->phase[k] = after.phase[k];
+        model_valid(state, false);
+        model_show();
+        return 0;
+    }
+    /// The amplitudes are measured before and after the gate, so this is
+    /// only quicker if the controls leave out over half of them
+    bool incremental = current 
+            && 2 * measure_op_length(ctrl_mask, targ, state, LED_NUM) < state->length;
+    if (!incremental) {
+        int result = multi_controlled_qubit_op(op, ctrl_mask, targ, state);
+        display_average(state);
+        return result;
     }
+    Marginals before, after;
+    int result = measure_qubit_op(op, ctrl_mask, targ, state, LED_NUM, 
+            sums, &before, &after);
+    if (result != 0) return result;
+    for (int k = 0; k < m->num_qubits; k++) {
+        if (sums) {
+            m->zero[k] += after.zero[k] - before.zero[k];
+            m->one[k] += after.one[k] - before.one[k];
+        }
+        m->phase[k] += after.phase[k] - before.phase[k];
+    }
+    model_valid(state, false);
+    model_show();
+    return 0;
 }
 
 /**
- * @param state The state to display
- * @param N The length of the state vector
+ * @brief The top K basis states are kept in a heap with the smallest
+ * probability at the root, so a new one only has to beat the root.
+ * Equal probabilities go to the smaller index, so the order is fixed.
  */
-void display_cycle(Complex state[]) {
-    
-    int output[STATE_LENGTH];
-    
-    /// Filter the state
-    int cycle_length = remove_zero_amp_states(state, output);
-    
-    /// Allocate RGB array
-    RGB colors[cycle_length][NUM_QUBITS];
-    
-    /// Decode 
-    for(int k=0; k < cycle_length; k++) {
-        for(int j=0; j < NUM_QUBITS; j++) {
-            colors[k][j].R = 0;
-            colors[k][j].G = 0;
-            colors[k][j].B = 0;
-            /// Look at the jth bit
-            if((output[k] & (1 << j)) == 0) {
-                colors[k][j].G = ONE_Q15;
-            } else {
-                colors[k][j].B = ONE_Q15;
-            }
+static bool more_likely(const BasisProb * a, const BasisProb * b) {
+    return a->p > b->p || (a->p == b->p && a->index < b->index);
+}
+
+/// @brief Move heap[n] down until it is less likely than its children
+static void sift_down(BasisProb heap[], int count, int n) {
+    while (1) {
+        int least = n, child = 2 * n + 1;
+        for (int c = child; c < child + 2 && c < count; c++) {
+            if (more_likely(&heap[least], &heap[c])) least = c;
         }
+        if (least == n) return;
+        BasisProb t = heap[n];
+        heap[n] = heap[least];
+        heap[least] = t;
+        n = least;
     }
-    /// Reset the cycle
-    reset_cycle();
+}
 
-    for (int k = 0; k < cycle_length; k++) {
-        /// Each iteration of this loop writes 
+/// @brief Offer a basis state to a heap of at most k
+static void top_push(BasisProb heap[], int * count, int k, size_t i, float p) {
+    BasisProb b = {i, p};
+    if (*count < k) {
+        /// Move it up past the more likely parents
+        int n = (*count)++;
+        while (n > 0 && more_likely(&heap[(n - 1) / 2], &b)) {
+            heap[n] = heap[(n - 1) / 2];
+            n = (n - 1) / 2;
+        }
+        heap[n] = b;
+    } else if (k > 0 && more_likely(&b, &heap[0])) {
+        heap[0] = b;
+        sift_down(heap, *count, 0);
+    }
+}
 
-        /// Loop here to add stuff
-        add_to_cycle(colors[k], NUM_QUBITS);
+/// @brief Sort the heap, most likely first (the least likely is taken
+/// off the root and put at the end each time)
+static void top_sort(BasisProb heap[], int count) {
+    for (int n = count - 1; n > 0; n--) {
+        BasisProb t = heap[0];
+        heap[0] = heap[n];
+        heap[n] = t;
+        sift_down(heap, n, 0);
     }
+}
 
+/// @brief The probability of basis state i (|a|^2 relative to NORM_TARGET)
+static float basis_prob(const StateVector * state, size_t i) {
+    float p = amp_square_magnitude(state, i) / NORM_TARGET;
+    return (p > 1) ? 1 : p;
 }
 
 /**
- * 
  * @param state The state vector
- * @param num_qubits The number of qubits in the state vector
- * @return 
- * 
- * This function finds the amplitude of the state vector with the largest
- * magnitude. 
+ * @param top The basis states found, most likely first
+ * @param k The most to find (the length of top)
+ * @param threshold The smallest probability to include
+ * @return The number found
  * 
+ * One pass over the state, keeping the k most likely so far in a heap,
+ * so only k entries are stored whatever the size of the state.
  */
-#define NUM_MAX_AMPS 4 /// Define the number of largest amplitudes to store
-int sort_states(Complex state[], int num_qubits){
-    /// @todo this function...
-    return 0;
+int sort_states(const StateVector * state, BasisProb top[], int k, 
+        float threshold) {
+    int count = 0;
+    for (size_t i = 0; i < state->length; i++) {
+        float p = basis_prob(state, i);
+        if (p >= threshold && p > 0) top_push(top, &count, k, i, p);
+    }
+    top_sort(top, count);
+    return count;
+}
+
+/// @brief The state being cycled (see display_cycle)
+typedef struct {
+    StateVector * state; ///< The state
+    unsigned long changes; ///< state->changes when the cycle started
+    size_t scanned; ///< The amplitudes looked at so far
+    BasisProb top[CYCLE_TOP_K]; ///< The most likely basis states
+    int count; ///< The number of them
+    bool ready; ///< Whether the scan is finished (and top sorted)
+    int next; ///< The next one to add to the ring
+    Task task; ///< The task which adds the frames
+    bool going; ///< Whether it is going (see display_cycling)
+} DisplayCycle;
+
+/// Zeroed (as a static is), which the Task needs (see sched.h)
+static DisplayCycle cycle;
+
+/// @brief Start looking for the most likely basis states again
+static void cycle_restart(void) {
+    cycle.changes = cycle.state->changes;
+    cycle.scanned = 0;
+    cycle.count = 0;
+    cycle.ready = false;
+    cycle.next = 0;
+}
+
+/**
+ * @brief Show the frame _T7Interrupt has moved on to, look at the next 
+ * CYCLE_SCAN amplitudes, and once they have all been looked at, add 
+ * frames for the most likely basis states until the ring is full
+ */
+static void cycle_task(void * arg) {
+    (void)arg;
+    StateVector * state = cycle.state;
+    if (state->changes != cycle.changes) {
+        /// Start again, dropping the frames of the old state
+        reset_cycle();
+        cycle_restart();
+    }
+    show_cycle();
+    if (!cycle.ready) {
+        /// The sort_states pass, a slice at a time
+        for (int n = 0; n < CYCLE_SCAN && cycle.scanned < state->length; n++) {
+            size_t i = cycle.scanned++;
+            float p = basis_prob(state, i);
+            if (p >= CYCLE_THRESHOLD && p > 0) 
+                top_push(cycle.top, &cycle.count, CYCLE_TOP_K, i, p);
+        }
+        if (cycle.scanned < state->length) return;
+        top_sort(cycle.top, cycle.count);
+        cycle.ready = true;
+    }
+    while (cycle.count > 0 && cycle_space() > 0) {
+        const BasisProb * b = &cycle.top[cycle.next];
+        cycle.next = (cycle.next + 1) % cycle.count;
+        /// Look at each bit of the basis state
+        RGB colors[NUM_QUBITS];
+        for (int j = 0; j < NUM_QUBITS; j++) {
+            colors[j].R = 0;
+            colors[j].G = ((b->index & ((size_t)1 << j)) == 0) ? ONE_Q15 : 0;
+            colors[j].B = ((b->index & ((size_t)1 << j)) == 0) ? 0 : ONE_Q15;
+        }
+        add_to_cycle(colors, NUM_QUBITS, 
+                CYCLE_MIN_DWELL + (unsigned long)(b->p * CYCLE_WEIGHTED_DWELL));
+    }
+}
+
+void display_cycle(StateVector * state) {
+    cycle.state = state;
+    cycle_restart();
+    reset_cycle();
+    sched_add(&cycle.task, cycle_task, NULL, 0, 1); // -1 if already going
+    cycle_task(NULL); // The first frames straight away
+    start_cycle();
+    cycle.going = true;
+}
+
+void display_cycle_stop(void) {
+    cycle.going = false;
+    sched_remove(&cycle.task);
+    stop_cycle();
+}
+
+bool display_cycling(void) {
+    return cycle.going;
 }
 
 /// @brief takes state vector, number of qubits and vector to write the nonzero elements
@@ -155,10 +349,10 @@ int sort_states(Complex state[], int num_qubits){
 /// In the Bell state example there are 2 values in disp_state, 0 & 3, count is returned
 /// as 3 which means take the first count-1 elements (in this case 2) of disp_state which 
 /// is 0,1 which is the correct elements
-int remove_zero_amp_states(Complex state[], int disp_state[]) {
+int remove_zero_amp_states(StateVector * state, size_t disp_state[], int max) {
     int count = 0;
-    for (int i = 0; i < STATE_LENGTH; i++) {
-        if (absolute(state[i]) > 0.0) {
+    for (size_t i = 0; i < state->length && count < max; i++) {
+        if (amp_square_magnitude(state, i) > 0.0) {
             disp_state[count] = i;
             count++;
         }
@@ -17,6 +17,7 @@ extern "C" {
 
 #include "quantum.h"
 #include "io.h"
+#include "sched.h"
 
 
        /**
@@ -27,21 +28,104 @@ extern "C" {
      * red and blue colors.
      * @todo rename to display_average
      */
-    void display_average(Complex state[]);
+    void display_average(StateVector * state);
     
-    /// @brief cycles through the non-zero amplitude states
-    void display_cycle(Complex state[]);
+    /**
+     * @brief Apply a gate and display the new state
+     * @param op The 2x2 operator
+     * @param ctrl_mask The ctrl qubits (0 for a single qubit gate)
+     * @param targ The target qubit
+     * @param state The state vector
+     * @return 0 if successful, -1 otherwise
+     * 
+     * The same as multi_controlled_qubit_op followed by display_average,
+     * but only the amplitudes the gate changes are gone over again
+     */
+    int display_gate(const Complex op[2][2], size_t ctrl_mask, int targ, 
+            StateVector * state);
+
+    /**
+     * @brief Set up a display_average which is done a slice at a time
+     * @param job The job
+     * @param state The state vector
+     */
+    void display_job_init(MeasureJob * job, StateVector * state);
+
+    /**
+     * @brief Measure the next slice of the state for the display
+     * @param job The job
+     * @param max_amps The most amplitudes to measure
+     * @return 1 if there are amplitudes left, 0 if the state is displayed
+     */
+    int display_job_step(MeasureJob * job, size_t max_amps);
+    
+    /// The shortest time a basis state is shown for when cycling, in timer
+    /// cycles (about 40 ms)
+#define CYCLE_MIN_DWELL 0x00200000
+
+    /// The time shared out between the basis states in proportion to
+    /// |a|^2, in timer cycles (about 1.3 s)
+#define CYCLE_WEIGHTED_DWELL 0x04000000
+
+    /// The amplitudes display_cycle looks through each tick
+#define CYCLE_SCAN 256
+
+    /// The most basis states display_cycle shows (the most likely ones)
+#define CYCLE_TOP_K 8
+
+    /// The smallest probability display_cycle shows
+#define CYCLE_THRESHOLD (1.0f / 1024)
+
+    /**
+     * @brief cycles through the non-zero amplitude states
+     * @param state The state to display (it must stay put until 
+     * display_cycle_stop)
+     * 
+     * The CYCLE_TOP_K most likely basis states (see sort_states) are shown
+     * in turn, most likely first, each for CYCLE_MIN_DWELL + |a|^2 
+     * CYCLE_WEIGHTED_DWELL, with green for a ZERO qubit and blue for a ONE.
+     * States less likely than CYCLE_THRESHOLD are left out. A scheduler 
+     * task (see sched.h) does the sort_states pass CYCLE_SCAN amplitudes
+     * a tick, and then keeps the ring of frames in io.c topped up from the
+     * CYCLE_TOP_K it found. If the state changes, the cycle starts again
+     * from the new state.
+     */
+    void display_cycle(StateVector * state);
+
+    /// @brief Stop cycling the basis states (the LEDs are then left for
+    /// display_average, which also stops it)
+    void display_cycle_stop(void);
+
+    /// @brief Whether the basis states are being cycled (from display_cycle
+    /// until display_cycle_stop, a reset or a gate)
+    bool display_cycling(void);
 
     /// @brief updates disp_state where the first 'return value of the function'elements
     /// are the nonzero elements of the state vector 'state'
     /// @param state complex state vector in
     /// @param disp_state complex inout vector where the first n entries are the nonzero
     /// elements of 'state'
+    /// @param max the length of disp_state. At most max indices are written
     /// @return returns the number of elements to look at in disp_state.
-    int remove_zero_amp_states(Complex state[], int disp_state[]);
+    int remove_zero_amp_states(StateVector * state, size_t disp_state[], int max);
 
-    /// @todo this
-    int sort_states(Complex state[], int num_qubits);
+    /// @brief A basis state and its probability
+    typedef struct {
+        size_t index; ///< The basis state
+        float p; ///< |a|^2 relative to NORM_TARGET
+    } BasisProb;
+
+    /**
+     * @brief Find the k most likely basis states
+     * @param state The state vector
+     * @param top The basis states found, most likely first (equal 
+     * probabilities in order of index)
+     * @param k The most to find (the length of top)
+     * @param threshold The smallest probability to include
+     * @return The number found
+     */
+    int sort_states(const StateVector * state, BasisProb top[], int k, 
+            float threshold);
 
 #ifdef	__cplusplus
 }
@@ -0,0 +1,128 @@
+/**
+ * @file hal.h
+ *
+ * @brief Description: Hardware abstraction layer for port D, the interrupt
+ * timers and the interrupt controller.
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * The simulator core (quantum.c, algo.c, display.c and io.c) only touches
+ * the hardware through the functions in this file and in spi.h and time.h.
+ * There are two backends:
+ *
+ *   - hal_dspic.c, spi.c and time.c for the dsPIC33E (built with XC16)
+ *   - hal_host.c for a Linux host (built with gcc or clang, see `make host')
+ *
+ * On the host there is no interrupt controller. The interrupt service
+ * routines are ordinary functions which can be called directly.
+ */
+
+#ifndef HAL_H
+#define	HAL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+#ifdef __XC16__
+#include "xc.h"
+/// Attributes for an interrupt service routine
+#define ISR __attribute__((__interrupt__, no_auto_psv))
+#else
+/// On the host an interrupt service routine is just a function
+#define ISR
+#endif
+
+/// Stop the compiler moving memory accesses across this point, so that
+/// data is written before the flag an interrupt checks (XC16 is based on
+/// gcc, and the dsPIC doesn't reorder memory accesses itself)
+#define hal_barrier() __asm__ __volatile__("" ::: "memory")
+
+    /// @brief The 32 bit timers used to generate interrupts
+    typedef enum {
+        HAL_TIMER_DISPLAY, ///< Timers 4 and 5 (LED brightness, _T5Interrupt)
+        HAL_TIMER_CYCLE,   ///< Timers 6 and 7 (state cycling, _T7Interrupt)
+        HAL_TIMER_TICK,    ///< Timers 8 and 9 (system tick, _T9Interrupt)
+    } HAL_TIMER;
+
+    /// @brief Set ports C and D to digital and set the line directions
+    void hal_setup_ports(void);
+
+    /// @brief Set a line on port D high
+    /// @param line The line number (0 - 15)
+    void hal_latd_set(int line);
+
+    /// @brief Set a line on port D low
+    /// @param line The line number (0 - 15)
+    void hal_latd_clear(int line);
+
+    /// @brief Read a line on port D
+    /// @param line The line number (0 - 15)
+    /// @return 1 if the line is high, 0 if it is low
+    int hal_portd_read(int line);
+
+    /// @brief Reset a timer pair in 32 bit mode and enable its interrupt
+    /// @param timer The timer to set up
+    void hal_timer_setup(HAL_TIMER timer);
+
+    /// @brief Set the period of a timer and reset its count
+    /// @param timer The timer to modify
+    /// @param period The period in instruction cycles
+    void hal_timer_period(HAL_TIMER timer, unsigned long period);
+
+    /// @brief Turn a timer on or off
+    /// @param timer The timer to modify
+    /// @param enable true to turn the timer on
+    void hal_timer_enable(HAL_TIMER timer, bool enable);
+
+    /**
+     * @brief Acknowledge a timer interrupt
+     * @param timer The timer which caused the interrupt
+     *
+     * Resets the timer count and clears the interrupt flag. Call this at
+     * the end of the interrupt service routine.
+     */
+    void hal_timer_ack(HAL_TIMER timer);
+
+    /// @brief Globally disable interrupts
+    void hal_interrupts_disable(void);
+
+    /// @brief Globally enable interrupts
+    void hal_interrupts_enable(void);
+
+    /// @brief Stop the CPU until the next interrupt (Idle mode)
+    void hal_idle(void);
+
+#ifndef __XC16__
+    /// @brief Host only: set the input lines of the emulated port D
+    /// @param value The 16 bit value read back from port D
+    void host_set_portd(unsigned int value);
+
+    /// @brief Host only: read the output latch of the emulated port D
+    unsigned int host_get_latd(void);
+
+    /// @brief Host only: set the bytes returned by the button shift registers
+    /// @param chip The shift register chip number
+    /// @param value The byte which will be read back over SPI 3
+    void host_set_buttons(int chip, int value);
+
+    /// @brief Host only: the last byte written to the display driver (SPI 1)
+    /// @param n Bytes ago (0 is the most recent byte)
+    int host_get_display_byte(int n);
+
+    /// @brief Host only: call the interrupt service routine of a timer
+    /// @return The timer period afterwards (the time until it fires again)
+    unsigned long host_fire_timer(HAL_TIMER timer);
+
+    /// @brief Host only: the number of bytes exchanged with the SRAM (SPI 2)
+    unsigned long host_get_sram_bytes(void);
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* HAL_H */
+
@@ -0,0 +1,172 @@
+/**
+ * @file hal_dspic.c
+ *
+ * @brief Description: dsPIC33E backend for the hardware abstraction layer
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Only built for the microcontroller. The host version is in hal_host.c
+ */
+
+#include "hal.h"
+
+/// @brief Set ports C and D to digital and set the line directions
+void hal_setup_ports(void) {
+    ANSELD = 0x0000; // Set port D to digital
+    TRISD = 0x20C0; // Set lines 0,1,2 as output; 6,7,13 as input
+    ///< Set port c digital for spi3
+    ANSELC = 0x0000; // Set port C to digital
+    TRISC = 0x0010; // Set line 4 as input
+}
+
+/// @brief Set a line on port D high
+void hal_latd_set(int line) {
+    LATD |= (1 << line);
+}
+
+/// @brief Set a line on port D low
+void hal_latd_clear(int line) {
+    LATD &= ~(1 << line);
+}
+
+/// @brief Read a line on port D
+int hal_portd_read(int line) {
+    return (PORTD & (1 << line)) >> line;
+}
+
+/**
+ * @brief Reset a timer pair in 32 bit mode and enable its interrupt
+ *
+ * The timers are set up using TxCON registers. In 32 bit mode the
+ * even timer is the low word and the odd timer is the high word, and
+ * the interrupt comes from the odd timer.
+ */
+void hal_timer_setup(HAL_TIMER timer) {
+    switch(timer) {
+        case HAL_TIMER_DISPLAY:
+            T4CON = 0x0000; // Reset the timer control registers
+            T5CON = 0x0000;
+            // Set up timer 4 in 32 bit mode with timer 5
+            // Clock prescaler 1:1, internal oscillator source.
+            T4CON = 0x0008;
+            // No need to change anything in T5CON
+            // Reset TMR4, TMR5, PR4 and PR5
+            TMR4 = 0x0000;
+            TMR5 = 0x0000;
+            PR4 = 0x0000; // Reset registers
+            PR5 = 0x0000;
+            // Setup interrupts for timer 5
+            IEC1bits.T5IE = 1; // Enable the interrupt
+            IFS1bits.T5IF = 0; // Clear the interrupt flag
+            break;
+        case HAL_TIMER_CYCLE:
+            T6CON = 0x0000; // Reset the timer control registers
+            T7CON = 0x0000;
+            // Set up timer 6 in 32 bit mode with timer 7
+            T6CON = 0x0008;
+            // Reset TMR6, TMR7, PR6 and PR7
+            TMR6 = 0x0000;
+            TMR7 = 0x0000;
+            PR6 = 0x0000; // Reset registers
+            PR7 = 0x0000;
+            // Setup interrupts for timer 7
+            IEC3bits.T7IE = 1; // Enable the interrupt
+            IFS3bits.T7IF = 0; // Clear the interrupt flag
+            break;
+        case HAL_TIMER_TICK:
+            T8CON = 0x0000; // Reset the timer control registers
+            T9CON = 0x0000;
+            // Set up timer 8 in 32 bit mode with timer 9
+            T8CON = 0x0008;
+            // Reset TMR8, TMR9, PR8 and PR9
+            TMR8 = 0x0000;
+            TMR9 = 0x0000;
+            PR8 = 0x0000; // Reset registers
+            PR9 = 0x0000;
+            // Setup interrupts for timer 9
+            IEC3bits.T9IE = 1; // Enable the interrupt
+            IFS3bits.T9IF = 0; // Clear the interrupt flag
+            break;
+    }
+}
+
+/// @brief Set the period of a timer and reset its count
+void hal_timer_period(HAL_TIMER timer, unsigned long period) {
+    switch(timer) {
+        case HAL_TIMER_DISPLAY:
+            TMR4 = 0x0000;
+            TMR5 = 0x0000;
+            PR4 = period & 0xFFFF;
+            PR5 = period >> 16;
+            break;
+        case HAL_TIMER_CYCLE:
+            TMR6 = 0x0000;
+            TMR7 = 0x0000;
+            PR6 = period & 0xFFFF;
+            PR7 = period >> 16;
+            break;
+        case HAL_TIMER_TICK:
+            TMR8 = 0x0000;
+            TMR9 = 0x0000;
+            PR8 = period & 0xFFFF;
+            PR9 = period >> 16;
+            break;
+    }
+}
+
+/// @brief Turn a timer on or off
+void hal_timer_enable(HAL_TIMER timer, bool enable) {
+    switch(timer) {
+        case HAL_TIMER_DISPLAY:
+            T4CONbits.TON = enable;
+            break;
+        case HAL_TIMER_CYCLE:
+            T6CONbits.TON = enable;
+            break;
+        case HAL_TIMER_TICK:
+            T8CONbits.TON = enable;
+            break;
+    }
+}
+
+/// @brief Acknowledge a timer interrupt
+void hal_timer_ack(HAL_TIMER timer) {
+    switch(timer) {
+        case HAL_TIMER_DISPLAY:
+            // Reset the timer
+            TMR4 = 0x0000;
+            TMR5 = 0x0000;
+            // Clear Timer5 interrupt flag
+            IFS1bits.T5IF = 0;
+            break;
+        case HAL_TIMER_CYCLE:
+            // Reset the timer
+            TMR6 = 0x0000;
+            TMR7 = 0x0000;
+            // Clear Timer7 interrupt flag
+            IFS3bits.T7IF = 0;
+            break;
+        case HAL_TIMER_TICK:
+            // Reset the timer
+            TMR8 = 0x0000;
+            TMR9 = 0x0000;
+            // Clear Timer9 interrupt flag
+            IFS3bits.T9IF = 0;
+            break;
+    }
+}
+
+/// @brief Globally disable interrupts
+void hal_interrupts_disable(void) {
+    __builtin_disable_interrupts();
+}
+
+/// @brief Globally enable interrupts
+void hal_interrupts_enable(void) {
+    __builtin_enable_interrupts();
+}
+
+/// @brief Stop the CPU until the next interrupt (the peripherals keep going)
+void hal_idle(void) {
+    Idle();
+}
@@ -0,0 +1,289 @@
+/**
+ * @file hal_host.c
+ *
+ * @brief Description: Linux host backend for the hardware abstraction layer
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * This file replaces hal_dspic.c, spi.c and time.c when the simulator is
+ * built on a host computer (`make host'). Port D, the SPI devices and the
+ * timers are emulated with plain variables so that the rest of the code
+ * runs unchanged. The timer functions in time.h read a monotonic clock and
+ * count nanoseconds instead of instruction cycles.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+
+#include "hal.h"
+#include "spi.h"
+#include "io.h"
+#include "sram.h"
+
+/// Emulated port D output latch
+static unsigned int latd = 0;
+
+/// Emulated port D input lines. The push buttons are active low.
+static unsigned int portd = 0xFFFF;
+
+/// Bytes returned by the button shift registers, one per chip
+static int button_bytes[BTN_CHIP_NUM] = {0};
+
+/// The next shift register chip to be read over SPI 3
+static int button_chip = 0;
+
+#define SPI1_LOG_LENGTH 8
+/// The last few bytes written to the display driver over SPI 1
+static int spi1_log[SPI1_LOG_LENGTH] = {0};
+static int spi1_head = 0;
+
+/// Emulated 23A1024 SRAM on SPI 2
+static unsigned char sram[SRAM_SIZE];
+static int sram_mode = SRAM_SEQUENTIAL;
+/// The instruction being carried out (-1 until the first byte arrives)
+static int sram_instruction = -1;
+/// The number of address bytes received so far
+static int sram_address_bytes = 0;
+static unsigned long sram_address = 0;
+/// True once the byte in byte mode has been transferred
+static bool sram_done = false;
+/// The number of bytes exchanged over SPI 2
+static unsigned long sram_bytes = 0;
+
+/// Emulated 32 bit timer (timers 2 and 3)
+static struct timespec timer_start;
+static unsigned long timer_count = 0;
+static bool timer_on = false;
+
+/// Emulated interrupt timers. They are not clocked on the host.
+static unsigned long timer_periods[3] = {0};
+static bool timers_enabled[3] = {false};
+
+void hal_setup_ports(void) {
+    latd = 0;
+    button_chip = 0;
+}
+
+void hal_latd_set(int line) {
+    latd |= (1 << line);
+    // Bringing SH low and high again latches the buttons
+    if(line == SH) button_chip = 0;
+    // Raising the SRAM chip select ends the command
+    if(line == SRAM_CS) sram_instruction = -1;
+}
+
+void hal_latd_clear(int line) {
+    latd &= ~(1 << line);
+    // Lowering the SRAM chip select starts a new command
+    if(line == SRAM_CS) sram_instruction = -1;
+}
+
+int hal_portd_read(int line) {
+    return (portd & (1 << line)) >> line;
+}
+
+void hal_timer_setup(HAL_TIMER timer) {
+    timer_periods[timer] = 0;
+    timers_enabled[timer] = false;
+}
+
+void hal_timer_period(HAL_TIMER timer, unsigned long period) {
+    timer_periods[timer] = period;
+}
+
+void hal_timer_enable(HAL_TIMER timer, bool enable) {
+    timers_enabled[timer] = enable;
+}
+
+void hal_timer_ack(HAL_TIMER timer) {
+    (void)timer; // Nothing to clear
+}
+
+void hal_interrupts_disable(void) {
+    // No interrupts on the host
+}
+
+void hal_interrupts_enable(void) {
+    // No interrupts on the host
+}
+
+void hal_idle(void) {
+    // Nothing else happens on the host while idle, so go straight to the
+    // next system tick (the only interrupt anything waits for)
+    if(timers_enabled[HAL_TIMER_TICK]) host_fire_timer(HAL_TIMER_TICK);
+}
+
+void host_set_portd(unsigned int value) {
+    portd = value;
+}
+
+unsigned int host_get_latd(void) {
+    return latd;
+}
+
+void host_set_buttons(int chip, int value) {
+    if(chip >= 0 && chip < BTN_CHIP_NUM) button_bytes[chip] = value;
+}
+
+unsigned long host_get_sram_bytes(void) {
+    return sram_bytes;
+}
+
+int host_get_display_byte(int n) {
+    int k = (spi1_head - 1 - n) % SPI1_LOG_LENGTH;
+    if(k < 0) k += SPI1_LOG_LENGTH;
+    return spi1_log[k];
+}
+
+/// The timer interrupt service routines (in io.c and sched.c)
+void _T5Interrupt(void);
+void _T7Interrupt(void);
+void _T9Interrupt(void);
+
+unsigned long host_fire_timer(HAL_TIMER timer) {
+    switch(timer) {
+        case HAL_TIMER_DISPLAY:
+            _T5Interrupt();
+            break;
+        case HAL_TIMER_CYCLE:
+            _T7Interrupt();
+            break;
+        case HAL_TIMER_TICK:
+            _T9Interrupt();
+            break;
+    }
+    return timer_periods[timer];
+}
+
+// ------------------------------------------------------------------ spi.h
+
+int setup_spi(void) {
+    spi1_head = 0;
+    button_chip = 0;
+    return 0;
+}
+
+int send_byte_spi_1(int data) {
+    spi1_log[spi1_head] = data & 0xFF;
+    spi1_head = (spi1_head + 1) % SPI1_LOG_LENGTH;
+    return 0;
+}
+
+int read_byte_spi_3() {
+    int data = button_bytes[button_chip];
+    button_chip = (button_chip + 1) % BTN_CHIP_NUM;
+    return data;
+}
+
+/// On the host a DMA transfer happens at once, and the done function is
+/// called before returning (as if the interrupt had fired straight away)
+int send_spi_1_dma(const unsigned char * data, int count, SpiDone done) {
+    for(int n = 0; n < count; n++) send_byte_spi_1(data[n]);
+    if(done != NULL) done();
+    return 0;
+}
+
+int read_spi_3_dma(unsigned char * buffer, int count, SpiDone done) {
+    for(int n = 0; n < count; n++) buffer[n] = read_byte_spi_3();
+    if(done != NULL) done();
+    return 0;
+}
+
+int spi_1_dma_busy(void) {
+    return 0;
+}
+
+int spi_3_dma_busy(void) {
+    return 0;
+}
+
+/**
+ * The SRAM follows the 23A1024 command sequence: an instruction byte, then
+ * (for READ and WRITE) three address bytes, then data until the chip select
+ * goes high. The address then moves on according to the mode.
+ */
+int exchange_byte_spi_2(int data) {
+    sram_bytes++;
+    // Nothing drives the data line unless the chip is selected
+    if(latd & (1 << SRAM_CS)) return 0;
+    data &= 0xFF;
+    if(sram_instruction < 0) {
+        sram_instruction = data;
+        sram_address_bytes = 0;
+        sram_address = 0;
+        sram_done = false;
+        return 0;
+    }
+    switch(sram_instruction) {
+        case SRAM_RDMR:
+            return sram_mode;
+        case SRAM_WRMR:
+            if(!sram_done) sram_mode = data;
+            sram_done = true;
+            return 0;
+        case SRAM_READ:
+        case SRAM_WRITE: {
+            if(sram_address_bytes < 3) {
+                sram_address = (sram_address << 8) | data;
+                sram_address_bytes++;
+                sram_address %= SRAM_SIZE;
+                return 0;
+            }
+            if(sram_done) return 0;
+            int out = 0;
+            if(sram_instruction == SRAM_READ) out = sram[sram_address];
+            else sram[sram_address] = data;
+            if(sram_mode == SRAM_BYTE_MODE) {
+                sram_done = true;
+            } else if(sram_mode == SRAM_PAGE_MODE) {
+                sram_address = (sram_address & ~31UL) | ((sram_address + 1) & 31);
+            } else {
+                sram_address = (sram_address + 1) % SRAM_SIZE;
+            }
+            return out;
+        }
+        default:
+            return 0;
+    }
+}
+
+// ----------------------------------------------------------------- time.h
+
+/// Nanoseconds elapsed since the timer was (re)started
+static unsigned long elapsed_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - timer_start.tv_sec) * 1000000000UL
+            + (now.tv_nsec - timer_start.tv_nsec);
+}
+
+void setup_clock() {
+    // The host clock is already running
+}
+
+void setup_timer() {
+    timer_count = 0;
+    timer_on = false;
+}
+
+void reset_timer() {
+    timer_count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &timer_start);
+}
+
+void start_timer() {
+    if(timer_on) return;
+    clock_gettime(CLOCK_MONOTONIC, &timer_start);
+    timer_on = true;
+}
+
+void stop_timer() {
+    if(!timer_on) return;
+    timer_count += elapsed_ns();
+    timer_on = false;
+}
+
+unsigned long int read_timer() {
+    if(timer_on) return timer_count + elapsed_ns();
+    return timer_count;
+}
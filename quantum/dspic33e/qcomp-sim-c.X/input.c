@@ -0,0 +1,105 @@
+/**
+ * @file input.c
+ *
+ * @brief Description: Button events from a timer driven scanner
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "input.h"
+#include "io.h"
+#include "hal.h"
+#include "sched.h"
+
+/// The debounced state of each button
+static bool input_state[INPUT_BUTTONS];
+
+/// The number of scans each button has been different from input_state
+static int input_count[INPUT_BUTTONS];
+
+/// The ring buffer. queue_head is only written by the interrupt and
+/// queue_tail only by input_get, and both only count up (the index is
+/// the count mod INPUT_QUEUE_LENGTH), so each side can read the other's 
+/// without a lock. Single word writes are atomic on the dsPIC.
+static InputEvent queue[INPUT_QUEUE_LENGTH];
+static volatile unsigned int queue_head = 0;
+static volatile unsigned int queue_tail = 0;
+static volatile unsigned long dropped = 0;
+
+/// Add an event to the ring buffer (called from the interrupt)
+static void input_push(int button, bool pressed) {
+    unsigned int head = queue_head;
+    if(head - queue_tail == INPUT_QUEUE_LENGTH) {
+        dropped++; // Full
+        return;
+    }
+    queue[head % INPUT_QUEUE_LENGTH].button = button;
+    queue[head % INPUT_QUEUE_LENGTH].pressed = pressed;
+    hal_barrier();
+    queue_head = head + 1; // Publish the event after it is written
+}
+
+/// The raw state of a button: 1 if pressed, 0 if not
+static int input_raw(int button) {
+    if(button < NUM_QUBITS) return read_qubit_btn(button);
+    if(button < NUM_BTNS) return read_func_btn(button - NUM_QUBITS);
+    return read_btn(sw3);
+}
+
+void input_setup(void) {
+    for(int b = 0; b < INPUT_BUTTONS; b++) {
+        input_state[b] = false;
+        input_count[b] = 0;
+    }
+    queue_head = 0;
+    queue_tail = 0;
+    dropped = 0;
+    read_external_buttons(); // Ready for the first scan
+}
+
+/// The buttons array holds the shift registers from the DMA read started
+/// by the last scan. Each button is debounced, then the next read is 
+/// started.
+void input_scan(void) {
+    for(int b = 0; b < INPUT_BUTTONS; b++) {
+        bool raw = (input_raw(b) == 1);
+        if(raw == input_state[b]) {
+            input_count[b] = 0; // Bounced back (or never changed)
+        } else if(++input_count[b] >= INPUT_DEBOUNCE) {
+            input_state[b] = raw;
+            input_count[b] = 0;
+            input_push(b, raw);
+        }
+    }
+    read_external_buttons();
+}
+
+int input_get(InputEvent * event) {
+    unsigned int tail = queue_tail;
+    if(tail == queue_head) return -1; // Empty
+    *event = queue[tail % INPUT_QUEUE_LENGTH];
+    hal_barrier();
+    queue_tail = tail + 1; // Free the slot after it is read
+    return 0;
+}
+
+bool input_pending(int button) {
+    /// Only the reader moves queue_tail, so the events between it and
+    /// queue_head stay put while they are looked at
+    for(unsigned int k = queue_tail; k != queue_head; k++) {
+        const InputEvent * event = &queue[k % INPUT_QUEUE_LENGTH];
+        if(event->button == button && event->pressed) return true;
+    }
+    return false;
+}
+
+void input_wait(InputEvent * event) {
+    while(input_get(event) != 0) {
+        /// Run the due tasks while there are no events
+        if(sched_run() != 0) hal_idle(); // Woken by the next tick
+    }
+}
+
+unsigned long input_dropped(void) {
+    return dropped;
+}
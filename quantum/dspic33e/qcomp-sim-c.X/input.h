@@ -0,0 +1,83 @@
+/**
+ * @file input.h
+ *
+ * @brief Description: Button events from a timer driven scanner
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * The buttons are scanned on every system tick (see sched.h) instead of
+ * being polled by the main loop. Each scan starts a DMA read of the shift
+ * registers (see read_external_buttons) and debounces the last one. A
+ * button which has changed for INPUT_DEBOUNCE scans in a row puts a press
+ * or release event in a ring buffer, which the main loop empties with
+ * input_get. The ring buffer has one writer (the interrupt) and one reader
+ * (the main loop), so it needs no locks.
+ */
+
+#ifndef INPUT_H
+#define	INPUT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "consts.h"
+
+    /// Button numbers: the qubit buttons are 0 to NUM_QUBITS - 1 and the
+    /// function buttons follow them (the logical numbers in io.c)
+#define INPUT_FUNC(n) (NUM_QUBITS + (n)) ///< The nth function button
+#define INPUT_RESET NUM_BTNS ///< The reset push button (sw3 on port D)
+#define INPUT_BUTTONS (NUM_BTNS + 1) ///< The number of buttons scanned
+
+    /// The number of scans a button must stay changed for an event
+#define INPUT_DEBOUNCE 3
+
+    /// The number of events the ring buffer holds (a power of 2)
+#define INPUT_QUEUE_LENGTH 16
+
+    /// @brief A button being pressed or released
+    typedef struct {
+        int button; ///< The button number (see above)
+        bool pressed; ///< true for a press, false for a release
+    } InputEvent;
+
+    /**
+     * @brief Reset the debouncing and the ring buffer (run after
+     * setup_external_buttons). The scanning starts with the system tick
+     */
+    void input_setup(void);
+
+    /// @brief Scan the buttons (called by the system tick interrupt)
+    void input_scan(void);
+
+    /**
+     * @brief Take the next event from the ring buffer, if there is one
+     * @param event The event
+     * @return 0 if there was an event, -1 if the buffer was empty
+     */
+    int input_get(InputEvent * event);
+
+    /**
+     * @brief Look for a press of a button in the ring buffer, without
+     * taking any events out
+     * @param button The button number
+     * @return true if there is a press of the button waiting
+     */
+    bool input_pending(int button);
+
+    /**
+     * @brief Wait for the next event, running the due tasks (see sched.h)
+     * and idling the CPU while there isn't one
+     * @param event The event
+     */
+    void input_wait(InputEvent * event);
+
+    /// @brief The number of events lost because the ring buffer was full
+    unsigned long input_dropped(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* INPUT_H */
@@ -14,7 +14,7 @@
  * Each entry in the array is either 1 if the button is 
  * pressed or 0 if not. The array is accessed globally using
  * `extern buttons;' in a *.c file. Read buttons array us updated
- * by calling read_external_buttons
+ * by calling read_external_buttons (when its DMA transfer finishes)
  */
 int buttons[BTN_CHIP_NUM];
 
@@ -42,44 +42,17 @@ int led_color_int(int device, int R, int G, int B) {
 /// @brief Set up LEDs and buttons on port D 
 int setup_io(void) {
     // Set up the input/output
-    ANSELD = 0x0000; // Set port D to digital
-    TRISD = 0x20C0; // Set lines 0,1,2 as output; 6,7,13 as input 
-    ///< Set port c digital for spi3
-    ANSELC = 0x0000; // Set port C to digital
-    TRISC = 0x0010; // Set line 4 as input 
+    hal_setup_ports();
     
-    // Setup timers for flashing LEDs
-    T4CON = 0x0000; // Reset the timer control registers
-    T5CON = 0x0000;
-    T6CON = 0x0000; // Reset the timer control registers
-    T7CON = 0x0000;
-    // Set up timer 4 in 32 bit mode with timer 5
-    // Clock prescaler 1:1, internal oscillator source.
-    T4CON = 0x0008;
-    T6CON = 0x0008;
-    // No need to change anything in T5CON
-    // Reset TMR4, TMR5, PR4 and PR5
-    TMR4 = 0x0000;
-    TMR5 = 0x0000;
-    PR4 = 0x0000; // Reset registers
-    PR5 = 0x0000;
-    // Reset TMR4, TMR5, PR4 and PR5
-    TMR6 = 0x0000;
-    TMR7 = 0x0000;
-    PR6 = 0x0000; // Reset registers
-    PR7 = 0x0000;
-    // Setup interrupts for timer 5
-    IEC1bits.T5IE = 1; // Enable the interrupt
-    IFS1bits.T5IF = 0; // Clear the interrupt flag
-    // Setup interrupts for timer 7
-    IEC3bits.T7IE = 1; // Enable the interrupt
-    IFS3bits.T7IF = 0; // Clear the interrupt flag
+    // Setup timers for flashing LEDs (4 and 5) and cycling (6 and 7)
+    hal_timer_setup(HAL_TIMER_DISPLAY);
+    hal_timer_setup(HAL_TIMER_CYCLE);
     /// Set the OE pin high
-    LATD |= (1 << OE); /// Set OE(ED2) pin
+    hal_latd_set(OE); /// Set OE(ED2) pin
     /// Set the SH pin high
-    LATD |= (1 << SH); /// Set SH pin
+    hal_latd_set(SH); /// Set SH pin
     /// set CLK_INH high while buttons are pressed
-    LATD |= (1 << CLK_INH);
+    hal_latd_set(CLK_INH);
     
     return 0;
 }
@@ -94,98 +67,198 @@ LED led[LED_NUM];
 /// Display buffer to be written to display driver
 int display_buf[DISPLAY_CHIP_NUM] = {0};
 
-/** @brief Counter for the interrupt service routine _T5Interrupt
+/** @brief Bit angle modulation (BAM) of the LED brightnesses
  * 
- * These variables are for keeping track of the interrupt based LED pulsing.
- * The type is _Fract because it is easier to directly compare two _Fracts
- * than attempt multiplication of integers and _Fracts (which isn't 
- * supported) The limit is not 1 because _Fract types do not go up to 1.
+ * Each brightness is turned into an 8 bit level, and bit p of every level
+ * goes in the display bytes for bit plane p. A frame is the display bytes
+ * for all the planes. _T5Interrupt shows one plane at a time, and the plane
+ * is held for BAM_TICK << p timer cycles. So an LED is on for level *
+ * BAM_TICK cycles out of 255 * BAM_TICK, and a frame takes 8 display writes
+ * instead of one every BAM_TICK.
  * 
- * It's probably a good idea to make sure the isr_res counter doesn't overflow
- * (by ensuring that isr_res + isr_limit does not exceed 0.999..., the max 
- * value of unsigned _Fract).
+ * BAM_TICK (the time for the lowest plane) must be long enough for the
+ * display bytes to be sent; if they aren't, that plane is skipped.
+ * 
+ * There are two frames. _T5Interrupt shows display_frames[frame_shown] and
+ * build_frame writes the other one and then sets frame_ready. The interrupt
+ * swaps them at the start of the next frame, so a frame is never shown 
+ * half written. build_frame clears frame_ready before it starts, so the 
+ * interrupt can't swap to the frame it is writing.
+ * 
+ * build_frame must only run in the main loop (never from an interrupt),
+ * so only one frame is ever being written. The cycling display keeps to
+ * this by leaving the LEDs to show_cycle.
+ */
+#define BAM_BITS 8
+#define BAM_TICK 0x00000300
+static unsigned char display_frames[2][BAM_BITS][DISPLAY_CHIP_NUM];
+static volatile int frame_shown = 0; /// The frame _T5Interrupt is showing
+static volatile bool frame_ready = false; /// The other frame is ready
+static int bam_plane = 0; /// The next plane to show
+
+/// Latch the display data (see below)
+static void latch_display(void);
+
+/**
+ * @brief Turn a brightness into a BAM level between 0 and 255
+ * 
+ * UQ16 is compared with the plane weights (1/2, 1/4, ...) rather than
+ * multiplied by 256, which would saturate as a _Fract.
  */
-unsigned _Fract isr_counter = 0; /// Counter value
-unsigned _Fract isr_res = 0.01; /// Counter resolution
-const unsigned _Fract isr_limit = 0.95; /// The max value for isr_counter
+static int bam_level(UQ16 x) {
+    int level = 0;
+    UQ16 weight = 0.5;
+    for(int p = BAM_BITS - 1; p >= 0; p--) {
+        if(x >= weight) {
+            level |= (1 << p);
+            x -= weight;
+        }
+        weight /= 2;
+    }
+    return level;
+}
+
+/// Set one LED line (chip number and line number) in every plane of a frame
+static void bam_set_line(unsigned char frame[BAM_BITS][DISPLAY_CHIP_NUM],
+        const int line[2], int level) {
+    for(int p = 0; p < BAM_BITS; p++) {
+        if(((level >> p) & 1) != 0) frame[p][line[0]] |= (1 << line[1]);
+    }
+}
+
+/**
+ * @brief Work out the frame for the brightnesses in the led array
+ * 
+ * This runs outside _T5Interrupt, which only has to send the bytes.
+ */
+static void build_frame(void) {
+    /// Stop the interrupt swapping to the back frame while it is written
+    frame_ready = false;
+    hal_barrier();
+    unsigned char (*frame)[DISPLAY_CHIP_NUM] = display_frames[1 - frame_shown];
+    for(int p = 0; p < BAM_BITS; p++) {
+        for(int n = 0; n < DISPLAY_CHIP_NUM; n++)
+            frame[p][n] = 0;
+    }
+    for(int i = 0; i < LED_NUM; i++) {
+        bam_set_line(frame, led[i].R, bam_level(led[i].N_R));
+        bam_set_line(frame, led[i].G, bam_level(led[i].N_G));
+        bam_set_line(frame, led[i].B, bam_level(led[i].N_B));
+    }
+    hal_barrier(); // The frame is written before it is marked ready
+    frame_ready = true;
+}
 
 /** @brief Interrupt service routine for timer 4
  * 
  * Interrupt service routines are automatically called by the microcontroller
  * when an event occurs. In this case, _T5Interrupt is called when the 32 bit
  * timer formed from T4 and T5 reaches its preset period. The silly name and
- * sill attributes are so that the compiler can correctly map the function in 
+ * sill attributes (the ISR macro in hal.h) are so that the compiler can correctly map the function in 
  * the microcontroller memory. More details of interrupts and interrupt vectors 
  * can be found in the compiler manual and the dsPIC33E datasheet.
  * 
  * The job of this routine is to control the modulated brightnesses of the 
- * RBG LEDs. This routine is set to be called periodically with a very long
- * period on the time scale of microcontroller operations, but very fast
- * in comparison to what the eye can see. For example, once every 100us.
+ * RBG LEDs. Each call sends the next BAM bit plane of the shown frame to
+ * the display drivers (see display_frames above) and sets the timer period 
+ * to how long that plane should be shown, from BAM_TICK up to 
+ * 128 * BAM_TICK.
  * 
  */
-void __attribute__((__interrupt__, no_auto_psv)) _T5Interrupt(void) {
+void ISR _T5Interrupt(void) {
 
-    /// Loop over all the LEDs (the index i). 
-    for(int i = 0; i < LED_NUM; i++) {
-        /// Decide whether R, G or B should be turned off
-        bool R = (isr_counter < led[i].N_R);
-        bool G = (isr_counter < led[i].N_G);
-        bool B = (isr_counter < led[i].N_B);
-        update_display_buffer(i, R, G, B); // Add changes to data buffer
+    /// Swap to the new frame if there is one (only between frames)
+    if(bam_plane == 0 && frame_ready) {
+        frame_shown = 1 - frame_shown;
+        frame_ready = false;
     }
     
-    /// Write the display buffer data to the display drivers
-    /// It's important this line goes here rather than after the the final 
-    /// update_display_buffer below. Otherwise you get a flicker due to the
-    /// LEDs all coming on at the start of this loop
-    write_display_driver();
+    /// Send the bit plane to the display drivers. It is latched when the
+    /// last byte has gone
+    if(!spi_1_dma_busy())
+        send_spi_1_dma(display_frames[frame_shown][bam_plane], 
+                DISPLAY_CHIP_NUM, latch_display);
     
-    // Add an increment to the ISR counter
-    isr_counter += isr_res; 
-    // Check if counter has reached the limit
-    if(isr_counter > isr_limit) {
-        /// Reset the counter
-        isr_counter = 0; 
-        /// Turn on all the LEDs back on
-        for (int i = 0; i < LED_NUM; i++) 
-            update_display_buffer(i, 1, 1, 1); // Add changes to data buffer
-    }
+    /// Show it for a time proportional to its weight (this also resets
+    /// TMR4 and TMR5)
+    hal_timer_period(HAL_TIMER_DISPLAY, (unsigned long)BAM_TICK << bam_plane);
+    bam_plane++;
+    if(bam_plane == BAM_BITS) bam_plane = 0;
     
-    // Reset the timer
-    TMR4 = 0x0000;
-    TMR5 = 0x0000;
-    // Clear Timer4 interrupt flag
-    IFS1bits.T5IF = 0;
+    // Reset the timer and clear the interrupt flag
+    hal_timer_ack(HAL_TIMER_DISPLAY);
 }
 
-#define MAX_CYCLE_LENGTH 16
-RGB cycle_colors[MAX_CYCLE_LENGTH][NUM_QUBITS];
-int last_row = 0;
-int cycle_counter = 0;
+/**
+ * @brief The frames waiting to be shown by the cycling display
+ * 
+ * A ring buffer written by add_to_cycle and read by show_cycle, both in
+ * the main loop. _T7Interrupt only keeps time: it moves cycle_next on to
+ * the next frame, sets cycle_due to one past it and sets the timer period
+ * to its dwell time (frames from before the last reset_cycle are skipped).
+ * show_cycle then writes that frame to the LEDs and frees the frames the
+ * interrupt has moved past, so the display frames (see build_frame) are
+ * only ever built by the main loop.
+ * 
+ * The counts only go up (the index is the count mod CYCLE_RING_LENGTH), 
+ * and each is written by one side: cycle_head by add_to_cycle, cycle_tail
+ * by show_cycle and cycle_next and cycle_due by the interrupt. The frames
+ * from cycle_tail to cycle_head are in use, so add_to_cycle never writes 
+ * over a frame the interrupt or show_cycle is looking at, and a frame is
+ * written before cycle_head moves past it. So nothing needs a lock.
+ * 
+ * reset_cycle can't empty the ring (the interrupt may be looking at any
+ * frame up to cycle_head), so it starts a new generation instead.
+ */
+static CycleFrame cycle_ring[CYCLE_RING_LENGTH];
+static volatile unsigned int cycle_head = 0;
+static volatile unsigned int cycle_tail = 0;
+static volatile unsigned int cycle_next = 0;
+static volatile unsigned int cycle_due = 0;
+static volatile unsigned int cycle_generation = 0;
+static unsigned int cycle_built = 0; /// cycle_due when show_cycle last ran
 
 /// Timer 6 and 7 for cycling superposition states
-void __attribute__((__interrupt__, no_auto_psv)) _T7Interrupt(void) {
-
-    /// Write a row to the leds
-    for(int k=0; k<NUM_QUBITS; k++) {
-        set_external_led(k, 
-                cycle_colors[cycle_counter][k].R,
-                cycle_colors[cycle_counter][k].G,
-                cycle_colors[cycle_counter][k].B);
-    }
+void ISR _T7Interrupt(void) {
+    unsigned int head = cycle_head;
+    unsigned int next = cycle_next;
     
-    cycle_counter++;
+    /// Skip the frames from before the last reset_cycle
+    while(next != head 
+            && cycle_ring[next % CYCLE_RING_LENGTH].generation != cycle_generation)
+        next++;
     
-    if(cycle_counter == last_row) {
-        cycle_counter = 0;
+    /// Move on to the next frame and wait for its dwell time, or keep the
+    /// last one and look again soon if there isn't one
+    unsigned long period = CYCLE_RETRY;
+    if(next != head) {
+        period = cycle_ring[next % CYCLE_RING_LENGTH].dwell;
+        next++;
+        cycle_due = next; // show_cycle writes it to the LEDs
     }
+    cycle_next = next;
+    hal_timer_period(HAL_TIMER_CYCLE, period);
            
-    // Reset the timer
-    TMR6 = 0x0000;
-    TMR7 = 0x0000;
-    // Clear Timer7 interrupt flag
-    IFS3bits.T7IF = 0;
+    // Reset the timer and clear the interrupt flag
+    hal_timer_ack(HAL_TIMER_CYCLE);
+}
+
+int show_cycle(void) {
+    /// cycle_next is read first, so the frame before cycle_due is never
+    /// freed before it is shown if the interrupt moves on in between
+    unsigned int next = cycle_next;
+    unsigned int due = cycle_due;
+    int shown = -1;
+    if(due != cycle_built) {
+        const CycleFrame * frame = &cycle_ring[(due - 1) % CYCLE_RING_LENGTH];
+        if(frame->generation == cycle_generation) {
+            set_external_leds(frame->colors, NUM_QUBITS);
+            shown = 0;
+        }
+        cycle_built = due;
+    }
+    cycle_tail = next; // Free the frames the interrupt has moved past
+    return shown;
 }
 
 //// button mapping
@@ -288,76 +361,77 @@ void setup_external_leds(void) {
     /// Initialise display buffer to zero
     for (int i = 0; i < DISPLAY_CHIP_NUM; i++)
         display_buf[i] = 0;
+    bam_plane = 0;
+    frame_shown = 0;
+    build_frame();
     
-    // Reset TMR4, TMR5
-    TMR4 = 0x0000;
-    TMR5 = 0x0000;
-    
-    // Set flashing period
-    PR4 = 0x0800;
-    PR5 = 0x0000;
+    // Set the period of the first bit plane (and reset TMR4, TMR5)
+    hal_timer_period(HAL_TIMER_DISPLAY, BAM_TICK);
     
-    /// Set flashing period
-    PR6 = 0x0000;
-    PR7 = 0x0080;
-
     // Turn timer 4 on
-    T4CONbits.TON = 1;
-    /// Turn timer 6 on
-
-    T6CONbits.TON = 0;/// @todo CURRENTLY CYCLING IS OFF
+    hal_timer_enable(HAL_TIMER_DISPLAY, true);
+    
+    /// Timer 6 is turned on by start_cycle
+    hal_timer_enable(HAL_TIMER_CYCLE, false);
 }
 
 
 /**
- * @brief Add an item to the list of states to cycle
- * 
- * @param leds An array of LED indices 
- * @param colors Corresponding RGB values for each LED
- * @param size The size of both the above arrays
- * 
- * This function is used to add a set of LED states (RGB values) into the
- * list of states being cycled. 
- * 
- * Repeatedly calling this function adds a new state to the end of the list
- * of displayed states. LED states are shown in the order this function is
- * called.
+ * @brief Add a frame to the states to cycle
  * 
- * The implementation uses the linked list type cycle_node. Each call of
- * this function adds a new element to the end of cycle node
+ * @param colors RGB values for LEDs 0 to size - 1
+ * @param size The number of colors (NUM_QUBITS)
+ * @param dwell The time to show the frame for, in timer cycles
  * 
+ * Repeatedly calling this function adds a new frame to the end of the ring
+ * of frames waiting to be shown. They are shown in the order this function
+ * is called, each one once.
  */
-int add_to_cycle(RGB colors[], int size) {
-    
-    /// Add the new colors to top of array
-    for(int k=0; k<NUM_QUBITS; k++) {
-        cycle_colors[last_row][k] = colors[k];
-    }
-    last_row ++;
-    
-    if(last_row == MAX_CYCLE_LENGTH) {
-        return -1; // This is bad
+int add_to_cycle(const RGB colors[], int size, unsigned long dwell) {
+    if(size != NUM_QUBITS || cycle_space() == 0) return -1;
+    unsigned int head = cycle_head;
+    CycleFrame * frame = &cycle_ring[head % CYCLE_RING_LENGTH];
+    for(int k = 0; k < NUM_QUBITS; k++) {
+        frame->colors[k] = colors[k];
     }
-    
+    frame->dwell = dwell;
+    frame->generation = cycle_generation;
+    hal_barrier();
+    cycle_head = head + 1; // Publish the frame after it is written
     return 0; // Success 
 }
 
+int cycle_space(void) {
+    return CYCLE_RING_LENGTH - (int)(cycle_head - cycle_tail);
+}
+
 /**
  * @brief Reset the LED display cycle
-_* @todo do it
  * 
+ * The frames already in the ring are dropped by the interrupt
  */
 int reset_cycle(void) {
-    last_row = 0;
+    cycle_generation++;
     return 0;
-    
+}
+
+void start_cycle(void) {
+    /// Free the frames the interrupt moved past before it was stopped
+    cycle_built = cycle_due = cycle_tail = cycle_next;
+    hal_timer_period(HAL_TIMER_CYCLE, CYCLE_RETRY);
+    hal_timer_enable(HAL_TIMER_CYCLE, true);
+}
+
+void stop_cycle(void) {
+    hal_timer_enable(HAL_TIMER_CYCLE, false);
+    reset_cycle();
 }
 
 
 
 /// @brief Stop LEDs flashing
 void stop_external_leds(void) {
-    T4CONbits.TON = 0; // Turn timer 4 off   
+    hal_timer_enable(HAL_TIMER_DISPLAY, false); // Turn timer 4 off   
 }
 
 /// @brief Set an LED strobing
@@ -365,11 +439,11 @@ void set_strobe(int color, int state) {
     extern LED_GLOBAL led_global;
     switch(state) {
         case on: // Start the strobing
-            LATD &= ~(1 << color);
+            hal_latd_clear(color);
             led_global.strobe_leds |= (1 << color);
             break;
         case off:
-            LATD &= ~(1 << color);
+            hal_latd_clear(color);
             led_global.strobe_leds &= ~(1 << color);
             break;
     }
@@ -378,16 +452,27 @@ void set_strobe(int color, int state) {
 /// @brief Toggle LED strobe
 void toggle_strobe(int color) {
     extern LED_GLOBAL led_global;
-    LATD &= ~(1 << color);
+    hal_latd_clear(color);
     led_global.strobe_leds ^= (1 << color);
 }
 
+/// @brief Flash the strobing LEDs (run by the scheduler, see sched.h)
+void strobe_task(void * arg) {
+    (void)arg;
+    extern LED_GLOBAL led_global;
+    led_global.strobe_state ^= 1;
+    for(int color = red; color <= green; color++) {
+        if(led_global.strobe_leds & (1 << color)) 
+            set_led(color, led_global.strobe_state & 1);
+    }
+}
+
 /// @brief Turn a particular LED on or off
   int set_led(int color, int state) {
   if (state == on)
-    LATD |= (1 << color);
+    hal_latd_set(color);
   else
-    LATD &= ~(1 << color);
+    hal_latd_clear(color);
   return 0;
 }
 
@@ -397,7 +482,7 @@ void toggle_strobe(int color) {
     return -1;
   } else {
     /// @note How well do you know C
-    return (((PORTD & (1 << btn)) >> btn) ^ 0x0001);
+    return (hal_portd_read(btn) ^ 0x0001);
   }
 }
 
@@ -412,7 +497,7 @@ void leds_off(void) {
 /// @brief Flash LED a number of times
   void flash_led(int color, int number) {
     unsigned long int m = 0, n = 0; // You need 32 bit types for this
-    while(n < number) {
+    while(n < (unsigned long)number) {
         set_led(color, on);
         m = 0;
         while(m < PERIOD) m++;
@@ -427,7 +512,7 @@ void leds_off(void) {
   void flash_all(int number) {
 
     unsigned long int m = 0, n = 0; // You need 32 bit types for this
-    while(n < number) {
+    while(n < (unsigned long)number) {
         set_led(red, on);
         set_led(amber, on);
         set_led(green, on);
@@ -477,6 +562,26 @@ int update_display_buffer(int n, bool R, bool G, bool B) {
     return 0;
 }
 
+/// The bytes being sent to the display driver by DMA
+static unsigned char display_dma[DISPLAY_CHIP_NUM];
+
+/**
+ * @brief Latch the display data (called from the SPI 1 DMA interrupt)
+ * 
+ * Runs once the last byte of display_dma has been clocked out
+ */
+static void latch_display(void) {
+    // Bring LE high momentarily
+    hal_latd_set(LE); /// Set LE(ED1) pin
+    unsigned long int n = 0;
+    while(n < 10) /// @todo How long should this be? 
+        n++;
+    hal_latd_clear(LE); // Clear LE(ED1) pin
+    
+    // Bring the output enable low
+    hal_latd_clear(OE); // Clear OE(ED2) pin
+}
+
 /** 
  * @brief Turn on an LED via the external display driver
  *
@@ -494,21 +599,14 @@ int update_display_buffer(int n, bool R, bool G, bool B) {
  */
 int write_display_driver(void) {
 
-    // Write the display buffer to the device using SPI
-    for (int n = 0; n < DISPLAY_CHIP_NUM; n++) 
-        send_byte_spi_1(display_buf[n]);
+    // Skip this refresh if the last one is still being sent
+    if(spi_1_dma_busy()) return -1;
     
-    // Bring LE high momentarily
-    LATD |= (1 << LE); /// Set LE(ED1) pin
-    unsigned long int n = 0;
-    while(n < 10) /// @todo How long should this be? 
-        n++;
-    LATD &= ~(1 << LE); // Clear LE(ED1) pin
-    
-    // Bring the output enable low
-    LATD &= ~(1 << OE); // Clear OE(ED2) pin
-    
-    return 0;
+    // Write the display buffer to the device using SPI (with DMA). The
+    // data is latched by latch_display when the last byte has gone out
+    for (int n = 0; n < DISPLAY_CHIP_NUM; n++) 
+        display_dma[n] = display_buf[n];
+    return send_spi_1_dma(display_dma, DISPLAY_CHIP_NUM, latch_display);
     
 }
 
@@ -551,12 +649,25 @@ int TLC591x_mode_switch(int mode) {
  * each color. The function returns 0 if successful and -1 otherwise.   
  */
 int set_external_led(int index, 
-        unsigned _Fract R, 
-        unsigned _Fract G,
-        unsigned _Fract B) {
+        UQ16 R, 
+        UQ16 G,
+        UQ16 B) {
     led[index].N_R = R;
     led[index].N_G = G;
     led[index].N_B = B;
+    /// Work out the frame shown by _T5Interrupt
+    build_frame();
+    return 0;
+}
+
+int set_external_leds(const RGB colors[], int count) {
+    if(count > LED_NUM) return -1;
+    for(int i = 0; i < count; i++) {
+        led[i].N_R = colors[i].R;
+        led[i].N_G = colors[i].G;
+        led[i].N_B = colors[i].B;
+    }
+    build_frame();
     return 0;
 }
 
@@ -572,30 +683,36 @@ int set_external_led(int index,
 //
 // The control lines SH and CLK_INH are on port D
 //
+// The bytes are read by DMA into button_dma, and copied to the buttons
+// array by store_buttons when the transfer has finished. So the buttons
+// array is updated in the background, not by the time this returns
+//
 * @todo read buttons
 */
 
+/// The bytes being read from the button shift registers by DMA
+static unsigned char button_dma[BTN_CHIP_NUM];
+
+/// Update the button array (called from the SPI 3 DMA interrupt)
+static void store_buttons(void) {
+    // Loop over the number of chips
+    for(int r = 0; r < BTN_CHIP_NUM; r++)
+        buttons[r] = button_dma[r]; // Update the button array
+}
+
 int read_external_buttons(void) {
+    // Leave the shift registers alone if the last read is still going
+    if(spi_3_dma_busy()) return -1;
+    
     // Bring SH low momentarily
-    LATD &= ~(1 << SH); /// SH pin
+    hal_latd_clear(SH); /// SH pin
     unsigned long int n = 0;
     while (n < 5) /// @todo How long should this be? 
         n++;
-    LATD |= (1 << SH); // Set SH pin again
+    hal_latd_set(SH); // Set SH pin again
 
     // Read the button states
-    int btn_byte = 0;
-    // Loop over the number of chips
-    for(int r = 0; r < BTN_CHIP_NUM; r++) {
-        btn_byte = read_byte_spi_3();
-        // loop over the bits in the byte
-        // for(int s = 0; s < 8; s++) {
-            buttons[r] = btn_byte ; // Update the button array
-        //}
-    }
-        int a=0;
-        a++;
-    return 0;
+    return read_spi_3_dma(button_dma, BTN_CHIP_NUM, store_buttons);
     /// @todo button remappings...
 }
 
@@ -645,7 +762,7 @@ int led_cycle_test(void) {
  */
 void varying_leds(void) {
     while (1 == 1) {
-        for (_Fract i = 0; i < 0.99; i += 0.001) {
+        for (Q15 i = 0; i < 0.99; i += 0.001) {
             long int counter = 0;
             while (counter < 1000) counter++;
             set_external_led(0, i, 0, 1.0 - i);
@@ -653,7 +770,7 @@ void varying_leds(void) {
             set_external_led(2, i, 0, 1.0 - i);
             set_external_led(3, 1.0 - i, 0, i);
         }
-        for (_Fract i = 0; i < 0.99; i += 0.001) {
+        for (Q15 i = 0; i < 0.99; i += 0.001) {
             long int counter = 0;
             while (counter < 1000) counter++;
             set_external_led(0, 1.0 - i, 0, i);
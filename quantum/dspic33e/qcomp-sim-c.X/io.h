@@ -17,6 +17,7 @@
 extern "C" {
 #endif
 
+#include "hal.h"
 #include "time.h"
 //#include "spi.h"
 #include "consts.h"
@@ -40,6 +41,9 @@ extern "C" {
 /// COntrol lines for SNx4HC165 chip
 #define SH 5
 #define CLK_INH 8
+
+/// Chip select (active low) for the 23A1024 SRAM on SPI 2 (see sram.h)
+#define SRAM_CS 9
     
 
    
@@ -52,6 +56,9 @@ extern "C" {
     // Pins for SH and CLK_INH on port D
     // SH = RD5 = uC:82 = J1:25 = J10:13
     // CLK_INH = RD8 = uC:68 = J1:58 = J11:25
+    //
+    // Pin for the SRAM chip select on port D
+    // SRAM_CS = RD9 = uC:69
     // \endverbatim
     */
     
@@ -77,18 +84,26 @@ extern "C" {
      * 
      * The position of the LED lines are contained in an array
      * 
-     * The type of the counter is _Fract to facilitate easy comparison with
+     * The type of the counter is UQ16 to facilitate easy comparison with
      * the N_* variables which used the fractional type.
      */
     typedef struct {
         int R[2]; /// Red mapping array: [chip number, line number]
         int G[2]; /// Green mapping array
         int B[2]; /// Blue mapping array
-        unsigned _Fract N_R; /// The R brightness
-        unsigned _Fract N_G; /// The G brightness
-        unsigned _Fract N_B; /// The B brightness
+        UQ16 N_R; /// The R brightness
+        UQ16 N_G; /// The G brightness
+        UQ16 N_B; /// The B brightness
     } LED;
     
+    /// @brief A type for holding red, green, blue values 
+
+    typedef struct {
+        UQ16 R;
+        UQ16 G;
+        UQ16 B;
+    } RGB;
+    
     /// Set up LEDs and buttons on port D 
     int setup_io(void);
 
@@ -146,6 +161,14 @@ extern "C" {
     /// @param color
     void toggle_strobe(int color);
 
+    /// The ticks between strobe_task runs (a quarter of a second)
+#define STROBE_PERIOD 48
+
+    /// @brief Flash the strobing LEDs. Add it to the scheduler (see sched.h)
+    /// with period STROBE_PERIOD
+    /// @param arg Not used
+    void strobe_task(void * arg);
+
     /**
      * 
      * @param led_index LED number to modify
@@ -156,10 +179,11 @@ extern "C" {
      */
     int update_display_buffer(int led_index, bool R, bool G, bool B);
     
-    /** @brief Send a byte to the display driver
+    /** @brief Send the display buffer to the display driver
      * 
      * Don't use this function to write to LEDs -- use the set_external_led
-     * function
+     * function. The bytes are sent by DMA and latched from the DMA interrupt
+     * @return 0 if the transfer was started, -1 if the last one is still going
      */
     int write_display_driver(void);
     
@@ -176,9 +200,19 @@ extern "C" {
      * each color. The function returns 0 if successful and -1 otherwise.   
      */
     int set_external_led(int led_index,
-            unsigned _Fract R,
-            unsigned _Fract G,
-            unsigned _Fract B);
+            UQ16 R,
+            UQ16 G,
+            UQ16 B);
+
+    /**
+     * @param colors The RGB values for LEDs 0 to count - 1
+     * @param count The number of LEDs to set
+     * @return 0 if successful, -1 otherwise
+     * 
+     * Like set_external_led, but for several LEDs at once. The display frame
+     * is only worked out once, and the new colors appear together.
+     */
+    int set_external_leds(const RGB colors[], int count);
 
     /// @brief Takes led number & RGB -> returns integer for sending via SPI to set the LED
     /// @param device input LED number to change
@@ -197,31 +231,51 @@ extern "C" {
     /**
      * @brief Update the buttons array (see declaration above) 
      * 
+     * The buttons are read by DMA, so the array changes when the transfer
+     * finishes (after this returns on the dsPIC)
+     * @return 0 if the read was started, -1 if the last one is still going
      */
     int read_external_buttons(void);
 
-    /// @brief A type for holding red, green, blue values 
+    /// The number of frames waiting to be cycled (a power of 2)
+#define CYCLE_RING_LENGTH 8
 
+    /// The time before _T7Interrupt looks again when there are no frames
+    /// waiting, in timer cycles (about 5 ms)
+#define CYCLE_RETRY 0x00040000
+
+    /// @brief A set of LED states shown by the cycling interrupt
     typedef struct {
-        unsigned _Fract R;
-        unsigned _Fract G;
-        unsigned _Fract B;
-    } RGB;
+        RGB colors[NUM_QUBITS]; ///< The RGB values of the qubit LEDs
+        unsigned long dwell; ///< The time to show them for, in timer cycles
+        unsigned int generation; ///< The reset_cycle count when it was added
+    } CycleFrame;
+    
+    /// Add a frame to the states to be cycled
+    /// @return 0 if successful, -1 if the ring is full or size is wrong
+    int add_to_cycle(const RGB colors[], int size, unsigned long dwell);
 
-    /// @brief The basis for a linked list of states to cycle
+    /// The number of frames which can be added before the ring is full
+    int cycle_space(void);
 
-    typedef struct cycle_node {
-        RGB * rgb; ///< Array of corresponding RGB values
-        int size; ///< The size of the above arrays
-        struct cycle_node * next; ///< Pointer to the next item
-        struct cycle_node * previous; ///< Pointer to the previous item
-    } cycle_node_t;
-    
-    /// Add an element to the states to be cycled
-    int add_to_cycle(RGB colors[], int size);
+    /**
+     * @brief Write the frame _T7Interrupt has moved on to to the LEDs
+     * 
+     * The interrupt only keeps time, so run this often from the main loop
+     * (display_cycle does it from a scheduler task). The frame is freed
+     * once it is shown.
+     * @return 0 if a new frame was shown, -1 otherwise
+     */
+    int show_cycle(void);
     
     /// Reset the display cycle. Called before adding anything
     int reset_cycle(void);
+
+    /// @brief Start showing the frames (timers 6 and 7)
+    void start_cycle(void);
+
+    /// @brief Stop showing the frames and drop the ones waiting
+    void stop_cycle(void);
     
 #ifdef	__cplusplus
 }
@@ -20,11 +20,23 @@
  * @note You also need the microchip xc16 compilers which
  * are available from https://www.microchip.com/mplab/compilers 
  *
+ * The simulator core can also be built on a linux host with gcc or clang
+ * using `make host', which doesn't need the microchip tools. See hal.h.
+ *
  */
 #include "config.h"
 #include "time.h"
 #include "algo.h"
 #include "display.h"
+#include "benchmark.h"
+#include "sram.h"
+#include "sched.h"
+
+#ifdef BENCHMARK
+/// Results of the kernel benchmarks (read them with the debugger)
+static BenchResult bench_results[NUM_BENCHMARKS * NUM_QUBITS];
+static volatile int bench_count = 0;
+#endif
 
 int main(void) {
 
@@ -40,22 +52,47 @@ int main(void) {
     // Setup SPI interface
     setup_spi();
     
+#ifdef SRAM_FITTED
+    // Setup the external SRAM (for paged states, see paged.h). The red LED
+    // stays on if it doesn't answer
+    if (sram_setup() != 0) set_led(red, on);
+#endif
+    
+    Complex amplitudes[STATE_LENGTH]; // Storage for the state vector
+    StateVector state; // Make a NUM_QUBITS qubit state vector
+    state_init(&state, NUM_QUBITS, amplitudes);
+
+#ifdef BENCHMARK
+    /// Time the gate kernels in cycles, then stop. This is done before the
+    /// display and system tick timers are started, so that their
+    /// interrupts are not counted in the times
+    bench_count = benchmark_suite(&state, 10, bench_results,
+            NUM_BENCHMARKS * NUM_QUBITS);
+    while (1);
+#endif
+    
     // Setup the external LEDs
     setup_external_leds();
     
     // Setup the external buttons
     setup_external_buttons();
 
-    Complex state[STATE_LENGTH]; // Make a 3 qubit state vector of length
+    // Reset the button events (see input.h)
+    input_setup();
     
+    // Start the system tick, which scans the buttons, and the tasks which
+    // run while the main loop waits (see sched.h)
+    sched_setup();
+    static Task strobe;
+    sched_add(&strobe, strobe_task, NULL, 0, STROBE_PERIOD);
     
     // set to vacuum
-VACUUM:zero_state(state);
-    display_average(state);
+VACUUM:zero_state(&state);
+    display_cycle_stop();
+    display_average(&state);
     
     /// Test single qubit gates
     /// @todo fix this menu system
-    /// @todo add a button for switching between display average and cycle modes
     /** In this test the qubit buttons (0 - 3) will be used to select a qubit 
      * and the function buttons (4 - 6) will be used to perform an operation
      * on the selected qubit (X, Z or H).
@@ -73,7 +110,7 @@ VACUUM:zero_state(state);
         if (select_op == -2) goto VACUUM;
 
         /// Perform operation
-        int op_result = op_routine(select_op, state);
+        int op_result = op_routine(select_op, &state);
         if (op_result == -2) goto VACUUM;
 
     }
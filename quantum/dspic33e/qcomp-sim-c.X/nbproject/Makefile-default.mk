@@ -57,17 +57,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=main.c io.c quantum.c time.c spi.c algo.c consts.c display.c trap.c
+SOURCEFILES_QUOTED_IF_SPACED=main.c io.c quantum.c time.c spi.c algo.c consts.c display.c trap.c hal_dspic.c queue.c benchmark.c sram.c paged.c input.c sched.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/main.o ${OBJECTDIR}/io.o ${OBJECTDIR}/quantum.o ${OBJECTDIR}/time.o ${OBJECTDIR}/spi.o ${OBJECTDIR}/algo.o ${OBJECTDIR}/consts.o ${OBJECTDIR}/display.o ${OBJECTDIR}/trap.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/main.o.d ${OBJECTDIR}/io.o.d ${OBJECTDIR}/quantum.o.d ${OBJECTDIR}/time.o.d ${OBJECTDIR}/spi.o.d ${OBJECTDIR}/algo.o.d ${OBJECTDIR}/consts.o.d ${OBJECTDIR}/display.o.d ${OBJECTDIR}/trap.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/main.o ${OBJECTDIR}/io.o ${OBJECTDIR}/quantum.o ${OBJECTDIR}/time.o ${OBJECTDIR}/spi.o ${OBJECTDIR}/algo.o ${OBJECTDIR}/consts.o ${OBJECTDIR}/display.o ${OBJECTDIR}/trap.o ${OBJECTDIR}/hal_dspic.o ${OBJECTDIR}/queue.o ${OBJECTDIR}/benchmark.o ${OBJECTDIR}/sram.o ${OBJECTDIR}/paged.o ${OBJECTDIR}/input.o ${OBJECTDIR}/sched.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/main.o.d ${OBJECTDIR}/io.o.d ${OBJECTDIR}/quantum.o.d ${OBJECTDIR}/time.o.d ${OBJECTDIR}/spi.o.d ${OBJECTDIR}/algo.o.d ${OBJECTDIR}/consts.o.d ${OBJECTDIR}/display.o.d ${OBJECTDIR}/trap.o.d ${OBJECTDIR}/hal_dspic.o.d ${OBJECTDIR}/queue.o.d ${OBJECTDIR}/benchmark.o.d ${OBJECTDIR}/sram.o.d ${OBJECTDIR}/paged.o.d ${OBJECTDIR}/input.o.d ${OBJECTDIR}/sched.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/main.o ${OBJECTDIR}/io.o ${OBJECTDIR}/quantum.o ${OBJECTDIR}/time.o ${OBJECTDIR}/spi.o ${OBJECTDIR}/algo.o ${OBJECTDIR}/consts.o ${OBJECTDIR}/display.o ${OBJECTDIR}/trap.o
+OBJECTFILES=${OBJECTDIR}/main.o ${OBJECTDIR}/io.o ${OBJECTDIR}/quantum.o ${OBJECTDIR}/time.o ${OBJECTDIR}/spi.o ${OBJECTDIR}/algo.o ${OBJECTDIR}/consts.o ${OBJECTDIR}/display.o ${OBJECTDIR}/trap.o ${OBJECTDIR}/hal_dspic.o ${OBJECTDIR}/queue.o ${OBJECTDIR}/benchmark.o ${OBJECTDIR}/sram.o ${OBJECTDIR}/paged.o ${OBJECTDIR}/input.o ${OBJECTDIR}/sched.o
 
 # Source Files
-SOURCEFILES=main.c io.c quantum.c time.c spi.c algo.c consts.c display.c trap.c
+SOURCEFILES=main.c io.c quantum.c time.c spi.c algo.c consts.c display.c trap.c hal_dspic.c queue.c benchmark.c sram.c paged.c input.c sched.c
 
 
 CFLAGS=
@@ -157,6 +157,55 @@ ${OBJECTDIR}/trap.o: trap.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  trap.c  -o ${OBJECTDIR}/trap.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/trap.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
 	@${FIXDEPS} "${OBJECTDIR}/trap.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/hal_dspic.o: hal_dspic.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/hal_dspic.o.d 
+	@${RM} ${OBJECTDIR}/hal_dspic.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  hal_dspic.c  -o ${OBJECTDIR}/hal_dspic.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/hal_dspic.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/hal_dspic.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/queue.o: queue.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/queue.o.d 
+	@${RM} ${OBJECTDIR}/queue.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  queue.c  -o ${OBJECTDIR}/queue.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/queue.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/queue.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/benchmark.o: benchmark.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/benchmark.o.d 
+	@${RM} ${OBJECTDIR}/benchmark.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  benchmark.c  -o ${OBJECTDIR}/benchmark.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/benchmark.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/benchmark.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/sram.o: sram.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/sram.o.d 
+	@${RM} ${OBJECTDIR}/sram.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  sram.c  -o ${OBJECTDIR}/sram.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/sram.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/sram.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/paged.o: paged.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/paged.o.d 
+	@${RM} ${OBJECTDIR}/paged.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  paged.c  -o ${OBJECTDIR}/paged.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/paged.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/paged.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/input.o: input.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/input.o.d 
+	@${RM} ${OBJECTDIR}/input.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  input.c  -o ${OBJECTDIR}/input.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/input.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/input.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/sched.o: sched.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/sched.o.d 
+	@${RM} ${OBJECTDIR}/sched.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  sched.c  -o ${OBJECTDIR}/sched.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/sched.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1  -mno-eds-warn  -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/sched.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 else
 ${OBJECTDIR}/main.o: main.c  nbproject/Makefile-${CND_CONF}.mk
 	@${MKDIR} "${OBJECTDIR}" 
@@ -221,6 +270,55 @@ ${OBJECTDIR}/trap.o: trap.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  trap.c  -o ${OBJECTDIR}/trap.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/trap.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
 	@${FIXDEPS} "${OBJECTDIR}/trap.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/hal_dspic.o: hal_dspic.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/hal_dspic.o.d 
+	@${RM} ${OBJECTDIR}/hal_dspic.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  hal_dspic.c  -o ${OBJECTDIR}/hal_dspic.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/hal_dspic.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/hal_dspic.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/queue.o: queue.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/queue.o.d 
+	@${RM} ${OBJECTDIR}/queue.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  queue.c  -o ${OBJECTDIR}/queue.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/queue.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/queue.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/benchmark.o: benchmark.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/benchmark.o.d 
+	@${RM} ${OBJECTDIR}/benchmark.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  benchmark.c  -o ${OBJECTDIR}/benchmark.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/benchmark.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/benchmark.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/sram.o: sram.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/sram.o.d 
+	@${RM} ${OBJECTDIR}/sram.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  sram.c  -o ${OBJECTDIR}/sram.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/sram.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/sram.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/paged.o: paged.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/paged.o.d 
+	@${RM} ${OBJECTDIR}/paged.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  paged.c  -o ${OBJECTDIR}/paged.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/paged.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/paged.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/input.o: input.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/input.o.d 
+	@${RM} ${OBJECTDIR}/input.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  input.c  -o ${OBJECTDIR}/input.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/input.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/input.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/sched.o: sched.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/sched.o.d 
+	@${RM} ${OBJECTDIR}/sched.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  sched.c  -o ${OBJECTDIR}/sched.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/sched.o.d"      -mno-eds-warn  -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -std=gnu99 -O2 -O0 -msmart-io=1 -Wall -msfr-warn=off   -menable-fixed
+	@${FIXDEPS} "${OBJECTDIR}/sched.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 endif
 
 # ------------------------------------------------------------------------------------
@@ -0,0 +1,168 @@
+/**
+ * @file paged.c
+ *
+ * @brief Description: State vectors kept in the external SRAM
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "paged.h"
+#include "sram.h"
+
+/// The on-chip buffer: two pages, side by side
+static Complex page_buffer[2 * PAGE_LENGTH];
+
+/**
+ * With STATE_SOA the SRAM holds all the real parts and then all the
+ * imaginary parts, and the buffer is split the same way, so that a page
+ * lands in the same place whether the buffer is viewed as one page or two.
+ */
+#ifdef STATE_SOA
+#define BUFFER_RE ((Q15 *)page_buffer)
+#define BUFFER_IM (BUFFER_RE + 2 * PAGE_LENGTH)
+#endif
+
+/// The number of amplitudes in a page of this state (less than PAGE_LENGTH
+/// for small states)
+static size_t page_length(const PagedState * state) {
+    return (state->length < PAGE_LENGTH) ? state->length : PAGE_LENGTH;
+}
+
+/// Copy amplitudes [first, first + count) between the SRAM and the buffer,
+/// starting at amplitude offset of the buffer
+static void transfer(const PagedState * state, size_t first, size_t count,
+        size_t offset, bool write) {
+#ifdef STATE_SOA
+    unsigned long re = state->base + (unsigned long)first * sizeof(Q15);
+    unsigned long im = re + (unsigned long)state->length * sizeof(Q15);
+    if (write) {
+        sram_write(re, BUFFER_RE + offset, count * sizeof(Q15));
+        sram_write(im, BUFFER_IM + offset, count * sizeof(Q15));
+    } else {
+        sram_read(re, BUFFER_RE + offset, count * sizeof(Q15));
+        sram_read(im, BUFFER_IM + offset, count * sizeof(Q15));
+    }
+#else
+    unsigned long address = state->base + (unsigned long)first * sizeof(Complex);
+    if (write) sram_write(address, page_buffer[offset], count * sizeof(Complex));
+    else sram_read(address, page_buffer[offset], count * sizeof(Complex));
+#endif
+}
+
+/// A state vector which uses the buffer as its storage
+static void buffer_view(StateVector * view, int num_qubits) {
+    view->num_qubits = num_qubits;
+    view->length = (size_t)1 << num_qubits;
+#ifdef STATE_SOA
+    view->re = BUFFER_RE;
+    view->im = BUFFER_IM;
+#else
+    view->amp = page_buffer;
+#endif
+    view->norm = NORM_TARGET;
+    view->renormalise = false;
+    view->changes = 0;
+}
+
+int paged_init(PagedState * state, int num_qubits, unsigned long base) {
+    if (num_qubits < 1 || num_qubits > PAGED_MAX_QUBITS) return -1;
+    size_t length = (size_t)1 << num_qubits;
+    if (base + (unsigned long)length * sizeof(Complex) > SRAM_SIZE) return -1;
+    state->num_qubits = num_qubits;
+    state->length = length;
+    state->base = base;
+    return 0;
+}
+
+void paged_zero_state(PagedState * state) {
+    size_t n = page_length(state);
+    StateVector view;
+    buffer_view(&view, 0);
+    view.length = n;
+    for (size_t first = 0; first < state->length; first += n) {
+        for (size_t i = 0; i < n; i++) {
+            AMP_RE(&view, i) = 0.0;
+            AMP_IM(&view, i) = 0.0;
+        }
+        if (first == 0) AMP_RE(&view, 0) = ONE_Q15;
+        transfer(state, first, n, 0, true);
+    }
+}
+
+int paged_multi_controlled_qubit_op(const Complex op[2][2], size_t ctrl_mask,
+        int targ, PagedState * state) {
+    if (targ < 0 || targ >= state->num_qubits) return -1;
+    if ((ctrl_mask >> targ) & 1 || (ctrl_mask >> state->num_qubits)) return -1;
+    size_t n = page_length(state);
+    int page_qubits = (state->num_qubits < PAGE_QUBITS) 
+            ? state->num_qubits : PAGE_QUBITS;
+    size_t pages = state->length / n;
+    /// The ctrl bits inside a page, and the ones which pick the page
+    size_t low_ctrl = ctrl_mask & (n - 1);
+    size_t high_ctrl = ctrl_mask >> page_qubits;
+    StateVector view;
+    if (targ < page_qubits) {
+        /// One page at a time
+        buffer_view(&view, page_qubits);
+        for (size_t p = 0; p < pages; p++) {
+            if ((p & high_ctrl) != high_ctrl) continue;
+            transfer(state, p * n, n, 0, false);
+            multi_controlled_qubit_op(op, low_ctrl, targ, &view);
+            transfer(state, p * n, n, 0, true);
+        }
+    } else {
+        /// Page p (ZERO) with page p + page_bit (ONE)
+        size_t page_bit = (size_t)1 << (targ - page_qubits);
+        buffer_view(&view, page_qubits + 1);
+        for (size_t p = 0; p < pages; p++) {
+            if ((p & page_bit) || (p & high_ctrl) != high_ctrl) continue;
+            transfer(state, p * n, n, 0, false);
+            transfer(state, (p + page_bit) * n, n, n, false);
+            multi_controlled_qubit_op(op, low_ctrl, page_qubits, &view);
+            transfer(state, p * n, n, 0, true);
+            transfer(state, (p + page_bit) * n, n, n, true);
+        }
+    }
+    return 0;
+}
+
+int paged_single_qubit_op(const Complex op[2][2], int k, PagedState * state) {
+    return paged_multi_controlled_qubit_op(op, 0, k, state);
+}
+
+int paged_controlled_qubit_op(const Complex op[2][2], int ctrl, int targ,
+        PagedState * state) {
+    if (ctrl < 0 || ctrl >= state->num_qubits) return -1;
+    return paged_multi_controlled_qubit_op(op, (size_t)1 << ctrl, targ, state);
+}
+
+/// Copy between the SRAM and a local state, a page at a time
+static int copy(PagedState * state, StateVector * local, bool write) {
+    if (local->num_qubits != state->num_qubits) return -1;
+    size_t n = page_length(state);
+    StateVector view;
+    buffer_view(&view, 0);
+    for (size_t first = 0; first < state->length; first += n) {
+        if (!write) transfer(state, first, n, 0, false);
+        for (size_t i = 0; i < n; i++) {
+            if (write) {
+                AMP_RE(&view, i) = AMP_RE(local, first + i);
+                AMP_IM(&view, i) = AMP_IM(local, first + i);
+            } else {
+                AMP_RE(local, first + i) = AMP_RE(&view, i);
+                AMP_IM(local, first + i) = AMP_IM(&view, i);
+            }
+        }
+        if (write) transfer(state, first, n, 0, true);
+    }
+    if (!write) local->changes++;
+    return 0;
+}
+
+int paged_load(const PagedState * state, StateVector * local) {
+    return copy((PagedState *)state, local, false);
+}
+
+int paged_store(PagedState * state, const StateVector * local) {
+    return copy(state, (StateVector *)local, true);
+}
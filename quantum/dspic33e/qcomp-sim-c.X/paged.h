@@ -0,0 +1,95 @@
+/**
+ * @file paged.h
+ *
+ * @brief Description: State vectors kept in the external SRAM
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * The on-chip RAM only holds a few qubits, but the 23A1024 (see sram.h)
+ * holds 128 KiB: 15 qubits of Q15 complex amplitudes (4 bytes each), or 14
+ * on the host where they are floats. A PagedState keeps its amplitudes in
+ * the SRAM and the gates stream them through an on-chip buffer of two
+ * pages, PAGE_LENGTH amplitudes each:
+ *
+ *   - If the targ qubit is inside a page (targ < PAGE_QUBITS), each page
+ *     is read, the gate is applied to it, and it is written back.
+ *   - Otherwise the pairs are in two different pages, p and p + 2^(targ -
+ *     PAGE_QUBITS), which are read together and written back together.
+ *
+ * Either way every page is read and written once per gate. Pages where a
+ * ctrl qubit above the page is ZERO are not touched at all. The gate itself
+ * is the usual kernel (multi_controlled_qubit_op) applied to the buffer.
+ */
+
+#ifndef PAGED_H
+#define	PAGED_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "quantum.h"
+
+    /// The number of qubits in one page
+#define PAGE_QUBITS 8
+    /// The number of amplitudes in one page
+#define PAGE_LENGTH (1 << PAGE_QUBITS)
+
+    /// The largest paged state. This is more than MAX_QUBITS on the dsPIC,
+    /// but the SRAM size is the real limit (see paged_init)
+#define PAGED_MAX_QUBITS 15
+
+    /// @brief A state vector in the external SRAM
+    typedef struct {
+        int num_qubits; ///< The number of qubits
+        size_t length; ///< The number of amplitudes, 2^num_qubits
+        unsigned long base; ///< The SRAM address of the amplitudes
+    } PagedState;
+
+    /**
+     * @brief Make a state vector in the SRAM
+     * @param state The state vector to set up
+     * @param num_qubits The number of qubits
+     * @param base The first SRAM address to use
+     * @return 0 if successful, -1 if it does not fit in the SRAM
+     *
+     * The amplitudes are not initialised -- call paged_zero_state.
+     */
+    int paged_init(PagedState * state, int num_qubits, unsigned long base);
+
+    /// @brief Set the state to the vacuum
+    void paged_zero_state(PagedState * state);
+
+    /**
+     * @brief Apply a 2x2 op to the targ qubit if all the ctrl qubits are ONE
+     * @param op single qubit unitary 2x2
+     * @param ctrl_mask the control qubits, with bit n set for qubit n
+     * @param targ target qubit number
+     * @param state the state in the SRAM
+     * @return 0 if successful, -1 if the qubits are not valid
+     */
+    int paged_multi_controlled_qubit_op(const Complex op[2][2], size_t ctrl_mask,
+            int targ, PagedState * state);
+
+    /// @brief Apply a single qubit gate (see paged_multi_controlled_qubit_op)
+    int paged_single_qubit_op(const Complex op[2][2], int k, PagedState * state);
+
+    /// @brief Apply a controlled gate (see paged_multi_controlled_qubit_op)
+    int paged_controlled_qubit_op(const Complex op[2][2], int ctrl, int targ,
+            PagedState * state);
+
+    /**
+     * @brief Copy amplitudes between the SRAM and an ordinary state
+     * @param state The state in the SRAM
+     * @param local A state with the same number of qubits
+     * @return 0 if successful, -1 if the sizes are different
+     */
+    int paged_load(const PagedState * state, StateVector * local);
+    int paged_store(PagedState * state, const StateVector * local);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PAGED_H */
+
@@ -0,0 +1,53 @@
+/**
+ * @file parallel.c
+ *
+ * @brief Description: Splitting gate kernels across threads on the host
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "parallel.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/// States with at least this many amplitudes are split across threads
+static size_t threshold = PARALLEL_THRESHOLD;
+
+void parallel_set_threshold(size_t length) {
+    threshold = length;
+}
+
+size_t parallel_threshold(void) {
+    return threshold;
+}
+
+int parallel_threads(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void parallel_range(size_t length, size_t count, RangeFn fn, void * ctx) {
+#ifdef _OPENMP
+    if (length >= threshold && count > 1 && omp_get_max_threads() > 1) {
+        #pragma omp parallel
+        {
+            /// One contiguous block per thread, so each thread streams 
+            /// through its own part of the state
+            size_t t = omp_get_thread_num();
+            size_t nt = omp_get_num_threads();
+            size_t begin = count * t / nt;
+            size_t end = count * (t + 1) / nt;
+            if (begin < end) fn(ctx, begin, end);
+        }
+        return;
+    }
+#else
+    (void)length; // Only used to decide on threads
+#endif
+    fn(ctx, 0, count);
+}
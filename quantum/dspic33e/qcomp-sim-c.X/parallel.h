@@ -0,0 +1,65 @@
+/**
+ * @file parallel.h
+ *
+ * @brief Description: Splitting gate kernels across threads on the host
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (not part of the MPLAB project). When the host build is
+ * compiled with OpenMP (the default, see `make host'), a range of work
+ * items such as amplitude pairs is split into one contiguous block per
+ * thread. States shorter than the threshold are processed on the calling
+ * thread, where the cost of waking the other threads would be larger than
+ * the gate itself. Without OpenMP everything runs on the calling thread.
+ *
+ * The number of threads is set with the usual OMP_NUM_THREADS variable.
+ */
+
+#ifndef PARALLEL_H
+#define	PARALLEL_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/// The default threshold, in amplitudes
+#ifndef PARALLEL_THRESHOLD
+#define PARALLEL_THRESHOLD ((size_t)1 << 16)
+#endif
+
+    /// @brief A function which processes the work items [begin, end)
+    typedef void (*RangeFn)(void * ctx, size_t begin, size_t end);
+
+    /**
+     * @brief Set the smallest state which is split across threads
+     * @param length The threshold, in amplitudes
+     */
+    void parallel_set_threshold(size_t length);
+
+    /// @brief The smallest state which is split across threads
+    size_t parallel_threshold(void);
+
+    /// @brief The number of threads used above the threshold
+    int parallel_threads(void);
+
+    /**
+     * @brief Call fn on blocks of the range [0, count)
+     * @param length The length of the state vector (compared with the
+     * threshold)
+     * @param count The number of work items
+     * @param fn The function to call on each block
+     * @param ctx Passed to fn
+     *
+     * The blocks do not overlap and together cover the range exactly. fn
+     * must only write to the amplitudes belonging to its own work items.
+     */
+    void parallel_range(size_t length, size_t count, RangeFn fn, void * ctx);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PARALLEL_H */
+
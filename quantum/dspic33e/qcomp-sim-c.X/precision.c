@@ -0,0 +1,76 @@
+/**
+ * @file precision.c
+ *
+ * @brief Description: The gate kernel built for several scalar types
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "precision.h"
+#include "consts.h"
+
+/// The vacuum amplitude, as in zero_state
+#define ONE ONE_Q15
+
+/// @brief Round a double to a fixed point number with the given fractional
+/// bits, saturating at the ends of the range
+static int64_t to_fixed(double x, int bits, int64_t max) {
+    double scaled = round(ldexp(x, bits));
+    if (scaled > max) return max;
+    if (scaled < -max - 1) return -max - 1;
+    return (int64_t)scaled;
+}
+
+/// @brief Shift right with rounding, and saturate to the range
+static int64_t round_shift(int64_t x, int shift, int64_t max) {
+    x = (x + ((int64_t)1 << (shift - 1))) >> shift;
+    if (x > max) return max;
+    if (x < -max - 1) return -max - 1;
+    return x;
+}
+
+#define PREC_NAME float
+#define PREC_T float
+#define PREC_ACC float
+#define PREC_FROM(x) ((float)(x))
+#define PREC_TO(x) ((double)(x))
+#define PREC_MUL(a, b) ((a) * (b))
+#define PREC_STORE(acc) (acc)
+#include "precision_impl.h"
+
+#define PREC_NAME double
+#define PREC_T double
+#define PREC_ACC double
+#define PREC_FROM(x) ((double)(x))
+#define PREC_TO(x) (x)
+#define PREC_MUL(a, b) ((a) * (b))
+#define PREC_STORE(acc) (acc)
+#include "precision_impl.h"
+
+/// Q15: products are Q30, summed in 64 bits (like the 40 bit accumulator)
+#define PREC_NAME q15
+#define PREC_T int16_t
+#define PREC_ACC int64_t
+#define PREC_FROM(x) ((int16_t)to_fixed((x), 15, INT16_MAX))
+#define PREC_TO(x) ldexp((double)(x), -15)
+#define PREC_MUL(a, b) ((int64_t)(a) * (b))
+#define PREC_STORE(acc) ((int16_t)round_shift((acc), 15, INT16_MAX))
+#include "precision_impl.h"
+
+/// Q31: every product is rounded back to Q31 before it is summed
+#define PREC_NAME q31
+#define PREC_T int32_t
+#define PREC_ACC int64_t
+#define PREC_FROM(x) ((int32_t)to_fixed((x), 31, INT32_MAX))
+#define PREC_TO(x) ldexp((double)(x), -31)
+#define PREC_MUL(a, b) round_shift((int64_t)(a) * (b), 31, INT32_MAX)
+#define PREC_STORE(acc) ((int32_t)((acc) > INT32_MAX ? INT32_MAX \
+        : (acc) < INT32_MIN ? INT32_MIN : (acc)))
+#include "precision_impl.h"
+
+const Precision * const precisions[] = {
+    &precision_float, &precision_double, &precision_q15, &precision_q31,
+};
@@ -0,0 +1,61 @@
+/**
+ * @file precision.h
+ *
+ * @brief Description: The gate kernel built for several scalar types
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (not part of the MPLAB project). The simulator itself uses one
+ * amplitude type, chosen at build time (Q15 on the dsPIC, float on the
+ * host, see AMP_Q31 in consts.h). To measure what the fixed point format
+ * costs in accuracy and speed, the multi-controlled gate kernel is also 
+ * written once in precision_impl.h, parameterised by macros on the scalar
+ * type, and compiled into the host library for
+ *
+ *   - float and double
+ *   - Q15: 16 bit integers. The products are summed at full precision and
+ *     rounded and saturated once, like mat_mul with the DSP engine
+ *   - Q31: 32 bit integers. Every product is rounded to Q31, like the XC16
+ *     library routines for long _Fract
+ *
+ * Each instantiation is used through a Precision table. They all use the
+ * same plain loop (no vectors or threads), so only the scalar type differs.
+ */
+
+#ifndef PRECISION_H
+#define	PRECISION_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+    /// @brief A 2x2 complex matrix in double, converted to each type
+    typedef double Matrix2[2][2][2];
+
+    /// @brief A state vector and its gate kernel for one scalar type
+    typedef struct {
+        const char * name; ///< The name of the scalar type
+        /// Make a state in the vacuum (NULL if there is not enough memory)
+        void * (*alloc)(int num_qubits);
+        /// Free a state made with alloc
+        void (*free)(void * state);
+        /// Apply op to targ if every qubit in ctrl_mask is ONE
+        void (*gate)(void * state, const Matrix2 op, size_t ctrl_mask, int targ);
+        /// Read the ith amplitude as a double
+        void (*amplitude)(const void * state, size_t i, double out[2]);
+    } Precision;
+
+    /// The instantiations, in the order float, double, Q15, Q31
+    extern const Precision * const precisions[];
+
+    /// The number of entries in precisions
+#define NUM_PRECISIONS 4
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PRECISION_H */
+
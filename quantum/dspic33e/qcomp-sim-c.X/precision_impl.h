@@ -0,0 +1,111 @@
+/**
+ * @file precision_impl.h
+ *
+ * @brief Description: The gate kernel for one scalar type
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Included by precision.c once per scalar type, with these defined:
+ *
+ *   PREC_NAME          The suffix of the names and the name in the table
+ *   PREC_T             The scalar type of the amplitudes
+ *   PREC_ACC           The type that products are summed in
+ *   PREC_FROM(x)       Convert a double to PREC_T
+ *   PREC_TO(x)         Convert a PREC_T to double
+ *   PREC_MUL(a, b)     The product of two PREC_T, as PREC_ACC
+ *   PREC_STORE(acc)    Round a sum of products to PREC_T
+ *
+ * They are undefined again at the end, ready for the next type.
+ */
+
+#define PREC_CAT2(a, b) a##_##b
+#define PREC_CAT(a, b) PREC_CAT2(a, b)
+#define PREC_FN(name) PREC_CAT(name, PREC_NAME)
+#define PREC_STR2(a) #a
+#define PREC_STR(a) PREC_STR2(a)
+
+/// @brief A state vector of PREC_T amplitudes
+typedef struct {
+    int num_qubits;
+    size_t length;
+    PREC_T (*amp)[2];
+} PREC_FN(State);
+
+static void * PREC_FN(alloc)(int num_qubits) {
+    PREC_FN(State) * state = malloc(sizeof(*state));
+    if (state == NULL) return NULL;
+    state->num_qubits = num_qubits;
+    state->length = (size_t)1 << num_qubits;
+    state->amp = calloc(state->length, sizeof(*state->amp));
+    if (state->amp == NULL) {
+        free(state);
+        return NULL;
+    }
+    state->amp[0][0] = PREC_FROM(ONE);
+    return state;
+}
+
+static void PREC_FN(free)(void * ctx) {
+    PREC_FN(State) * state = ctx;
+    free(state->amp);
+    free(state);
+}
+
+/// The same pair enumeration as multi_controlled_qubit_op
+static void PREC_FN(gate)(void * ctx, const Matrix2 op, size_t ctrl_mask, 
+        int targ) {
+    PREC_FN(State) * state = ctx;
+    PREC_T m[2][2][2];
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            m[r][c][0] = PREC_FROM(op[r][c][0]);
+            m[r][c][1] = PREC_FROM(op[r][c][1]);
+        }
+    }
+    size_t targ_bit = (size_t)1 << targ;
+    size_t free_bits = (state->length - 1) & ~(ctrl_mask | targ_bit);
+    size_t x = 0;
+    do {
+        PREC_T (*a)[2] = &state->amp[x | ctrl_mask];
+        PREC_T (*b)[2] = &state->amp[x | ctrl_mask | targ_bit];
+        PREC_T ar = (*a)[0], ai = (*a)[1], br = (*b)[0], bi = (*b)[1];
+        PREC_ACC re, im;
+        re = PREC_MUL(m[0][0][0], ar) - PREC_MUL(m[0][0][1], ai)
+                + PREC_MUL(m[0][1][0], br) - PREC_MUL(m[0][1][1], bi);
+        im = PREC_MUL(m[0][0][0], ai) + PREC_MUL(m[0][0][1], ar)
+                + PREC_MUL(m[0][1][0], bi) + PREC_MUL(m[0][1][1], br);
+        (*a)[0] = PREC_STORE(re);
+        (*a)[1] = PREC_STORE(im);
+        re = PREC_MUL(m[1][0][0], ar) - PREC_MUL(m[1][0][1], ai)
+                + PREC_MUL(m[1][1][0], br) - PREC_MUL(m[1][1][1], bi);
+        im = PREC_MUL(m[1][0][0], ai) + PREC_MUL(m[1][0][1], ar)
+                + PREC_MUL(m[1][1][0], bi) + PREC_MUL(m[1][1][1], br);
+        (*b)[0] = PREC_STORE(re);
+        (*b)[1] = PREC_STORE(im);
+        x = ((x | ~free_bits) + 1) & free_bits;
+    } while (x != 0);
+}
+
+static void PREC_FN(amplitude)(const void * ctx, size_t i, double out[2]) {
+    const PREC_FN(State) * state = ctx;
+    out[0] = PREC_TO(state->amp[i][0]);
+    out[1] = PREC_TO(state->amp[i][1]);
+}
+
+static const Precision PREC_FN(precision) = {
+    PREC_STR(PREC_NAME), PREC_FN(alloc), PREC_FN(free), PREC_FN(gate), 
+    PREC_FN(amplitude),
+};
+
+#undef PREC_NAME
+#undef PREC_T
+#undef PREC_ACC
+#undef PREC_FROM
+#undef PREC_TO
+#undef PREC_MUL
+#undef PREC_STORE
+#undef PREC_CAT2
+#undef PREC_CAT
+#undef PREC_FN
+#undef PREC_STR2
+#undef PREC_STR
@@ -0,0 +1,150 @@
+/**
+ * @file qcircuit.c
+ *
+ * @brief Description: Runs a circuit file on the host
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (`make host-cli', then run build/host/qcircuit). Loads a
+ * circuit file (see circuit.h), runs it from the vacuum through the gate
+ * kernels in quantum.c and prints the final amplitudes and the time taken.
+ *
+ * Usage: qcircuit [options] file
+ *
+ * \verbatim
+ *   -d          Apply each gate directly instead of fusing them in a GateQueue
+ *   -n          Track and correct the norm (see state_renormalise)
+ *   -k kernel   Use the scalar, sse or avx2 kernel (default: the best one)
+ *   -p length   Split states of at least length amplitudes across threads
+ *   -r repeats  Run the circuit this many times and print the fastest time
+ *   -a count    Print at most this many amplitudes (default 16, 0 for none)
+ * \endverbatim
+ *
+ * Only amplitudes with a probability above PRINT_THRESHOLD are printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "circuit.h"
+#include "simd.h"
+#include "parallel.h"
+#include "time.h"
+
+/// The smallest probability printed
+#define PRINT_THRESHOLD 1e-9
+
+static void usage(void) {
+    fprintf(stderr, "usage: qcircuit [-d] [-n] [-k scalar|sse|avx2] [-p length]"
+            " [-r repeats] [-a count] file\n");
+}
+
+/// @brief Print the amplitudes of the state, largest index last
+static void print_amplitudes(StateVector * state, long max_count) {
+    long printed = 0;
+    for (size_t i = 0; i < state->length && printed < max_count; i++) {
+        double p = amp_square_magnitude(state, i);
+        if (p <= PRINT_THRESHOLD) continue;
+        char bits[MAX_QUBITS + 1];
+        for (int k = 0; k < state->num_qubits; k++) {
+            bits[state->num_qubits - 1 - k] = ((i >> k) & 1) ? '1' : '0';
+        }
+        bits[state->num_qubits] = '\0';
+        printf("|%s>  %+.6f %+.6fi  p=%.6f\n", bits, AMP_RE(state, i),
+                AMP_IM(state, i), p);
+        printed++;
+    }
+}
+
+int main(int argc, char ** argv) {
+    bool fuse = true;
+    bool renormalise = false;
+    int repeats = 1;
+    long max_count = 16;
+    int opt;
+    while ((opt = getopt(argc, argv, "dnk:p:r:a:")) != -1) {
+        switch (opt) {
+            case 'd':
+                fuse = false;
+                break;
+            case 'n':
+                renormalise = true;
+                break;
+            case 'k':
+                if (strcmp(optarg, "scalar") == 0) simd_select(SIMD_SCALAR);
+                else if (strcmp(optarg, "sse") == 0) simd_select(SIMD_SSE);
+                else if (strcmp(optarg, "avx2") == 0) simd_select(SIMD_AVX2);
+                else {
+                    usage();
+                    return 2;
+                }
+                break;
+            case 'p':
+                parallel_set_threshold(strtoul(optarg, NULL, 10));
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                if (repeats < 1) repeats = 1;
+                break;
+            case 'a':
+                max_count = atol(optarg);
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return 2;
+    }
+
+    const char * path = argv[optind];
+    FILE * file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    Circuit circuit;
+    char error[128];
+    int result = circuit_read(&circuit, file, error, sizeof(error));
+    fclose(file);
+    if (result != 0) {
+        fprintf(stderr, "%s: %s\n", path, error);
+        circuit_free(&circuit);
+        return 1;
+    }
+
+    StateVector state;
+    if (state_alloc(&state, circuit.num_qubits) != 0) {
+        fprintf(stderr, "qcircuit: cannot make a %d qubit state\n",
+                circuit.num_qubits);
+        circuit_free(&circuit);
+        return 1;
+    }
+
+    setup_timer();
+    unsigned long best = 0;
+    long passes = 0;
+    for (int r = 0; r < repeats; r++) {
+        zero_state(&state);
+        state_renormalise(&state, renormalise);
+        reset_timer();
+        start_timer();
+        passes = circuit_run(&circuit, &state, fuse);
+        stop_timer();
+        unsigned long t = read_timer();
+        if (r == 0 || t < best) best = t;
+    }
+
+    printf("%s: %d qubits, %zu gates, %ld passes (%s), %s kernel, %d threads\n",
+            path, circuit.num_qubits, circuit.count, passes,
+            fuse ? "queued" : "direct", simd_name(), parallel_threads());
+    printf("time %lu ns, norm %.9f\n", best, state_norm(&state));
+    print_amplitudes(&state, max_count);
+
+    state_free(&state);
+    circuit_free(&circuit);
+    return 0;
+}
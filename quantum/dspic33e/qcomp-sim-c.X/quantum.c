@@ -8,7 +8,14 @@
 * @todo split into a complex math and operator files 
  */
 
+#include <stdlib.h>
 #include "quantum.h"
+#ifndef __XC16__
+#include "simd.h"
+#include "parallel.h"
+#else
+#include "xc.h"
+#endif
 
 /**
  * @brief A simple function to compute integer powers of 2
@@ -82,17 +89,76 @@ Q15 square_magnitude(Complex x) {
     return x[0] * x[0] + x[1] * x[1];
 }
 
+/**
+ * @param state The state vector
+ * @param i The index of the amplitude
+ * @return The value of |a_i|^2
+ */
+Q15 amp_square_magnitude(const StateVector * state, size_t i) {
+    return AMP_RE(state, i) * AMP_RE(state, i) 
+            + AMP_IM(state, i) * AMP_IM(state, i);
+}
+
+/**
+ * @param state The state vector to set up
+ * @param num_qubits The number of qubits
+ * @param storage An array of at least 2^num_qubits amplitudes
+ * @return 0 if successful, -1 otherwise
+ */
+int state_init(StateVector * state, int num_qubits, Complex storage[]) {
+    if (num_qubits < 1 || num_qubits > MAX_QUBITS) return -1;
+    state->num_qubits = num_qubits;
+    state->length = (size_t)1 << num_qubits;
+#ifdef STATE_SOA
+    state->re = (Q15 *)storage;
+    state->im = state->re + state->length;
+#else
+    state->amp = storage;
+#endif
+    state->norm = NORM_TARGET;
+    state->renormalise = false;
+    state->changes = 0;
+    return 0;
+}
+
+/**
+ * @param state The state vector to set up
+ * @param num_qubits The number of qubits
+ * @return 0 if successful, -1 otherwise
+ */
+int state_alloc(StateVector * state, int num_qubits) {
+    if (num_qubits < 1 || num_qubits > MAX_QUBITS) return -1;
+    Complex * storage = malloc(((size_t)1 << num_qubits) * sizeof(Complex));
+    if (storage == NULL) return -1;
+    state_init(state, num_qubits, storage);
+    zero_state(state);
+    return 0;
+}
+
+/// @param state A state vector made with state_alloc
+void state_free(StateVector * state) {
+#ifdef STATE_SOA
+    free(state->re); // The imaginary parts share the allocation
+    state->re = NULL;
+    state->im = NULL;
+#else
+    free(state->amp);
+    state->amp = NULL;
+#endif
+    state->num_qubits = 0;
+    state->length = 0;
+}
+
 /// Initialise state to the vacuum (zero apart from the first position)
-/// Specify the dimension -- of the matrix, i.e. 2^(number of qubits)
-void zero_state(Complex state[]) {
-    for (int i = 0; i < STATE_LENGTH; i++) {
-        // Loop over the real and imaginary parts
-        for (int j = 0; j < 2; j++) {
-            state[i][j] = 0.0;
-        }
+void zero_state(StateVector * state) {
+    for (size_t i = 0; i < state->length; i++) {
+        AMP_RE(state, i) = 0.0;
+        AMP_IM(state, i) = 0.0;
     }
     /// @note oh the clarity! 
-    state[0][0] = ONE_Q15;
+    AMP_RE(state, 0) = ONE_Q15;
+    state->norm = NORM_TARGET;
+    state->changes++;
 }
 
 
@@ -100,64 +166,469 @@ void zero_state(Complex state[]) {
  * @brief This is an old version of the mat_mul function
  * 
  * @param M A 2x2 complex matrix
- * @param V A Nx1 complex vector
- * @param i The first index to pick from the vector V
- * @param j The second index to pick from the vector V
+ * @param state The state vector
+ * @param i The first index to pick from the state vector
+ * @param j The second index to pick from the state vector
  * 
  * The function uses cadd and cmul
  * 
  */
-void mat_mul_old(const Complex M[2][2], Complex V[], int i, int j) {
-    static Complex a, b, c, d; ///@todo Should these be outside the function?
-    cmul(M[0][0],V[i],a); 
-    cmul(M[0][1],V[j],b);
+void mat_mul_old(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    Complex a, b, c, d;
+    Complex vi = {AMP_RE(state, i), AMP_IM(state, i)};
+    Complex vj = {AMP_RE(state, j), AMP_IM(state, j)};
+    cmul(M[0][0],vi,a); 
+    cmul(M[0][1],vj,b);
     cadd(a,b,c);
-    cmul(M[1][0],V[i],a);
-    cmul(M[1][1],V[j],b);
+    cmul(M[1][0],vi,a);
+    cmul(M[1][1],vj,b);
     cadd(a,b,d);
-    V[i][0] = c[0];
-    V[i][1] = c[1];
-    V[j][0] = d[0];
-    V[j][1] = d[1];
+    AMP_RE(state, i) = c[0];
+    AMP_IM(state, i) = c[1];
+    AMP_RE(state, j) = d[0];
+    AMP_IM(state, j) = d[1];
 }
 
 /**
  * @brief This version uses inlined cadd and cmul
  * 
  * @param M A 2x2 complex matrix
- * @param V A Nx1 complex vector
- * @param i The first index to pick from the vector V
- * @param j The second index to pick from the vector V
+ * @param state The state vector
+ * @param i The first index to pick from the state vector
+ * @param j The second index to pick from the state vector
  * 
+ * On the dsPIC each output is summed in one of the 40 bit accumulators
+ * with the DSP engine instead (see below), unless the amplitudes are Q31.
  */
-void mat_mul(const Complex M[2][2], Complex V[], int i, int j) {
+#if defined(__XC16__) && !defined(AMP_Q31)
+/// The bits of a Q15 number, which is what the DSP builtins take
+static inline int q15_bits(Q15 x) {
+    union { Q15 q; int bits; } u = {x};
+    return u.bits;
+}
+
+/// The Q15 number with the given bits
+static inline Q15 bits_q15(int bits) {
+    union { Q15 q; int bits; } u;
+    u.bits = bits;
+    return u.q;
+}
+
+/// Shorthands for the unused prefetch and write back arguments
+#define NO_MPY_PREFETCH NULL, NULL, 0, NULL, NULL, 0
+#define NO_MAC_PREFETCH NO_MPY_PREFETCH, NULL, 0
+
+unsigned int mat_mul_begin(void) {
+    /// Saturate both accumulators, fractional mode, round to nearest
+    unsigned int corcon = CORCON;
+    CORCONbits.SATA = 1;
+    CORCONbits.SATB = 1;
+    CORCONbits.SATDW = 1;
+    CORCONbits.IF = 0;
+    CORCONbits.RND = 1;
+    return corcon;
+}
+
+void mat_mul_end(unsigned int saved) {
+    CORCON = saved;
+}
+
+/**
+ * Each output is four products (MPY, then MAC or MSC), accumulated in
+ * ACCA or ACCB at full precision (40 bits), and stored with one rounding 
+ * (SAC.R) instead of truncating every product to Q15. The real and 
+ * imaginary parts of an output use the two accumulators so that the 
+ * products can be interleaved. The accumulators saturate, and so does the
+ * store, so a matrix which is not quite unitary clips at +/-1 instead of 
+ * wrapping round.
+ * 
+ * The MAC prefetch from X and Y data space is not used: it needs the
+ * matrix in X space and the state in Y space, and the state can be any
+ * array (e.g. the one on the stack in main). Loading the eight words 
+ * into registers first costs about as much as the prefetch would save,
+ * since every word is used twice.
+ *
+ * CORCON is set up once for the whole gate by mat_mul_begin rather than
+ * saved and restored here for every pair.
+ */
+void mat_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    register int acc_a asm("A");
+    register int acc_b asm("B");
+
+    int ir = q15_bits(AMP_RE(state, i)), ii = q15_bits(AMP_IM(state, i));
+    int jr = q15_bits(AMP_RE(state, j)), ji = q15_bits(AMP_IM(state, j));
+
+    /// ZERO output: real part in A, imaginary part in B
+    int mr = q15_bits(M[0][0][0]), mi = q15_bits(M[0][0][1]);
+    acc_a = __builtin_mpy(mr, ir, NO_MPY_PREFETCH);
+    acc_b = __builtin_mpy(mr, ii, NO_MPY_PREFETCH);
+    acc_a = __builtin_msc(acc_a, mi, ii, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mi, ir, NO_MAC_PREFETCH);
+    mr = q15_bits(M[0][1][0]);
+    mi = q15_bits(M[0][1][1]);
+    acc_a = __builtin_mac(acc_a, mr, jr, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mr, ji, NO_MAC_PREFETCH);
+    acc_a = __builtin_msc(acc_a, mi, ji, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mi, jr, NO_MAC_PREFETCH);
+    int zr = __builtin_sacr(acc_a, 0);
+    int zi = __builtin_sacr(acc_b, 0);
 
-    /// @todo Is static enough? Or should we declare outside the function?
-    static Q15 a, b, c, d;
+    /// ONE output
+    mr = q15_bits(M[1][0][0]);
+    mi = q15_bits(M[1][0][1]);
+    acc_a = __builtin_mpy(mr, ir, NO_MPY_PREFETCH);
+    acc_b = __builtin_mpy(mr, ii, NO_MPY_PREFETCH);
+    acc_a = __builtin_msc(acc_a, mi, ii, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mi, ir, NO_MAC_PREFETCH);
+    mr = q15_bits(M[1][1][0]);
+    mi = q15_bits(M[1][1][1]);
+    acc_a = __builtin_mac(acc_a, mr, jr, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mr, ji, NO_MAC_PREFETCH);
+    acc_a = __builtin_msc(acc_a, mi, ji, NO_MAC_PREFETCH);
+    acc_b = __builtin_mac(acc_b, mi, jr, NO_MAC_PREFETCH);
+
+    AMP_RE(state, i) = bits_q15(zr);
+    AMP_IM(state, i) = bits_q15(zi);
+    AMP_RE(state, j) = bits_q15(__builtin_sacr(acc_a, 0));
+    AMP_IM(state, j) = bits_q15(__builtin_sacr(acc_b, 0));
+}
+#else
+unsigned int mat_mul_begin(void) {
+    return 0;
+}
+
+void mat_mul_end(unsigned int saved) {
+    (void)saved;
+}
+
+void mat_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+
+    /// Local temporaries (not static) so they can live in registers
+    Q15 a, b, c, d;
+    
+    /// Read the two amplitudes once (works with either layout)
+    Q15 ir = AMP_RE(state, i), ii = AMP_IM(state, i);
+    Q15 jr = AMP_RE(state, j), ji = AMP_IM(state, j);
     
     /// @todo Should we use for loops? Or is it better not to..?
     
     // Manual complex matrix multiplication for first element of vector
-    a = M[0][0][0] * V[i][0] - M[0][0][1] * V[i][1] + 
-            M[0][1][0] * V[j][0] - M[0][1][1] * V[j][1]; // Real part
-    b = M[0][0][0] * V[i][1] + M[0][0][1] * V[i][0] + 
-            M[0][1][0] * V[j][1] + M[0][1][1] * V[j][0]; // Imag part
+    a = M[0][0][0] * ir - M[0][0][1] * ii + 
+            M[0][1][0] * jr - M[0][1][1] * ji; // Real part
+    b = M[0][0][0] * ii + M[0][0][1] * ir + 
+            M[0][1][0] * ji + M[0][1][1] * jr; // Imag part
     
     // Manual complex matrix multiplication for second element of vector
-    c = M[1][0][0] * V[i][0] - M[1][0][1] * V[i][1] + 
-            M[1][1][0] * V[j][0] - M[1][1][1] * V[j][1]; // Real part
-    d = M[1][0][0] * V[i][1] + M[1][0][1] * V[i][0] + 
-            M[1][1][0] * V[j][1] + M[1][1][1] * V[j][0]; // Imag part
+    c = M[1][0][0] * ir - M[1][0][1] * ii + 
+            M[1][1][0] * jr - M[1][1][1] * ji; // Real part
+    d = M[1][0][0] * ii + M[1][0][1] * ir + 
+            M[1][1][0] * ji + M[1][1][1] * jr; // Imag part
     
-    /// This is necessary because the previous computations use V
-    V[i][0] = a;
-    V[i][1] = b;
-    V[j][0] = c;
-    V[j][1] = d;
+    /// This is necessary because the previous computations use the state
+    AMP_RE(state, i) = a;
+    AMP_IM(state, i) = b;
+    AMP_RE(state, j) = c;
+    AMP_IM(state, j) = d;
     
     // Get me out of here
     return;
 }
+#endif
+
+/**
+ * @param A The left matrix (the gate applied second)
+ * @param B The right matrix (the gate applied first)
+ * @param C The result (must not be A or B)
+ */
+void mat_mat_mul(const Complex A[2][2], const Complex B[2][2], Complex C[2][2]) {
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            C[r][c][0] = A[r][0][0] * B[0][c][0] - A[r][0][1] * B[0][c][1]
+                    + A[r][1][0] * B[1][c][0] - A[r][1][1] * B[1][c][1];
+            C[r][c][1] = A[r][0][0] * B[0][c][1] + A[r][0][1] * B[0][c][0]
+                    + A[r][1][0] * B[1][c][1] + A[r][1][1] * B[1][c][0];
+        }
+    }
+}
+
+/// True if the complex number is one. ONE_Q15 counts as one because 1.0 is
+/// not a Q15 number
+static bool is_one(const Complex a) {
+    return a[0] >= ONE_Q15 && a[1] == 0.0;
+}
+
+/// True if the complex number is minus one
+static bool is_minus_one(const Complex a) {
+    return a[0] <= -ONE_Q15 && a[1] == 0.0;
+}
+
+/// True if the complex number is zero
+static bool is_zero(const Complex a) {
+    return a[0] == 0.0 && a[1] == 0.0;
+}
+
+/**
+ * @param op The 2x2 matrix
+ * @return The kind of the matrix
+ * 
+ * The checks are exact apart from ONE_Q15 (the one in the gate constants,
+ * see consts.c), which counts as one. So the fast paths do not give quite
+ * the same answer as mat_mul: where mat_mul scales an amplitude by 
+ * ONE_Q15, they leave it as it is. That is a relative difference of about
+ * 3e-5 (5e-10 with AMP_Q31) per gate, on the dsPIC and on the host, and 
+ * the fast paths are the ones which keep the norm.
+ */
+GateKind classify_gate(const Complex op[2][2]) {
+    if (is_zero(op[0][1]) && is_zero(op[1][0])) {
+        if (is_one(op[0][0])) {
+            if (is_one(op[1][1])) return GATE_IDENTITY;
+            if (is_minus_one(op[1][1])) return GATE_SIGN;
+            return GATE_PHASE;
+        }
+        return GATE_DIAGONAL;
+    }
+    if (is_zero(op[0][0]) && is_zero(op[1][1])) {
+        if (is_one(op[0][1]) && is_one(op[1][0])) return GATE_SWAP;
+        return GATE_ANTIDIAGONAL;
+    }
+    return GATE_GENERAL;
+}
+
+/// Multiply the ith amplitude by the complex number m
+static void amp_mul(const Complex m, StateVector * state, size_t i) {
+    Q15 re = AMP_RE(state, i), im = AMP_IM(state, i);
+    AMP_RE(state, i) = m[0] * re - m[1] * im;
+    AMP_IM(state, i) = m[0] * im + m[1] * re;
+}
+
+/// Nothing to do
+static void identity_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    (void)M; (void)state; (void)i; (void)j;
+}
+
+/// Multiply the ZERO and ONE amplitudes by the diagonal elements
+static void diagonal_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    amp_mul(M[0][0], state, i);
+    amp_mul(M[1][1], state, j);
+}
+
+/// Multiply the ONE amplitude by the phase (the ZERO amplitude is not read)
+static void phase_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    (void)i;
+    amp_mul(M[1][1], state, j);
+}
+
+/// Change the sign of the ONE amplitude
+static void sign_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    (void)M; (void)i;
+    AMP_RE(state, j) = -AMP_RE(state, j);
+    AMP_IM(state, j) = -AMP_IM(state, j);
+}
+
+/// Exchange the ZERO and ONE amplitudes
+static void swap_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    (void)M;
+    Q15 re = AMP_RE(state, i), im = AMP_IM(state, i);
+    AMP_RE(state, i) = AMP_RE(state, j);
+    AMP_IM(state, i) = AMP_IM(state, j);
+    AMP_RE(state, j) = re;
+    AMP_IM(state, j) = im;
+}
+
+/// Exchange the ZERO and ONE amplitudes and multiply them by the
+/// off-diagonal elements
+static void antidiagonal_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j) {
+    swap_mul(M, state, i, j);
+    amp_mul(M[0][1], state, i);
+    amp_mul(M[1][0], state, j);
+}
+
+/**
+ * @param kind The kind of matrix (from classify_gate)
+ * @return The function which applies that kind of matrix to one pair
+ */
+PairOp pair_op(GateKind kind) {
+    switch (kind) {
+        case GATE_IDENTITY: return identity_mul;
+        case GATE_DIAGONAL: return diagonal_mul;
+        case GATE_PHASE: return phase_mul;
+        case GATE_SIGN: return sign_mul;
+        case GATE_SWAP: return swap_mul;
+        case GATE_ANTIDIAGONAL: return antidiagonal_mul;
+        default: return mat_mul;
+    }
+}
+
+/// |a_i|^2 at the precision of NormSum, which keeps the small amplitudes 
+/// that Q15 squares lose
+static NormSum amp_norm(const StateVector * state, size_t i) {
+    NormSum re = AMP_RE(state, i), im = AMP_IM(state, i);
+    return re * re + im * im;
+}
+
+/// @brief sum |a_i|^2, at the precision of NormSum
+static NormSum norm_sum(const StateVector * state) {
+    NormSum norm = 0;
+    for (size_t i = 0; i < state->length; i++) {
+        norm += amp_norm(state, i);
+    }
+    return norm;
+}
+
+/**
+ * @param state The state vector
+ * @return sum |a_i|^2
+ */
+float state_norm(const StateVector * state) {
+    return (float)norm_sum(state);
+}
+
+/**
+ * @param state The state vector
+ * @param on true to track and correct the norm
+ */
+void state_renormalise(StateVector * state, bool on) {
+    state->renormalise = on;
+    if (on) state->norm = norm_sum(state);
+}
+
+/// The number of pairs in a block when tracking the norm (small enough 
+/// to stay in cache between the two sums)
+#define NORM_BLOCK 1024
+
+/**
+ * @brief The sum of |a|^2 over a range of pairs
+ * 
+ * The pairs are numbered like multi_controlled_qubit_op: the qth ZERO 
+ * index is insert_zeros(q, ctrl_mask | targ_bit) | ctrl_mask.
+ */
+static NormSum pairs_norm(const StateVector * state, size_t targ_bit, 
+        size_t ctrl_mask, size_t begin, size_t end) {
+    size_t free = (state->length - 1) & ~(ctrl_mask | targ_bit);
+    size_t x = insert_zeros(begin, ctrl_mask | targ_bit);
+    NormSum norm = 0;
+    for (size_t q = begin; q < end; q++) {
+        size_t zero = x | ctrl_mask;
+        norm += amp_norm(state, zero) + amp_norm(state, zero + targ_bit);
+        x = ((x | ~free) + 1) & free;
+    }
+    return norm;
+}
+
+/// The arguments of tracked_op, for the parallel blocks
+typedef struct {
+    const Complex (*op)[2];
+    int targ;
+    size_t ctrl_mask;
+    StateVector * state;
+    NormSum change; ///< The change in the norm
+} TrackedJob;
+
+/// Apply the gate to the pairs [begin, end), NORM_BLOCK at a time, and add
+/// the change in the norm to job->change
+static void tracked_block(void * ctx, size_t begin, size_t end) {
+    TrackedJob * job = ctx;
+    size_t targ_bit = (size_t)1 << job->targ;
+    NormSum change = 0;
+    for (size_t b = begin; b < end; b += NORM_BLOCK) {
+        size_t e = (end - b > NORM_BLOCK) ? b + NORM_BLOCK : end;
+        change -= pairs_norm(job->state, targ_bit, job->ctrl_mask, b, e);
+#ifndef __XC16__
+        simd_controlled_op(job->op, job->targ, job->ctrl_mask, job->state, b, e);
+#else
+        PairOp pair = pair_op(classify_gate(job->op));
+        size_t free = (job->state->length - 1) & ~(job->ctrl_mask | targ_bit);
+        size_t x = insert_zeros(b, job->ctrl_mask | targ_bit);
+        unsigned int dsp = mat_mul_begin();
+        for (size_t q = b; q < e; q++) {
+            size_t zero = x | job->ctrl_mask;
+            pair(job->op, job->state, zero, zero + targ_bit);
+            x = ((x | ~free) + 1) & free;
+        }
+        mat_mul_end(dsp);
+#endif
+        change += pairs_norm(job->state, targ_bit, job->ctrl_mask, b, e);
+    }
+#ifdef _OPENMP
+    #pragma omp atomic
+#endif
+    job->change += change;
+}
+
+/// Corrections to the norm smaller than 2^-NORM_TINY_BITS are not made,
+/// as they hardly change the amplitudes
+#ifdef AMP_Q31
+#define NORM_TINY_BITS 30
+#else
+#define NORM_TINY_BITS 20
+#endif
+
+/**
+ * The square root is not used, as the dsPIC only has one for float, in
+ * software. The norm only drifts by the rounding in the gates since the last 
+ * correction, so d = norm - NORM_TARGET is small (and as NORM_TARGET is 
+ * one to within the resolution of Q15, it is also the relative drift). 
+ * 1 - d/2 + 3d^2/8 is then as close as the amplitudes can show for 
+ * |d| < 1/32 in Q15 (1/1000 in Q31). A larger d is clipped to 1/2, and 
+ * the norm is put back over a few gates instead of one. A correction
+ * smaller than 2^-NORM_TINY_BITS is left for later (the factor is 1).
+ */
+NormSum norm_correction(NormSum norm) {
+    const NormSum half = (NormSum)1 / 2;
+    const NormSum tiny = (NormSum)1 / (1L << NORM_TINY_BITS);
+    NormSum d = norm - NORM_TARGET;
+    if (d < 2 * tiny && d > -2 * tiny) return 1;
+    if (d > half) d = half;
+    if (d < -half) d = -half;
+    return 1 - d / 2 + 3 * d * d / 8;
+}
+
+/**
+ * @brief Scale a matrix so that it puts the norm of the state back
+ * @return 0 if successful, -1 if there is nothing to correct or the scaled
+ * matrix does not fit in the amplitude type
+ */
+static int renormalise_gate(const Complex op[2][2], NormSum norm, 
+        Complex scaled[2][2]) {
+    if (norm <= 0) return -1;
+    NormSum s = norm_correction(norm);
+    if (s == 1) return -1;
+    const NormSum one = ONE_Q15;
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            for (int n = 0; n < 2; n++) {
+                NormSum x = s * op[r][c][n];
+                if (x > one || x < -one) return -1;
+                scaled[r][c][n] = x;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Apply a (controlled) gate and update the running norm
+ * 
+ * Used by the gate kernels when state->renormalise is set (see 
+ * state_renormalise). A single qubit gate also corrects the norm.
+ */
+static void tracked_op(const Complex op[2][2], size_t ctrl_mask, int targ,
+        StateVector * state) {
+    Complex scaled[2][2];
+    TrackedJob job = {op, targ, ctrl_mask, state, 0};
+    if (ctrl_mask == 0 && renormalise_gate(op, state->norm, scaled) == 0) {
+        job.op = scaled;
+    }
+    int c = 0;
+    for (size_t m = ctrl_mask; m != 0; m &= m - 1) c++;
+    size_t pairs = state->length >> (c + 1);
+#ifndef __XC16__
+    parallel_range(state->length, pairs, tracked_block, &job);
+#else
+    tracked_block(&job, 0, pairs);
+#endif
+    state->norm += job.change;
+}
 
 /** apply operator
  * @param state state vector containing amplitudes 
@@ -215,19 +686,50 @@ void mat_mul(const Complex M[2][2], Complex V[], int i, int j) {
  * 
  * corresponds to the ONE entry.
  * 
+ * On the host the pairs are handed to the vectorised kernel in simd.c
+ * instead, which walks them in contiguous blocks. Large states are split
+ * into one block of pairs per thread (see parallel.h).
+ * 
  */
-void single_qubit_op(const Complex op[2][2], int k, Complex state[]) {
-    int root_max = pow2(k); // Declared outside the loop
-    int increment = 2 * root_max;
+#ifndef __XC16__
+/// The arguments of single_qubit_op, for the parallel blocks
+typedef struct {
+    const Complex (*op)[2];
+    int k;
+    StateVector * state;
+} SingleQubitJob;
+
+static void single_qubit_block(void * ctx, size_t begin, size_t end) {
+    SingleQubitJob * job = ctx;
+    simd_single_qubit_op(job->op, job->k, job->state, begin, end);
+}
+#endif
+
+void single_qubit_op(const Complex op[2][2], int k, StateVector * state) {
+    state->changes++;
+    if (state->renormalise) {
+        tracked_op(op, 0, k, state);
+        return;
+    }
+#ifndef __XC16__
+    SingleQubitJob job = {op, k, state};
+    parallel_range(state->length, state->length >> 1, single_qubit_block, &job);
+#else
+    PairOp pair = pair_op(classify_gate(op)); // mat_mul or a faster one
+    size_t root_max = (size_t)1 << k; // Declared outside the loop
+    size_t increment = 2 * root_max;
+    unsigned int dsp = mat_mul_begin();
     /// ROOT loop: starts at 0, increases in steps of 1
-    for (int root = 0; root < root_max; root++) {
+    for (size_t root = 0; root < root_max; root++) {
         /// STEP loop: starts at 0, increases in steps of 2^(k+1)
-        for (int step = 0; step < STATE_LENGTH; step += increment) {
+        for (size_t step = 0; step < state->length; step += increment) {
             /// First index is ZERO, second index is ONE
             /// @todo Should we inline mat_mul here?
-            mat_mul(op, state, root + step, root + root_max + step);
+            pair(op, state, root + step, root + root_max + step);
         }
     }
+    mat_mul_end(dsp);
+#endif
 }
 
 /**
@@ -243,18 +745,21 @@ void single_qubit_op(const Complex op[2][2], int k, Complex state[]) {
  * the kth bit from zero to one.
  * 
  */
-void single_qubit_op_new(const Complex op[2][2], int k, Complex state[]) {
-	int bit = (1 << k); // The bit position corresponding to the kth qubit
-	int high_incr = (bit << 1); 
-	// Increment through the indices above bit
-	for(int i=0; i<STATE_LENGTH; i+=high_incr) {
-		// Increment through the indices less than bit
-		for(int j=0; j<bit; j++) {
-			// 2x2 matrix multiplication on the zero (i+j)
-			// and one (i+j+bit) indices
-			mat_mul(op, state, i+j, i+j+bit);
-		}
-	}
+void single_qubit_op_new(const Complex op[2][2], int k, StateVector * state) {
+    state->changes++;
+    size_t bit = ((size_t)1 << k); // The bit position corresponding to the kth qubit
+    size_t high_incr = (bit << 1); 
+    unsigned int dsp = mat_mul_begin();
+    // Increment through the indices above bit
+    for(size_t i=0; i<state->length; i+=high_incr) {
+        // Increment through the indices less than bit
+        for(size_t j=0; j<bit; j++) {
+            // 2x2 matrix multiplication on the zero (i+j)
+            // and one (i+j+bit) indices
+            mat_mul(op, state, i+j, i+j+bit);
+        }
+    }
+    mat_mul_end(dsp);
 }
 
 
@@ -267,44 +772,598 @@ void single_qubit_op_new(const Complex op[2][2], int k, Complex state[]) {
  * 
  * This function is implemented similarly to the single qubit case above.
  * Now there are three ranges of indices to increment through, separated by
- * the two qubit indices. 
+ * the two qubit indices. Only the indices with a zero in both the ctrl and
+ * targ positions are generated, and the ctrl bit is then added on, so only
+ * the quarter of the state where the ctrl qubit is ONE is visited and there
+ * is no test on the ctrl bit.
+ * 
+ * On the host the pairs are numbered and handed to the vectorised kernel in
+ * simd.c instead (see simd_controlled_op), split across threads for large
+ * states.
  * 
  */
-void controlled_qubit_op_new(const Complex op[2][2], int ctrl, int targ, Complex state[]) {
-    int small_bit, large_bit;
+#ifndef __XC16__
+/// The arguments of controlled_qubit_op, for the parallel blocks
+typedef struct {
+    const Complex (*op)[2];
+    int targ;
+    size_t ctrl_mask;
+    StateVector * state;
+} ControlledJob;
+
+static void controlled_block(void * ctx, size_t begin, size_t end) {
+    ControlledJob * job = ctx;
+    simd_controlled_op(job->op, job->targ, job->ctrl_mask, job->state, begin, end);
+}
+#endif
+
+int controlled_qubit_op(const Complex op[2][2], int ctrl, int targ, StateVector * state) {
+    if (ctrl < 0 || ctrl >= state->num_qubits) return -1;
+    if (targ < 0 || targ >= state->num_qubits || ctrl == targ) return -1;
+    state->changes++;
+    if (state->renormalise) {
+        tracked_op(op, (size_t)1 << ctrl, targ, state);
+        return 0;
+    }
+#ifndef __XC16__
+    ControlledJob job = {op, targ, (size_t)1 << ctrl, state};
+    parallel_range(state->length, state->length >> 2, controlled_block, &job);
+#else
+    size_t small_bit, large_bit;
     if(ctrl > targ) {
-        small_bit = (1 << targ);
-        large_bit = (1 << ctrl);
+        small_bit = ((size_t)1 << targ);
+        large_bit = ((size_t)1 << ctrl);
     } else {
-        small_bit = (1 << ctrl);
-        large_bit = (1 << targ);
+        small_bit = ((size_t)1 << ctrl);
+        large_bit = ((size_t)1 << targ);
     }
-    int mid_incr = (small_bit << 1);
-    int high_incr = (large_bit << 1);
-    int targ_bit = (1 << targ);
+    size_t mid_incr = (small_bit << 1);
+    size_t high_incr = (large_bit << 1);
+    size_t targ_bit = ((size_t)1 << targ);
+    size_t ctrl_bit = ((size_t)1 << ctrl);
+    PairOp pair = pair_op(classify_gate(op)); // mat_mul or a faster one
+    unsigned int dsp = mat_mul_begin();
 
 	// Increment through the indices above largest bit (ctrl or targ)
-	for(int i=0; i<STATE_LENGTH; i+=high_incr) {
+	for(size_t i=0; i<state->length; i+=high_incr) {
 		// Increment through the middle set of bits
-		for(int j=0; j<large_bit; j+=mid_incr) {
+		for(size_t j=0; j<large_bit; j+=mid_incr) {
             // Increment through the low set of bits
-            for(int k=0; j<small_bit; j++) {
-                // 2x2 matrix multiplication on the zero (i+j+k)
-                // and one (i+j+k+targ_bit) indices. 
-                mat_mul(op, state, i+j+k, i+j+k+targ_bit);
+            for(size_t k=0; k<small_bit; k++) {
+                // 2x2 matrix multiplication on the zero (i+j+k+ctrl_bit)
+                // and one (i+j+k+ctrl_bit+targ_bit) indices. 
+                size_t zero = i + j + k + ctrl_bit;
+                pair(op, state, zero, zero + targ_bit);
             }
 		}
 	}
+    mat_mul_end(dsp);
+#endif
+    return 0;
+}
+
+/**
+ * @param x The number to spread out
+ * @param mask The positions of the zero bits in the result
+ * @return x with its bits moved up past the positions in mask
+ */
+size_t insert_zeros(size_t x, size_t mask) {
+    while (mask != 0) {
+        size_t low = mask & (~mask + 1); // The lowest position left
+        x = ((x & ~(low - 1)) << 1) | (x & (low - 1));
+        mask &= mask - 1;
+    }
+    return x;
+}
+
+/**
+ * @brief Multi-controlled qubit operation
+ * @param op the operation (ctrl-op is performed)
+ * @param ctrl_mask the ctrl qubits, one bit each
+ * @param targ the index of the targ qubit
+ * @param state the state vector
+ * @return 0 if successful, -1 if the qubits are not valid
+ * 
+ * The ZERO indices are the indices with the targ bit clear and every ctrl
+ * bit set. The bits which are free to change are 
+ * 
+ *      free = (length - 1) & ~(ctrl_mask | targ_bit)
+ * 
+ * and the ZERO indices are ctrl_mask plus every subset of free. The subsets
+ * are generated in increasing order with
+ * 
+ *      next = ((x | ~free) + 1) & free
+ * 
+ * which carries straight over the fixed bits, so there are no tests on the
+ * ctrl bits. On the host the pairs are handed to the vectorised kernel 
+ * instead, like controlled_qubit_op.
+ * 
+ */
+int multi_controlled_qubit_op(const Complex op[2][2], size_t ctrl_mask, 
+        int targ, StateVector * state) {
+    if (targ < 0 || targ >= state->num_qubits) return -1;
+    size_t targ_bit = (size_t)1 << targ;
+    if ((ctrl_mask & targ_bit) || (ctrl_mask >> state->num_qubits)) return -1;
+    /// Count the ctrl qubits
+    int c = 0;
+    for (size_t m = ctrl_mask; m != 0; m &= m - 1) c++;
+    size_t pairs = state->length >> (c + 1);
+    state->changes++;
+    if (state->renormalise) {
+        tracked_op(op, ctrl_mask, targ, state);
+        return 0;
+    }
+#ifndef __XC16__
+    ControlledJob job = {op, targ, ctrl_mask, state};
+    parallel_range(state->length, pairs, controlled_block, &job);
+#else
+    PairOp pair = pair_op(classify_gate(op)); // mat_mul or a faster one
+    size_t free = (state->length - 1) & ~(ctrl_mask | targ_bit);
+    size_t x = 0;
+    unsigned int dsp = mat_mul_begin();
+    for (size_t q = 0; q < pairs; q++) {
+        size_t zero = x | ctrl_mask;
+        pair(op, state, zero, zero + targ_bit);
+        x = ((x | ~free) + 1) & free;
+    }
+    mat_mul_end(dsp);
+#endif
+    return 0;
+}
+
+int gate_job_init(GateJob * job, const Complex op[2][2], size_t ctrl_mask,
+        int targ, StateVector * state) {
+    if (targ < 0 || targ >= state->num_qubits) return -1;
+    if (((ctrl_mask >> targ) & 1) || (ctrl_mask >> state->num_qubits)) return -1;
+    int c = 0;
+    for (size_t m = ctrl_mask; m != 0; m &= m - 1) c++;
+    /// Like tracked_op, a single qubit gate also corrects the norm
+    job->tracked = state->renormalise;
+    if (!job->tracked || ctrl_mask != 0 
+            || renormalise_gate(op, state->norm, job->op) != 0) {
+        for (int r = 0; r < 2; r++) {
+            for (int col = 0; col < 2; col++) {
+                job->op[r][col][0] = op[r][col][0];
+                job->op[r][col][1] = op[r][col][1];
+            }
+        }
+    }
+    job->ctrl_mask = ctrl_mask;
+    job->targ = targ;
+    job->state = state;
+    job->pairs = state->length >> (c + 1);
+    job->next = 0;
+    job->change = 0;
+    return 0;
+}
+
+int gate_job_step(GateJob * job, size_t max_pairs) {
+    size_t begin = job->next;
+    if (begin == job->pairs) return 0; // Already finished
+    size_t end = (job->pairs - begin > max_pairs) ? begin + max_pairs : job->pairs;
+    job->state->changes++;
+    if (job->tracked) {
+        TrackedJob t = {job->op, job->targ, job->ctrl_mask, job->state, 0};
+        tracked_block(&t, begin, end);
+        job->change += t.change;
+    } else {
+#ifndef __XC16__
+        simd_controlled_op(job->op, job->targ, job->ctrl_mask, job->state, 
+                begin, end);
+#else
+        size_t targ_bit = (size_t)1 << job->targ;
+        PairOp pair = pair_op(classify_gate(job->op));
+        size_t free = (job->state->length - 1) & ~(job->ctrl_mask | targ_bit);
+        size_t x = insert_zeros(begin, job->ctrl_mask | targ_bit);
+        unsigned int dsp = mat_mul_begin();
+        for (size_t q = begin; q < end; q++) {
+            size_t zero = x | job->ctrl_mask;
+            pair(job->op, job->state, zero, zero + targ_bit);
+            x = ((x | ~free) + 1) & free;
+        }
+        mat_mul_end(dsp);
+#endif
+    }
+    job->next = end;
+    if (end < job->pairs) return 1;
+    if (job->tracked) job->state->norm += job->change;
+    return 0;
+}
+
+/// The arguments of swap_qubits, for the parallel blocks
+typedef struct {
+    size_t bit1; ///< The bit which is ONE in the first index of each pair
+    size_t bit2; ///< The bit which is ONE in the second index
+    StateVector * state;
+} SwapJob;
+
+/// Swap the pairs [begin, end), numbered like multi_controlled_qubit_op
+static void swap_block(void * ctx, size_t begin, size_t end) {
+    SwapJob * job = ctx;
+    size_t both = job->bit1 | job->bit2;
+    size_t free = (job->state->length - 1) & ~both;
+    size_t x = insert_zeros(begin, both);
+    for (size_t q = begin; q < end; q++) {
+        size_t i = x | job->bit1;
+        swap_mul(X, job->state, i, i ^ both);
+        x = ((x | ~free) + 1) & free;
+    }
+}
+
+/**
+ * @param q1 The first qubit
+ * @param q2 The second qubit
+ * @param state The state vector
+ * @return 0 if successful, -1 if the qubits are not valid
+ * 
+ * Swapping two qubits exchanges the amplitudes of each index with q1 = ONE
+ * and q2 = ZERO with the index where q1 and q2 are the other way round.
+ * Those indices are generated like the ZERO indices in 
+ * multi_controlled_qubit_op, so the state is visited in one pass which
+ * moves half of the amplitudes and does no arithmetic.
+ */
+int swap_qubits(int q1, int q2, StateVector * state) {
+    if (q1 < 0 || q1 >= state->num_qubits) return -1;
+    if (q2 < 0 || q2 >= state->num_qubits) return -1;
+    if (q1 == q2) return 0;
+    state->changes++;
+    SwapJob job = {(size_t)1 << q1, (size_t)1 << q2, state};
+#ifndef __XC16__
+    parallel_range(state->length, state->length >> 2, swap_block, &job);
+#else
+    swap_block(&job, 0, state->length >> 2);
+#endif
+    return 0;
+}
+
+/// @brief Empty measurements of num_qubits qubits (if m is not NULL)
+static void measure_clear(Marginals * m, int num_qubits, 
+        const StateVector * state) {
+    if (m == NULL) return;
+    if (num_qubits > MEASURE_QUBITS) num_qubits = MEASURE_QUBITS;
+    if (num_qubits > state->num_qubits) num_qubits = state->num_qubits;
+    if (num_qubits < 0) num_qubits = 0;
+    m->num_qubits = num_qubits;
+    for (int k = 0; k < num_qubits; k++) {
+        m->zero[k] = 0;
+        m->one[k] = 0;
+        m->phase[k] = 0;
+    }
+}
+
+#ifdef __XC16__
+/**
+ * @brief Add one group of 2^m->num_qubits amplitudes to the measurements
+ * 
+ * The measured qubits are the lowest bits of the index, so a group starting
+ * at base holds every pair for every measured qubit. Only the amplitudes 
+ * with the low_ctrl bits set are counted. A pair has a phase difference if
+ * the real or imaginary parts have opposite signs. The |a|^2 sums are left
+ * out unless sums is set.
+ */
+static void measure_group(const StateVector * state, size_t base,
+        size_t low_ctrl, bool sums, Marginals * m) {
+    size_t group = (size_t)1 << m->num_qubits;
+    const Q15 limit = -0.01; // Products below this are a sign change
+    /// Copy the group, and |a|^2 (zero without the ctrl bits)
+    Q15 re[1 << MEASURE_QUBITS], im[1 << MEASURE_QUBITS], p[1 << MEASURE_QUBITS];
+    int in[1 << MEASURE_QUBITS];
+    for (size_t l = 0; l < group; l++) {
+        re[l] = AMP_RE(state, base + l);
+        im[l] = AMP_IM(state, base + l);
+        in[l] = (l & low_ctrl) == low_ctrl;
+        p[l] = (in[l] && sums) ? re[l] * re[l] + im[l] * im[l] : 0;
+    }
+    for (int k = 0; k < m->num_qubits; k++) {
+        size_t bit = (size_t)1 << k;
+        Q15 zero = 0, one = 0;
+        long phase = 0;
+        /// The pairs (l, l + bit), in runs of bit. A pair is counted if 
+        /// its ONE end has the ctrl bits set
+        for (size_t run = 0; run < group; run += 2 * bit) {
+            for (size_t l = run; l < run + bit; l++) {
+                zero += p[l];
+                one += p[l + bit];
+                phase += in[l + bit] & ((re[l] * re[l + bit] < limit) 
+                        | (im[l] * im[l + bit] < limit));
+            }
+        }
+        m->zero[k] += zero;
+        m->one[k] += one;
+        m->phase[k] += phase;
+    }
+}
+
+/// @brief Measure the groups in a block of amplitudes which have the 
+/// ctrl bits set (the sums only if sums is set)
+static void measure_block(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+    size_t group = (size_t)1 << m->num_qubits;
+    size_t mid_ctrl = ctrl_mask & (block - 1) & ~(group - 1);
+    for (size_t g = 0; g < block; g += group) {
+        if ((g & mid_ctrl) != mid_ctrl) continue;
+        measure_group(state, base + g, ctrl_mask & (group - 1), sums, m);
+    }
+}
+
+/// @brief The size of the blocks measured at a time (a group)
+static int measure_block_qubits(const StateVector * state, const Marginals * m) {
+    (void)state;
+    return m->num_qubits;
+}
+#else
+
+/// @brief Add a block of amplitudes to the measurements (vectorised, see
+/// simd_measure_block)
+static void measure_block(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+    simd_measure_block(state, base, block, ctrl_mask, sums, m);
+}
+
+/// @brief The size of the blocks measured at a time
+static int measure_block_qubits(const StateVector * state, const Marginals * m) {
+    (void)m;
+    return (state->num_qubits < MEASURE_BLOCK_QUBITS) ? state->num_qubits 
+            : MEASURE_BLOCK_QUBITS;
+}
+#endif
+
+/**
+ * The blocks (see measure_block) with the higher ctrl bits set are 
+ * generated like the ZERO indices in multi_controlled_qubit_op.
+ */
+void measure_state(const StateVector * state, size_t ctrl_mask,
+        int num_qubits, Marginals * m) {
+    measure_clear(m, num_qubits, state);
+    size_t block = (size_t)1 << measure_block_qubits(state, m);
+    size_t free = (state->length - 1) & ~ctrl_mask & ~(block - 1);
+    size_t x = 0;
+    do {
+        measure_block(state, x | (ctrl_mask & ~(block - 1)), block, 
+                ctrl_mask, true, m);
+        x = ((x | ~free) + 1) & free;
+    } while (x != 0);
+}
+
+void measure_job_init(MeasureJob * job, const StateVector * state,
+        int num_qubits, Marginals * m) {
+    measure_clear(m, num_qubits, state);
+    job->state = state;
+    job->m = m;
+    job->next = 0;
+}
+
+/// The slices are whole groups of 2^num_qubits, measured at most a block
+/// at a time (see measure_block)
+int measure_job_step(MeasureJob * job, size_t max_amps) {
+    size_t group = (size_t)1 << job->m->num_qubits;
+    size_t block = (size_t)1 << measure_block_qubits(job->state, job->m);
+    size_t length = job->state->length;
+    size_t end = job->next + ((max_amps > group) ? max_amps : group);
+    end = (end + group - 1) & ~(group - 1);
+    if (end > length || end < job->next) end = length;
+    while (job->next < end) {
+        size_t n = (end - job->next < block) ? end - job->next : block;
+        measure_block(job->state, job->next, n, 0, true, job->m);
+        job->next += n;
+    }
+    return job->next < length;
+}
+
+/// @brief Add one set of measurements to another (if m is not NULL)
+static void measure_add(Marginals * m, const Marginals * part) {
+    if (m == NULL) return;
+    for (int k = 0; k < m->num_qubits; k++) {
+        m->zero[k] += part->zero[k];
+        m->one[k] += part->one[k];
+        m->phase[k] += part->phase[k];
+    }
+}
+
+/// @brief The size of the blocks measure_qubit_op goes over at a time 
+/// (2^num_qubits is a group)
+static int measure_op_block_qubits(const StateVector * state, int num_qubits) {
+#ifndef __XC16__
+    (void)num_qubits; // The same blocks as measure_state
+    return (state->num_qubits < MEASURE_BLOCK_QUBITS) ? state->num_qubits 
+            : MEASURE_BLOCK_QUBITS;
+#else
+    if (num_qubits > MEASURE_QUBITS) num_qubits = MEASURE_QUBITS;
+    if (num_qubits > state->num_qubits) num_qubits = state->num_qubits;
+    if (num_qubits < 0) num_qubits = 0;
+    return num_qubits;
+#endif
+}
+
+/// @brief The number of blocks of 2^b amplitudes which measure_qubit_op 
+/// visits: one for each setting of the free bits above the block
+static size_t measure_op_blocks(size_t ctrl_mask, int targ, 
+        const StateVector * state, int b) {
+    size_t blocks = state->length >> b;
+    size_t fixed = ctrl_mask | ((size_t)1 << targ);
+    for (size_t m = fixed >> b; m != 0; m &= m - 1) blocks >>= 1;
+    return blocks;
+}
+
+size_t measure_op_length(size_t ctrl_mask, int targ, 
+        const StateVector * state, int num_qubits) {
+    int b = measure_op_block_qubits(state, num_qubits);
+    /// The pairs are between two blocks if targ is above them
+    int ends = (targ >= b) ? 2 : 1;
+    return measure_op_blocks(ctrl_mask, targ, state, b) * ends << b;
+}
+
+/// The arguments of measure_op_block, for the parallel blocks
+typedef struct {
+    const Complex (*op)[2];
+    size_t ctrl_mask;
+    int targ;
+    StateVector * state;
+    int block_qubits; ///< The blocks are 2^block_qubits amplitudes
+    bool sums; ///< Whether to work out the |a|^2 sums
+    Marginals * before; ///< The measurements before the gate (or NULL)
+    Marginals * after; ///< The measurements after the gate (or NULL)
+} MeasureOpJob;
+
+#ifndef __XC16__
+/// The bytes the cache is filled in
+#define CACHE_LINE 64
+
+/// @brief Start bringing a block of amplitudes into the cache (to be 
+/// written), while the one before it is still being worked on
+static void prefetch_block(const StateVector * state, size_t base, 
+        size_t block) {
+#ifdef STATE_SOA
+    const char * re = (const char *)&state->re[base];
+    const char * im = (const char *)&state->im[base];
+    for (size_t k = 0; k < block * sizeof(Q15); k += CACHE_LINE) {
+        __builtin_prefetch(re + k, 1);
+        __builtin_prefetch(im + k, 1);
+    }
+#else
+    const char * amp = (const char *)state->amp[base];
+    for (size_t k = 0; k < block * sizeof(Complex); k += CACHE_LINE) {
+        __builtin_prefetch(amp + k, 1);
+    }
+#endif
+}
+#endif
+
+/**
+ * @brief Measure, apply the gate and measure again the blocks [begin, end)
+ * 
+ * The blocks are numbered like the pairs in multi_controlled_qubit_op, 
+ * with the bits below the block and the fixed bits left out. The sums are
+ * kept locally and added to the job's at the end, so that each thread 
+ * only touches the shared measurements once.
+ */
+static void measure_op_block(void * ctx, size_t begin, size_t end) {
+    MeasureOpJob * job = ctx;
+    StateVector * state = job->state;
+    size_t ctrl_mask = job->ctrl_mask;
+    size_t targ_bit = (size_t)1 << job->targ;
+    size_t block = (size_t)1 << job->block_qubits;
+    size_t fixed = ctrl_mask | targ_bit;
+    /// Whether the pairs are inside a block or between two of them
+    bool inside = targ_bit < block;
+    size_t free = (state->length - 1) & ~(block - 1) & ~fixed;
+    Marginals before, after;
+    Marginals * b = (job->before != NULL) ? &before : NULL;
+    Marginals * a = (job->after != NULL) ? &after : NULL;
+    int num_qubits = (b != NULL) ? job->before->num_qubits 
+            : (a != NULL) ? job->after->num_qubits : 0;
+    measure_clear(b, num_qubits, state);
+    measure_clear(a, num_qubits, state);
+#ifdef __XC16__
+    PairOp pair = pair_op(classify_gate(job->op)); // mat_mul or a faster one
+#endif
+    size_t x = insert_zeros(begin, (block - 1) | fixed);
+#ifndef __XC16__
+    size_t count = block; // The pairs in each block
+    for (size_t m = fixed & (block - 1); m != 0; m &= m - 1) count >>= 1;
+#endif
+    for (size_t q = begin; q < end; q++) {
+        size_t base = x | (ctrl_mask & ~(block - 1));
+        if (b != NULL) {
+            measure_block(state, base, block, ctrl_mask, job->sums, b);
+            if (!inside) {
+                measure_block(state, base + targ_bit, block, ctrl_mask, 
+                        job->sums, b);
+            }
+        }
+#ifndef __XC16__
+        /// The pairs with their ZERO index in the block are the qth run of
+        /// pair numbers (see simd_controlled_op)
+        size_t first = q * count;
+        if (ctrl_mask == 0) simd_single_qubit_op(job->op, job->targ, state, first, first + count);
+        else simd_controlled_op(job->op, job->targ, ctrl_mask, state, first, first + count);
+#else
+        size_t low_ctrl = ctrl_mask & (block - 1);
+        for (size_t l = 0; l < block; l++) {
+            if ((l & low_ctrl) != low_ctrl || (l & targ_bit)) continue;
+            pair(job->op, state, base + l, base + l + targ_bit);
+        }
+#endif
+        x = ((x | ~free) + 1) & free;
+#ifndef __XC16__
+        /// The next blocks come in while these are measured
+        if (q + 1 < end) {
+            size_t next = x | (ctrl_mask & ~(block - 1));
+            prefetch_block(state, next, block);
+            if (!inside) prefetch_block(state, next + targ_bit, block);
+        }
+#endif
+        if (a != NULL) {
+            measure_block(state, base, block, ctrl_mask, job->sums, a);
+            if (!inside) {
+                measure_block(state, base + targ_bit, block, ctrl_mask, 
+                        job->sums, a);
+            }
+        }
+    }
+#ifdef _OPENMP
+    #pragma omp critical
+#endif
+    {
+        measure_add(job->before, &before);
+        measure_add(job->after, &after);
+    }
+}
+
+/**
+ * The state is gone over a block at a time, or two blocks at a time if the
+ * targ qubit is above the block (the pairs are then between the blocks).
+ * Each block is measured (see measure_block), the gate is applied to its 
+ * pairs, and it is measured again while it is still in cache. So the 
+ * state is read and written once, instead of once for the gate and again
+ * for each measurement.
+ * 
+ * On the host the blocks are 2^MEASURE_BLOCK_QUBITS amplitudes, the pairs
+ * in them are handed to the vectorised kernels, and large states are split
+ * into one run of blocks per thread like the gates (see parallel.h). On 
+ * the dsPIC a block is a group, and the pairs are done with mat_mul (or 
+ * the faster pair op for the kind of gate).
+ */
+int measure_qubit_op(const Complex op[2][2], size_t ctrl_mask, int targ,
+        StateVector * state, int num_qubits, bool sums, Marginals * before, 
+        Marginals * after) {
+    if (targ < 0 || targ >= state->num_qubits) return -1;
+    size_t targ_bit = (size_t)1 << targ;
+    if ((ctrl_mask & targ_bit) || (ctrl_mask >> state->num_qubits)) return -1;
+    if (state->renormalise) {
+        /// The norm is tracked by the usual kernel
+        if (before != NULL) measure_state(state, ctrl_mask, num_qubits, before);
+        multi_controlled_qubit_op(op, ctrl_mask, targ, state);
+        if (after != NULL) measure_state(state, ctrl_mask, num_qubits, after);
+        return 0;
+    }
+    state->changes++;
+    measure_clear(before, num_qubits, state);
+    measure_clear(after, num_qubits, state);
+    int b = measure_op_block_qubits(state, num_qubits);
+    MeasureOpJob job = {op, ctrl_mask, targ, state, b, sums, before, after};
+    size_t blocks = measure_op_blocks(ctrl_mask, targ, state, b);
+#ifndef __XC16__
+    parallel_range(state->length, blocks, measure_op_block, &job);
+#else
+    unsigned int dsp = mat_mul_begin();
+    measure_op_block(&job, 0, blocks);
+    mat_mul_end(dsp);
+#endif
+    return 0;
 }
 
 /// Old controlled qubit operations
-void controlled_qubit_op(const Complex op[2][2], int ctrl, int targ, Complex state[]) {
-    int root_max = pow2(targ); // Declared outside the loop
-    int increment = 2 * root_max;
+void controlled_qubit_op_old(const Complex op[2][2], int ctrl, int targ, StateVector * state) {
+    state->changes++;
+    unsigned int dsp = mat_mul_begin();
+    size_t root_max = (size_t)1 << targ; // Declared outside the loop
+    size_t increment = 2 * root_max;
+    size_t ctrl_bit = (size_t)1 << ctrl;
     /// ROOT loop: starts at 0, increases in steps of 1
-    for (int root = 0; root < root_max; root++) {
+    for (size_t root = 0; root < root_max; root++) {
         /// STEP loop: starts at 0, increases in steps of 2^(k+1)
-        for (int step = 0; step < STATE_LENGTH; step += increment) {
+        for (size_t step = 0; step < state->length; step += increment) {
             /// First index is ZERO, second index is ONE
             /// @note for 2 qubit case check if the index in the ctrl qubit 
             /// is a 1 then apply the 2x2 unitary else do nothing
@@ -320,13 +1379,14 @@ void controlled_qubit_op(const Complex op[2][2], int ctrl, int targ, Complex sta
             /// @todo This expression can probably be simplified or broken over lines.
             /// The condition for the if statement is that root+step and
             /// root + step + root_max contain 1 in the ctrl-th bit. 
-            if( (((root+step) & (1 << ctrl)) && 
+            if( (((root+step) & ctrl_bit) && 
                     
-                    ((root+step+root_max) & (1 << ctrl))) == 1){
+                    ((root+step+root_max) & ctrl_bit)) == 1){
                 mat_mul(op, state, root + step, root + root_max + step);
             }
         }
     }
+    mat_mul_end(dsp);
 }
 
 
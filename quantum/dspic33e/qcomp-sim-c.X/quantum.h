@@ -17,42 +17,397 @@ extern "C" {
 
 
 #include <math.h>
+#include <stddef.h>
 #include "consts.h" 
 
     /// Basis states
     typedef enum {ZERO, ONE, PLUS, MINUS, iPLUS, iMINUS} State;
 
+    /// The type sums of |a|^2 are kept in. On the dsPIC it is the 40 bit
+    /// accumulator type (float is done in software), which a Q15 square 
+    /// fits exactly. On the host it is the amplitude type, so the sums 
+    /// keep the precision of AMP_Q31
+#ifdef __XC16__
+    typedef _Accum NormSum;
+#else
+    typedef Q15 NormSum;
+#endif
+
+    /**
+     * @brief A state vector which carries its own size
+     * 
+     * The state vector has length 2^num_qubits. Indices into the state 
+     * vector are size_t so that the host build can go past 2^15 amplitudes.
+     * 
+     * There are two memory layouts, chosen at build time:
+     * 
+     *   - Array of structures (the default): the amplitudes are stored in
+     *     the array amp, with the real and imaginary parts interleaved.
+     *   - Structure of arrays (define STATE_SOA): the real parts are stored
+     *     in the array re and the imaginary parts in the array im.
+     * 
+     * Code outside the gate kernels should read and write amplitudes with 
+     * AMP_RE and AMP_IM so that it works with both layouts.
+     */
+    typedef struct {
+        int num_qubits; ///< The number of qubits (1 to MAX_QUBITS)
+        size_t length; ///< The number of amplitudes, 2^num_qubits
+#ifdef STATE_SOA
+        Q15 * re; ///< The real parts of the amplitudes
+        Q15 * im; ///< The imaginary parts of the amplitudes
+#else
+        Complex * amp; ///< The amplitudes
+#endif
+        NormSum norm; ///< The running norm (see state_renormalise)
+        bool renormalise; ///< Set to track and correct the norm
+        unsigned long changes; ///< Counts the changes to the amplitudes
+    } StateVector;
+
+#ifdef STATE_SOA
+/// The real part of the ith amplitude (can be assigned to)
+#define AMP_RE(state, i) ((state)->re[i])
+/// The imaginary part of the ith amplitude (can be assigned to)
+#define AMP_IM(state, i) ((state)->im[i])
+#else
+/// The real part of the ith amplitude (can be assigned to)
+#define AMP_RE(state, i) ((state)->amp[i][0])
+/// The imaginary part of the ith amplitude (can be assigned to)
+#define AMP_IM(state, i) ((state)->amp[i][1])
+#endif
+
+    /**
+     * @brief Make a state vector using existing storage
+     * @param state The state vector to set up
+     * @param num_qubits The number of qubits
+     * @param storage An array of at least 2^num_qubits amplitudes
+     * @return 0 if successful, -1 otherwise
+     * 
+     * Use this on the microcontroller, where the storage is a static array.
+     * The amplitudes are not initialised -- call zero_state afterwards.
+     * With STATE_SOA the same storage is split in half: the first 
+     * 2^num_qubits numbers are the real parts and the rest are the 
+     * imaginary parts.
+     */
+    int state_init(StateVector * state, int num_qubits, Complex storage[]);
+
+    /**
+     * @brief Make a state vector on the heap
+     * @param state The state vector to set up
+     * @param num_qubits The number of qubits
+     * @return 0 if successful, -1 otherwise
+     * 
+     * The state is initialised to the vacuum. Free it with state_free.
+     */
+    int state_alloc(StateVector * state, int num_qubits);
+
+    /// @brief Free a state vector made with state_alloc
+    void state_free(StateVector * state);
+
+    /// The norm that state_renormalise aims for (the norm of the vacuum)
+#define NORM_TARGET ((NormSum)ONE_Q15 * (NormSum)ONE_Q15)
+
+    /// @brief The norm of the state, sum |a_i|^2 (one pass over the state)
+    float state_norm(const StateVector * state);
+
+    /**
+     * @brief Turn the renormalisation mode on or off
+     * @param state The state vector
+     * @param on true to track and correct the norm
+     * 
+     * The rounding in the gates (e.g. H is 0.70709 in Q15) makes the norm
+     * drift. In this mode every gate also adds up |a|^2 over the pairs it
+     * changes, before and after, a block at a time while the block is
+     * still in cache, and keeps the running norm in state->norm. The next
+     * single qubit gate (which touches every amplitude) has its matrix 
+     * scaled by about sqrt(NORM_TARGET/norm) (see norm_correction), so the
+     * state is put back without a separate normalisation pass. If the 
+     * scaled matrix does not fit in the fractional type, the correction 
+     * waits for a later gate.
+     * 
+     * Turning the mode on measures the norm once with state_norm.
+     */
+    void state_renormalise(StateVector * state, bool on);
+
+    /**
+     * @brief The factor state_renormalise scales a gate by
+     * @param norm The running norm
+     * @return About sqrt(NORM_TARGET/norm), or exactly 1 if the correction
+     * is too small to be worth making
+     * 
+     * It is worked out in the accumulator type (_Accum on the dsPIC) from
+     * a series in norm - NORM_TARGET, with no square root. That is exact 
+     * to the resolution of the amplitudes for the drift of a few gates, 
+     * and a larger drift is put back over several gates.
+     */
+    NormSum norm_correction(NormSum norm);
+
     /// Initialise state to the vacuum (zero apart from the first position)
-    /// Specify the dimension -- of the matrix, i.e. 2^(number of qubits)
     /// @param state complex state vector 
-    void zero_state(Complex state[]);
+    void zero_state(StateVector * state);
 
     /// returns phase quadrant 
     int sign(Complex a);
 
+    /**
+     * @brief 2x2 complex matrix product C = AB
+     * @param A The left matrix (the gate applied second)
+     * @param B The right matrix (the gate applied first)
+     * @param C The result (must not be A or B)
+     */
+    void mat_mat_mul(const Complex A[2][2], const Complex B[2][2], Complex C[2][2]);
+
+    /// @brief The kinds of 2x2 matrix which have a faster kernel than mat_mul
+    typedef enum {
+        GATE_GENERAL, ///< Anything else (mat_mul)
+        GATE_IDENTITY, ///< Nothing to do
+        GATE_DIAGONAL, ///< Both amplitudes are multiplied by a number
+        GATE_PHASE, ///< Only the ONE amplitude is multiplied (e.g. S, T)
+        GATE_SIGN, ///< The ONE amplitude changes sign (Z)
+        GATE_SWAP, ///< The ZERO and ONE amplitudes are swapped (X)
+        GATE_ANTIDIAGONAL, ///< Swapped and multiplied (Y)
+    } GateKind;
+
+    /// @brief Work out which kind of matrix a gate is
+    GateKind classify_gate(const Complex op[2][2]);
+
+    /// @brief A function which applies a 2x2 matrix to the pair (i, j)
+    typedef void (*PairOp)(const Complex M[2][2], StateVector * state, 
+            size_t i, size_t j);
+
+    /// @brief The pair function for a kind of matrix (mat_mul for
+    /// GATE_GENERAL). The gate kernels use this to skip the arithmetic
+    /// that is not needed
+    PairOp pair_op(GateKind kind);
+
     /// 2x2 complex matrix multiplication
     /// @param M complex matrix
-    /// @param V complex vector
+    /// @param state state vector
     /// @param i integer first element of state vector
     /// @param j integer second element of state vector
     /// @todo Because of the way the array types work (you can't pass a 
     /// multidimensional array of unknown size) we will also need a function
     /// for 4x4 matrix multiplication.
-    void mat_mul(const Complex M[2][2], Complex V[], int i, int j);
+    /// @note On the dsPIC it needs the DSP engine set up by mat_mul_begin,
+    /// which the gate functions do once for a whole gate
+    void mat_mul(const Complex M[2][2], StateVector * state, size_t i, size_t j);
+
+    /// @brief Set up the DSP engine for mat_mul (nothing on the host)
+    /// @return The old setting, for mat_mul_end
+    unsigned int mat_mul_begin(void);
+
+    /// @brief Put the DSP engine back as it was before mat_mul_begin
+    /// @param saved What mat_mul_begin returned
+    void mat_mul_end(unsigned int saved);
+
+    /// @brief The old 2x2 complex matrix multiplication. Kept as a reference
+    /// for the benchmarks
+    void mat_mul_old(const Complex M[2][2], StateVector * state, size_t i, size_t j);
 
      /** apply operator
      * @param state state vector containing amplitudes 
      * @param qubit qubit number to apply 2x2 matrix to
      * @param op 2x2 operator to be applied
      */
-    void single_qubit_op(const Complex op[2][2], int qubit, Complex state[]);
+    void single_qubit_op(const Complex op[2][2], int qubit, StateVector * state);
+
+    /// @brief The serial single qubit op with mat_mul on every pair. Kept as
+    /// a reference for the benchmarks
+    void single_qubit_op_new(const Complex op[2][2], int k, StateVector * state);
     
     /// apply controlled 2x2 op
     /// @param op single qubit unitary 2x2
     /// @param ctrl control qubit number (0,1,..,n-1)
     /// @param targ target qubit number (0,1,...,n-1)
     /// @param state complex state vector
-    void controlled_qubit_op(const Complex op[2][2], int ctrl, int targ, Complex state[]);
+    /// @return 0 if successful, -1 if the qubits are not valid (as for 
+    /// multi_controlled_qubit_op, ctrl and targ must differ)
+    int controlled_qubit_op(const Complex op[2][2], int ctrl, int targ, StateVector * state);
+
+    /**
+     * @brief Apply a 2x2 op to the targ qubit if all the ctrl qubits are ONE
+     * @param op single qubit unitary 2x2
+     * @param ctrl_mask the control qubits, with bit n set for qubit n
+     * @param targ target qubit number (0,1,...,n-1)
+     * @param state complex state vector
+     * @return 0 if successful, -1 if the qubits are not valid
+     * 
+     * A Toffoli gate is an X with two bits set in ctrl_mask, and a 
+     * ctrl_mask of zero is a single qubit gate. The state is visited in 
+     * one pass which only touches the 2^(N-c) amplitudes with all c ctrl
+     * bits set.
+     */
+    int multi_controlled_qubit_op(const Complex op[2][2], size_t ctrl_mask, 
+            int targ, StateVector * state);
+
+    /**
+     * @brief A (multi-)controlled gate which is applied a slice at a time
+     * 
+     * The pairs are numbered like multi_controlled_qubit_op, and each call
+     * of gate_job_step does the next few, so the caller can do other work
+     * (or give up) between slices. Do not apply other gates to the state
+     * until the job is finished.
+     */
+    typedef struct {
+        Complex op[2][2]; ///< The gate (scaled to correct the norm)
+        size_t ctrl_mask; ///< The ctrl qubits, one bit each
+        int targ; ///< The targ qubit
+        StateVector * state; ///< The state vector
+        size_t pairs; ///< The number of pairs the gate changes
+        size_t next; ///< The next pair to do
+        bool tracked; ///< Whether the norm is being tracked
+        NormSum change; ///< The change in the norm so far
+    } GateJob;
+
+    /**
+     * @brief Set up a gate to be applied by gate_job_step
+     * @param job The job
+     * @param op single qubit unitary 2x2
+     * @param ctrl_mask the control qubits, with bit n set for qubit n
+     * @param targ target qubit number (0,1,...,n-1)
+     * @param state complex state vector
+     * @return 0 if successful, -1 if the qubits are not valid
+     */
+    int gate_job_init(GateJob * job, const Complex op[2][2], size_t ctrl_mask,
+            int targ, StateVector * state);
+
+    /**
+     * @brief Apply the gate to the next slice of pairs
+     * @param job The job
+     * @param max_pairs The most pairs to do
+     * @return 1 if there are pairs left, 0 if the gate is finished
+     */
+    int gate_job_step(GateJob * job, size_t max_pairs);
+
+    /**
+     * @brief Swap two qubits in one pass over the state
+     * @param q1 The first qubit
+     * @param q2 The second qubit
+     * @param state The state vector
+     * @return 0 if successful, -1 if the qubits are not valid
+     */
+    int swap_qubits(int q1, int q2, StateVector * state);
+
+/// The most qubits measure_qubit_op can measure (one for each LED)
+#define MEASURE_QUBITS LED_NUM
+
+    /**
+     * @brief The measurements of the lowest qubits of a state
+     * 
+     * Sums over a set of amplitudes: |a|^2 where each qubit is ZERO or ONE,
+     * and the number of pairs of amplitudes (differing only in the qubit)
+     * where the real or imaginary parts have opposite signs (the phase
+     * difference shown on the display)
+     */
+    typedef struct {
+        int num_qubits; ///< The number of qubits measured (0, 1, 2, ...)
+        Q15 zero[MEASURE_QUBITS]; ///< The sum of |a|^2 where qubit k is ZERO
+        Q15 one[MEASURE_QUBITS]; ///< The sum of |a|^2 where qubit k is ONE
+        long phase[MEASURE_QUBITS]; ///< The pairs with a phase difference
+    } Marginals;
+
+    /**
+     * @brief Measure the amplitudes with all the ctrl bits set
+     * @param state The state vector
+     * @param ctrl_mask The ctrl qubits (0 for the whole state)
+     * @param num_qubits The number of qubits to measure
+     * @param m The measurements
+     * 
+     * A pair is counted from its ZERO end, unless the qubit is in 
+     * ctrl_mask, in which case it is counted from its ONE end. So the
+     * pairs are the ones a gate with these ctrl qubits changes.
+     */
+    void measure_state(const StateVector * state, size_t ctrl_mask,
+            int num_qubits, Marginals * m);
+
+    /**
+     * @brief A measure_state of the whole state which is done a slice at a
+     * time
+     * 
+     * Like GateJob, each call of measure_job_step measures the next few 
+     * amplitudes, so the caller can do other work (or give up) between 
+     * slices. The measurements are only complete when it returns 0.
+     */
+    typedef struct {
+        const StateVector * state; ///< The state vector
+        Marginals * m; ///< The measurements
+        size_t next; ///< The first amplitude still to measure
+    } MeasureJob;
+
+    /**
+     * @brief Set up a measurement of the whole state
+     * @param job The job
+     * @param state The state vector
+     * @param num_qubits The number of qubits to measure
+     * @param m The measurements (cleared here)
+     */
+    void measure_job_init(MeasureJob * job, const StateVector * state,
+            int num_qubits, Marginals * m);
+
+    /**
+     * @brief Measure the next slice of amplitudes
+     * @param job The job
+     * @param max_amps The most amplitudes to measure (at least one group of
+     * 2^num_qubits is measured)
+     * @return 1 if there are amplitudes left, 0 if the measurements are done
+     */
+    int measure_job_step(MeasureJob * job, size_t max_amps);
+
+    /**
+     * @brief Apply a gate and measure the amplitudes it changes in the same
+     * pass (like multi_controlled_qubit_op then measure_state)
+     * @param op single qubit unitary 2x2
+     * @param ctrl_mask the control qubits, with bit n set for qubit n
+     * @param targ target qubit number (0,1,...,n-1)
+     * @param state complex state vector
+     * @param num_qubits The number of qubits to measure
+     * @param sums Whether to work out the |a|^2 sums (if not, only the 
+     * phase differences are counted, and zero and one should not be used)
+     * @param before The measurements before the gate (may be NULL)
+     * @param after The measurements after the gate (may be NULL)
+     * @return 0 if successful, -1 if the qubits are not valid
+     * 
+     * A gate only mixes the pairs of amplitudes which differ in targ, so 
+     * the sums of the other qubits are the same after it, and a gate which
+     * only multiplies the amplitudes (see classify_gate) changes no |a|^2 
+     * at all. The caller can then leave the sums out.
+     */
+    int measure_qubit_op(const Complex op[2][2], size_t ctrl_mask, int targ,
+            StateVector * state, int num_qubits, bool sums, Marginals * before,
+            Marginals * after);
+
+    /**
+     * @brief The number of amplitudes measure_qubit_op goes over for a gate
+     * (for each of before and after)
+     * @param ctrl_mask the control qubits, with bit n set for qubit n
+     * @param targ target qubit number (0,1,...,n-1)
+     * @param state complex state vector
+     * @param num_qubits The number of qubits to measure
+     * @return The number of amplitudes, up to state->length
+     * 
+     * The amplitudes are measured a block at a time, so only the control 
+     * qubits above the block cut down the work.
+     */
+    size_t measure_op_length(size_t ctrl_mask, int targ, 
+            const StateVector * state, int num_qubits);
+
+    /**
+     * @brief Insert zero bits into x at the positions set in mask
+     * @param x The number to spread out
+     * @param mask The positions of the zero bits in the result
+     * @return x with its bits moved up past the positions in mask
+     * 
+     * This numbers the indices which have a zero in every position in
+     * mask: the qth such index is insert_zeros(q, mask).
+     */
+    size_t insert_zeros(size_t x, size_t mask);
+
+    /// @brief The old controlled 2x2 op, which visits every pair and checks
+    /// the ctrl bit. Kept as a reference for the benchmarks
+    /// @param op single qubit unitary 2x2
+    /// @param ctrl control qubit number (0,1,..,n-1)
+    /// @param targ target qubit number (0,1,...,n-1)
+    /// @param state complex state vector
+    void controlled_qubit_op_old(const Complex op[2][2], int ctrl, int targ, StateVector * state);
     
     /// abs function
     Q15 absolute(Complex x);
@@ -74,6 +429,9 @@ extern "C" {
      * @todo Maybe we should inline this 
      */
     Q15 square_magnitude(Complex x);
+
+    /// @brief The value of |a_i|^2 for the ith amplitude of the state
+    Q15 amp_square_magnitude(const StateVector * state, size_t i);
     
 #ifdef	__cplusplus
 }
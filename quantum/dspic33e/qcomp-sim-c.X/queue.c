@@ -0,0 +1,110 @@
+/**
+ * @file queue.c
+ *
+ * @brief Description: A gate queue which fuses gates before applying them
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "queue.h"
+
+/// Copy a 2x2 matrix
+static void copy_matrix(const Complex from[2][2], Complex to[2][2]) {
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < 2; c++) {
+            to[r][c][0] = from[r][c][0];
+            to[r][c][1] = from[r][c][1];
+        }
+    }
+}
+
+/// Apply one gate from the ordered list to the state
+static void apply(GateQueue * queue, const QueuedGate * gate) {
+    if (gate->ctrl_mask == 0) {
+        single_qubit_op(gate->op, gate->targ, queue->state);
+    } else {
+        multi_controlled_qubit_op(gate->op, gate->ctrl_mask, gate->targ, 
+                queue->state);
+    }
+    queue->passes++;
+}
+
+/// Apply the ordered list to the state and empty it. The pending gates
+/// all come after the list, so they can stay where they are
+static void apply_list(GateQueue * queue) {
+    for (int n = 0; n < queue->count; n++) {
+        apply(queue, &queue->gates[n]);
+    }
+    queue->count = 0;
+}
+
+/// Add a gate to the end of the ordered list (applying the list first if 
+/// it is full)
+static void append(GateQueue * queue, const Complex op[2][2], 
+        size_t ctrl_mask, int targ) {
+    if (queue->count == QUEUE_LENGTH) apply_list(queue);
+    QueuedGate * gate = &queue->gates[queue->count++];
+    copy_matrix(op, gate->op);
+    gate->ctrl_mask = ctrl_mask;
+    gate->targ = targ;
+}
+
+/// Move the pending gates on the qubits in mask to the ordered list
+static void move_pending(GateQueue * queue, size_t mask) {
+    size_t move = queue->pending_mask & mask;
+    for (int k = 0; move != 0; k++, move >>= 1) {
+        if (move & 1) append(queue, queue->pending[k], 0, k);
+    }
+    queue->pending_mask &= ~mask;
+}
+
+void queue_init(GateQueue * queue, StateVector * state) {
+    queue->state = state;
+    queue->count = 0;
+    queue->pending_mask = 0;
+    queue->added = 0;
+    queue->passes = 0;
+}
+
+int queue_gate(GateQueue * queue, const Complex op[2][2], int targ) {
+    if (targ < 0 || targ >= queue->state->num_qubits) return -1;
+    size_t bit = (size_t)1 << targ;
+    if (queue->pending_mask & bit) {
+        /// The new gate acts after the pending one
+        Complex product[2][2];
+        mat_mat_mul(op, queue->pending[targ], product);
+        copy_matrix(product, queue->pending[targ]);
+    } else {
+        copy_matrix(op, queue->pending[targ]);
+        queue->pending_mask |= bit;
+    }
+    queue->added++;
+    return 0;
+}
+
+int queue_controlled_gate(GateQueue * queue, const Complex op[2][2],
+        size_t ctrl_mask, int targ) {
+    if (targ < 0 || targ >= queue->state->num_qubits) return -1;
+    size_t targ_bit = (size_t)1 << targ;
+    if ((ctrl_mask & targ_bit) || (ctrl_mask >> queue->state->num_qubits)) {
+        return -1;
+    }
+    if (ctrl_mask == 0) return queue_gate(queue, op, targ);
+    move_pending(queue, ctrl_mask | targ_bit);
+    QueuedGate * last = (queue->count > 0) ? &queue->gates[queue->count - 1] : NULL;
+    if (last != NULL && last->ctrl_mask == ctrl_mask && last->targ == targ) {
+        /// Same qubits as the last gate, and nothing in between on them
+        Complex product[2][2];
+        mat_mat_mul(op, last->op, product);
+        copy_matrix(product, last->op);
+    } else {
+        append(queue, op, ctrl_mask, targ);
+    }
+    queue->added++;
+    return 0;
+}
+
+void queue_flush(GateQueue * queue) {
+    move_pending(queue, queue->pending_mask);
+    apply_list(queue);
+}
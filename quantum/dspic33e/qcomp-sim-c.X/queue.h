@@ -0,0 +1,85 @@
+/**
+ * @file queue.h
+ *
+ * @brief Description: A gate queue which fuses gates before applying them
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Gates are added to the queue instead of being applied to the state
+ * straight away. Single qubit gates are multiplied into one pending 2x2
+ * matrix per qubit, so a run of gates on one qubit (e.g. H;Z;H) costs one
+ * pass over the state. Single qubit gates on different qubits commute, so
+ * gates on other qubits in between do not stop the fusion.
+ *
+ * A controlled gate has to come after the pending gates on its qubits, so
+ * those are moved into the ordered list first. Consecutive controlled
+ * gates with the same ctrl and targ qubits are fused as well. Nothing
+ * touches the state until queue_flush (or the ordered list is full).
+ */
+
+#ifndef QUEUE_H
+#define	QUEUE_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "quantum.h"
+
+/// The length of the ordered gate list
+#ifdef __XC16__
+#define QUEUE_LENGTH 16
+#else
+#define QUEUE_LENGTH 64
+#endif
+
+    /// @brief A gate in the ordered list
+    typedef struct {
+        Complex op[2][2]; ///< The (fused) matrix
+        size_t ctrl_mask; ///< The ctrl qubits (0 for a single qubit gate)
+        int targ; ///< The targ qubit
+    } QueuedGate;
+
+    /// @brief A queue of gates waiting to be applied to a state
+    typedef struct {
+        StateVector * state; ///< The state the gates are applied to
+        QueuedGate gates[QUEUE_LENGTH]; ///< The ordered list
+        int count; ///< The number of gates in the ordered list
+        Complex pending[MAX_QUBITS][2][2]; ///< Fused single qubit gates
+        size_t pending_mask; ///< Bit k is set if pending[k] is in use
+        unsigned long added; ///< The number of gates added so far
+        unsigned long passes; ///< The number of passes over the state so far
+    } GateQueue;
+
+    /// @brief Make an empty queue for a state
+    void queue_init(GateQueue * queue, StateVector * state);
+
+    /**
+     * @brief Add a single qubit gate to the queue
+     * @param queue The queue
+     * @param op The 2x2 matrix
+     * @param targ The qubit
+     * @return 0 if successful, -1 if the qubit is not valid
+     */
+    int queue_gate(GateQueue * queue, const Complex op[2][2], int targ);
+
+    /**
+     * @brief Add a (multi-)controlled gate to the queue
+     * @param queue The queue
+     * @param op The 2x2 matrix
+     * @param ctrl_mask The ctrl qubits, with bit n set for qubit n
+     * @param targ The targ qubit
+     * @return 0 if successful, -1 if the qubits are not valid
+     */
+    int queue_controlled_gate(GateQueue * queue, const Complex op[2][2],
+            size_t ctrl_mask, int targ);
+
+    /// @brief Apply everything in the queue to the state and empty it
+    void queue_flush(GateQueue * queue);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* QUEUE_H */
+
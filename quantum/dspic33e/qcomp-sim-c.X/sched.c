@@ -0,0 +1,120 @@
+/**
+ * @file sched.c
+ *
+ * @brief Description: A cooperative scheduler driven by the system tick
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "sched.h"
+#include "input.h"
+#include "hal.h"
+
+/// The tick count. It is 32 bits, so on the dsPIC it is read with the
+/// interrupts off (see sched_now)
+static volatile unsigned long ticks = 0;
+
+/// Whether the tick is running (sched_sleep returns straight away if not)
+static bool started = false;
+
+/// The run queue, in order of due tick
+static Task * run_queue = NULL;
+
+/// The task being run by sched_run (or NULL)
+static Task * current = NULL;
+
+/// Whether tick a comes before tick b (allowing for the count wrapping)
+static bool before(unsigned long a, unsigned long b) {
+    return (long)(a - b) < 0;
+}
+
+/// Put a task in the run queue after the tasks due on or before it
+static void insert(Task * task) {
+    Task ** p = &run_queue;
+    while(*p != NULL && !before(task->due, (*p)->due)) p = &(*p)->next;
+    task->next = *p;
+    *p = task;
+    task->queued = true;
+}
+
+void sched_setup(void) {
+    run_queue = NULL;
+    ticks = 0;
+    hal_timer_setup(HAL_TIMER_TICK);
+    hal_timer_period(HAL_TIMER_TICK, SCHED_TICK_PERIOD);
+    hal_timer_enable(HAL_TIMER_TICK, true);
+    started = true;
+}
+
+/** @brief Interrupt service routine for timer 9 (the system tick)
+ *
+ * Called when the 32 bit timer formed from T8 and T9 reaches its period.
+ * Scans the buttons and counts the tick. The tasks are run by the main
+ * loop, not here.
+ */
+void ISR _T9Interrupt(void) {
+    input_scan();
+    ticks++;
+
+    // Reset the timer and clear the interrupt flag
+    hal_timer_ack(HAL_TIMER_TICK);
+}
+
+unsigned long sched_now(void) {
+    hal_interrupts_disable();
+    unsigned long now = ticks;
+    hal_interrupts_enable();
+    return now;
+}
+
+int sched_add(Task * task, TaskFunc func, void * arg,
+        unsigned long delay, unsigned long period) {
+    if(task->queued) return -1;
+    task->func = func;
+    task->arg = arg;
+    task->due = sched_now() + delay;
+    task->period = period;
+    insert(task);
+    return 0;
+}
+
+int sched_remove(Task * task) {
+    if(task == current && !task->queued) {
+        task->period = 0; // Stop it being queued again
+        return 0;
+    }
+    if(!task->queued) return -1;
+    Task ** p = &run_queue;
+    while(*p != task) p = &(*p)->next;
+    *p = task->next;
+    task->queued = false;
+    return 0;
+}
+
+int sched_run(void) {
+    Task * task = run_queue;
+    unsigned long now = sched_now();
+    if(task == NULL || before(now, task->due)) return -1;
+    run_queue = task->next;
+    task->queued = false;
+    Task * outer = current; // Tasks can run inside sched_sleep in a task
+    current = task;
+    task->func(task->arg);
+    current = outer;
+    /// Queue it again unless it only runs once, or removed or added
+    /// itself (the next run is skipped forward if it has fallen behind)
+    if(task->period != 0 && !task->queued) {
+        task->due += task->period;
+        if(before(task->due, now)) task->due = now;
+        insert(task);
+    }
+    return 0;
+}
+
+void sched_sleep(unsigned long n) {
+    if(!started) return; // No tick to wait for
+    unsigned long end = sched_now() + n;
+    while(before(sched_now(), end)) {
+        if(sched_run() != 0) hal_idle(); // Woken by the next tick
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * @file sched.h
+ *
+ * @brief Description: A cooperative scheduler driven by the system tick
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * The system tick is _T9Interrupt (timers 8 and 9). Each tick scans the
+ * buttons (see input.h) and counts. Tasks are functions which are run by
+ * the main loop when their tick comes round, and possibly again every
+ * period ticks. They are kept in a run queue in order of the tick they
+ * are due on.
+ *
+ * Nothing is pre-empted: a task runs until it returns. The main loop runs
+ * the due tasks whenever it waits -- in sched_sleep (which replaces the
+ * old busy wait delay) and in input_wait -- and idles the CPU when there
+ * are none. So a task should do a short piece of work and return.
+ */
+
+#ifndef SCHED_H
+#define	SCHED_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+    /// The tick period in timer cycles (about 5 ms)
+#define SCHED_TICK_PERIOD 0x00040000
+
+    /// The ticks the display is held for after a gate (about 0.1 s, which
+    /// is about what the old delay function took)
+#define SCHED_DELAY 24
+
+    /// @brief A function run by the scheduler
+    typedef void (*TaskFunc)(void * arg);
+
+    /**
+     * @brief A task in the run queue
+     *
+     * The storage belongs to the caller (like a StateVector) and must
+     * stay put until the task is removed. Start with it zeroed (as a
+     * static Task is) and only use it through the functions below.
+     */
+    typedef struct Task {
+        TaskFunc func; ///< The function to run
+        void * arg; ///< Passed to func
+        unsigned long due; ///< The tick to run it on
+        unsigned long period; ///< Ticks between runs, or 0 to run once
+        bool queued; ///< Whether the task is in the run queue
+        struct Task * next; ///< The next task due
+    } Task;
+
+    /**
+     * @brief Empty the run queue and start the system tick
+     */
+    void sched_setup(void);
+
+    /// @brief The number of ticks since sched_setup
+    unsigned long sched_now(void);
+
+    /**
+     * @brief Add a task to the run queue
+     * @param task The task storage
+     * @param func The function to run
+     * @param arg Passed to func
+     * @param delay The ticks until the first run
+     * @param period The ticks between runs, or 0 to run it once
+     * @return 0 if successful, -1 if the task is already queued
+     */
+    int sched_add(Task * task, TaskFunc func, void * arg,
+            unsigned long delay, unsigned long period);
+
+    /**
+     * @brief Take a task out of the run queue
+     * @param task The task (which may be the one running)
+     * @return 0 if successful, -1 if the task was not queued
+     */
+    int sched_remove(Task * task);
+
+    /**
+     * @brief Run the task which is due first, if it is due
+     * @return 0 if a task was run, -1 if none were due
+     *
+     * A task is taken out of the queue while it runs, so it can call
+     * sched_sleep itself without being run again.
+     */
+    int sched_run(void);
+
+    /**
+     * @brief Run the due tasks, idling the CPU when there are none, until
+     * a number of ticks have passed
+     * @param ticks The number of ticks
+     */
+    void sched_sleep(unsigned long ticks);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SCHED_H */
@@ -0,0 +1,966 @@
+/**
+ * @file simd.c
+ *
+ * @brief Description: Vectorised gate kernels for the host build
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Every kernel comes in two parts:
+ *
+ *   - run: apply the matrix to n contiguous pairs (i + j, i + j + 2^k).
+ *     This is the high stride case (k > 0).
+ *   - adjacent: apply the matrix to n pairs (2p + 2j, 2p + 2j + 1) which
+ *     sit next to each other in memory. This is the low stride case (k = 0).
+ *
+ * With the default (interleaved) layout, the complex multiplication of a
+ * vector of amplitudes (ar, ai, br, bi, ...) by a matrix element
+ * m = mr + i*mi is done as
+ *
+ *      addsub(mr * v, mi * swap(v))
+ *
+ * where swap exchanges the real and imaginary parts of each amplitude and
+ * addsub subtracts in the even (real) positions and adds in the odd
+ * (imaginary) positions. The products with the two matrix elements in a
+ * row are summed before the addsub, so each output needs one addsub.
+ *
+ * With STATE_SOA the real and imaginary parts are already in separate
+ * registers, so the kernel is the plain complex formula with no shuffles.
+ * Only the low stride case needs to separate even and odd elements.
+ */
+
+#include "simd.h"
+
+/// The vector kernels are written for float amplitudes, so the AMP_Q31
+/// (double) build only has the plain C kernels. The measurements (see 
+/// measure_avx2) are written for both.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MEASURE_X86
+#ifndef AMP_Q31
+#define SIMD_X86
+#endif
+#endif
+
+/// @brief A kernel implementation
+typedef struct {
+    const char * name;
+    /// Apply op to the pairs (i + j, i + j + bit) for j = 0, ..., n-1
+    void (*run)(const Complex op[2][2], StateVector * state,
+            size_t i, size_t bit, size_t n);
+    /// Apply op to the pairs (2p + 2j, 2p + 2j + 1) for j = 0, ..., n-1
+    void (*adjacent)(const Complex op[2][2], StateVector * state,
+            size_t p, size_t n);
+} Kernel;
+
+/// Vectorise the loop which follows (the pragma is only known with OpenMP)
+#ifdef _OPENMP
+#define SIMD_LOOP _Pragma("omp simd")
+#else
+#define SIMD_LOOP
+#endif
+
+/// On x86 the plain C kernels are also compiled for AVX2 (for the double
+/// amplitudes too), and the version to use is picked when the program is
+/// loaded
+#ifdef MEASURE_X86
+#define CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define CLONES
+#endif
+
+/// @brief Apply op to the pair of amplitudes a and b. The temporaries are
+/// local so the compiler is free to keep them in registers
+static inline void pair_scalar(const Complex op[2][2],
+        Q15 * a_re, Q15 * a_im, Q15 * b_re, Q15 * b_im) {
+    Q15 ar = *a_re, ai = *a_im, br = *b_re, bi = *b_im;
+    *a_re = op[0][0][0] * ar - op[0][0][1] * ai + op[0][1][0] * br - op[0][1][1] * bi;
+    *a_im = op[0][0][0] * ai + op[0][0][1] * ar + op[0][1][0] * bi + op[0][1][1] * br;
+    *b_re = op[1][0][0] * ar - op[1][0][1] * ai + op[1][1][0] * br - op[1][1][1] * bi;
+    *b_im = op[1][0][0] * ai + op[1][0][1] * ar + op[1][1][0] * bi + op[1][1][1] * br;
+}
+
+/// The pair (x, y) of amplitudes, by index
+#define PAIR(state, x, y) &AMP_RE(state, x), &AMP_IM(state, x), \
+        &AMP_RE(state, y), &AMP_IM(state, y)
+
+/**
+ * @brief Apply op to the pairs (z, z + bit) for z = zero, zero + stride, 
+ * ... (n pairs)
+ * 
+ * Unlike pair_scalar, the matrix is in locals (as in the special kernels
+ * below), so the compiler can vectorise the loop. That is what the 
+ * AMP_Q31 build has instead of the vector kernels.
+ */
+static inline void general_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    Q15 ar = op[0][0][0], ai = op[0][0][1], br = op[0][1][0], bi = op[0][1][1];
+    Q15 cr = op[1][0][0], ci = op[1][0][1], dr = op[1][1][0], di = op[1][1][1];
+    SIMD_LOOP
+    for (size_t z = zero; z < zero + n * stride; z += stride) {
+        Q15 xr = AMP_RE(state, z), xi = AMP_IM(state, z);
+        Q15 yr = AMP_RE(state, z + bit), yi = AMP_IM(state, z + bit);
+        AMP_RE(state, z) = ar * xr - ai * xi + br * yr - bi * yi;
+        AMP_IM(state, z) = ar * xi + ai * xr + br * yi + bi * yr;
+        AMP_RE(state, z + bit) = cr * xr - ci * xi + dr * yr - di * yi;
+        AMP_IM(state, z + bit) = cr * xi + ci * xr + dr * yi + di * yr;
+    }
+}
+
+CLONES static void run_scalar(const Complex op[2][2], StateVector * state,
+        size_t i, size_t bit, size_t n) {
+    general_pairs(op, state, i, bit, 1, n);
+}
+
+CLONES static void adjacent_scalar(const Complex op[2][2], StateVector * state,
+        size_t p, size_t n) {
+    general_pairs(op, state, 2*p, 1, 2, n);
+}
+
+static const Kernel kernel_scalar = {"scalar", run_scalar, adjacent_scalar};
+
+#if defined(SIMD_X86) && !defined(STATE_SOA)
+
+/// Swap the real and imaginary parts of each amplitude
+#define SWAP_RI _MM_SHUFFLE(2, 3, 0, 1)
+
+__attribute__((target("sse3")))
+static void run_sse(const Complex op[2][2], StateVector * state,
+        size_t i, size_t bit, size_t n) {
+    Complex * lo = state->amp + i;
+    Complex * hi = lo + bit;
+    /// Broadcast the real and imaginary parts of each matrix element
+    __m128 m00r = _mm_set1_ps(op[0][0][0]), m00i = _mm_set1_ps(op[0][0][1]);
+    __m128 m01r = _mm_set1_ps(op[0][1][0]), m01i = _mm_set1_ps(op[0][1][1]);
+    __m128 m10r = _mm_set1_ps(op[1][0][0]), m10i = _mm_set1_ps(op[1][0][1]);
+    __m128 m11r = _mm_set1_ps(op[1][1][0]), m11i = _mm_set1_ps(op[1][1][1]);
+    size_t j = 0;
+    /// Two pairs at a time
+    for (; j + 2 <= n; j += 2) {
+        __m128 a = _mm_loadu_ps(lo[j]);
+        __m128 b = _mm_loadu_ps(hi[j]);
+        __m128 as = _mm_shuffle_ps(a, a, SWAP_RI);
+        __m128 bs = _mm_shuffle_ps(b, b, SWAP_RI);
+        __m128 x = _mm_addsub_ps(
+                _mm_add_ps(_mm_mul_ps(m00r, a), _mm_mul_ps(m01r, b)),
+                _mm_add_ps(_mm_mul_ps(m00i, as), _mm_mul_ps(m01i, bs)));
+        __m128 y = _mm_addsub_ps(
+                _mm_add_ps(_mm_mul_ps(m10r, a), _mm_mul_ps(m11r, b)),
+                _mm_add_ps(_mm_mul_ps(m10i, as), _mm_mul_ps(m11i, bs)));
+        _mm_storeu_ps(lo[j], x);
+        _mm_storeu_ps(hi[j], y);
+    }
+    /// Odd one out
+    if (j < n) pair_scalar(op, PAIR(state, i + j, i + j + bit));
+}
+
+__attribute__((target("sse3")))
+static void adjacent_sse(const Complex op[2][2], StateVector * state,
+        size_t p, size_t n) {
+    Complex * v = state->amp + 2*p;
+    /// Columns of the matrix: c0 = (m00, m10), c1 = (m01, m11)
+    __m128 c0 = _mm_setr_ps(op[0][0][0], op[0][0][1], op[1][0][0], op[1][0][1]);
+    __m128 c1 = _mm_setr_ps(op[0][1][0], op[0][1][1], op[1][1][0], op[1][1][1]);
+    __m128 c0r = _mm_moveldup_ps(c0), c0i = _mm_movehdup_ps(c0);
+    __m128 c1r = _mm_moveldup_ps(c1), c1i = _mm_movehdup_ps(c1);
+    for (size_t j = 0; j < n; j++) {
+        /// One register holds the pair (a, b)
+        __m128 ab = _mm_loadu_ps(v[2*j]);
+        __m128 a = _mm_movelh_ps(ab, ab); // (a, a)
+        __m128 b = _mm_movehl_ps(ab, ab); // (b, b)
+        __m128 as = _mm_shuffle_ps(a, a, SWAP_RI);
+        __m128 bs = _mm_shuffle_ps(b, b, SWAP_RI);
+        __m128 x = _mm_addsub_ps(
+                _mm_add_ps(_mm_mul_ps(c0r, a), _mm_mul_ps(c1r, b)),
+                _mm_add_ps(_mm_mul_ps(c0i, as), _mm_mul_ps(c1i, bs)));
+        _mm_storeu_ps(v[2*j], x);
+    }
+}
+
+static const Kernel kernel_sse = {"sse3", run_sse, adjacent_sse};
+
+__attribute__((target("avx2,fma")))
+static void run_avx2(const Complex op[2][2], StateVector * state,
+        size_t i, size_t bit, size_t n) {
+    Complex * lo = state->amp + i;
+    Complex * hi = lo + bit;
+    __m256 m00r = _mm256_set1_ps(op[0][0][0]), m00i = _mm256_set1_ps(op[0][0][1]);
+    __m256 m01r = _mm256_set1_ps(op[0][1][0]), m01i = _mm256_set1_ps(op[0][1][1]);
+    __m256 m10r = _mm256_set1_ps(op[1][0][0]), m10i = _mm256_set1_ps(op[1][0][1]);
+    __m256 m11r = _mm256_set1_ps(op[1][1][0]), m11i = _mm256_set1_ps(op[1][1][1]);
+    size_t j = 0;
+    /// Four pairs at a time
+    for (; j + 4 <= n; j += 4) {
+        __m256 a = _mm256_loadu_ps(lo[j]);
+        __m256 b = _mm256_loadu_ps(hi[j]);
+        __m256 as = _mm256_permute_ps(a, SWAP_RI);
+        __m256 bs = _mm256_permute_ps(b, SWAP_RI);
+        __m256 x = _mm256_addsub_ps(
+                _mm256_fmadd_ps(m00r, a, _mm256_mul_ps(m01r, b)),
+                _mm256_fmadd_ps(m00i, as, _mm256_mul_ps(m01i, bs)));
+        __m256 y = _mm256_addsub_ps(
+                _mm256_fmadd_ps(m10r, a, _mm256_mul_ps(m11r, b)),
+                _mm256_fmadd_ps(m10i, as, _mm256_mul_ps(m11i, bs)));
+        _mm256_storeu_ps(lo[j], x);
+        _mm256_storeu_ps(hi[j], y);
+    }
+    /// Runs shorter than four (k = 1) and the remainder. These stay in this
+    /// function: calling the SSE kernel with the upper halves of the ymm
+    /// registers dirty costs a state transition on every run
+    for (; j + 2 <= n; j += 2) {
+        __m128 a = _mm_loadu_ps(lo[j]);
+        __m128 b = _mm_loadu_ps(hi[j]);
+        __m128 as = _mm_permute_ps(a, SWAP_RI);
+        __m128 bs = _mm_permute_ps(b, SWAP_RI);
+        __m128 x = _mm_addsub_ps(
+                _mm_fmadd_ps(_mm256_castps256_ps128(m00r), a,
+                    _mm_mul_ps(_mm256_castps256_ps128(m01r), b)),
+                _mm_fmadd_ps(_mm256_castps256_ps128(m00i), as,
+                    _mm_mul_ps(_mm256_castps256_ps128(m01i), bs)));
+        __m128 y = _mm_addsub_ps(
+                _mm_fmadd_ps(_mm256_castps256_ps128(m10r), a,
+                    _mm_mul_ps(_mm256_castps256_ps128(m11r), b)),
+                _mm_fmadd_ps(_mm256_castps256_ps128(m10i), as,
+                    _mm_mul_ps(_mm256_castps256_ps128(m11i), bs)));
+        _mm_storeu_ps(lo[j], x);
+        _mm_storeu_ps(hi[j], y);
+    }
+    if (j < n) pair_scalar(op, PAIR(state, i + j, i + j + bit));
+}
+
+__attribute__((target("avx2,fma")))
+static void adjacent_avx2(const Complex op[2][2], StateVector * state,
+        size_t p, size_t n) {
+    Complex * v = state->amp + 2*p;
+    __m256 c0 = _mm256_setr_ps(op[0][0][0], op[0][0][1], op[1][0][0], op[1][0][1],
+            op[0][0][0], op[0][0][1], op[1][0][0], op[1][0][1]);
+    __m256 c1 = _mm256_setr_ps(op[0][1][0], op[0][1][1], op[1][1][0], op[1][1][1],
+            op[0][1][0], op[0][1][1], op[1][1][0], op[1][1][1]);
+    __m256 c0r = _mm256_moveldup_ps(c0), c0i = _mm256_movehdup_ps(c0);
+    __m256 c1r = _mm256_moveldup_ps(c1), c1i = _mm256_movehdup_ps(c1);
+    size_t j = 0;
+    /// Two pairs at a time
+    for (; j + 2 <= n; j += 2) {
+        /// (a0, b0, a1, b1) viewed as four 64 bit amplitudes
+        __m256d ab = _mm256_castps_pd(_mm256_loadu_ps(v[2*j]));
+        __m256 a = _mm256_castpd_ps(_mm256_movedup_pd(ab)); // (a0, a0, a1, a1)
+        __m256 b = _mm256_castpd_ps(_mm256_permute_pd(ab, 0xF)); // (b0, b0, b1, b1)
+        __m256 as = _mm256_permute_ps(a, SWAP_RI);
+        __m256 bs = _mm256_permute_ps(b, SWAP_RI);
+        __m256 x = _mm256_addsub_ps(
+                _mm256_fmadd_ps(c0r, a, _mm256_mul_ps(c1r, b)),
+                _mm256_fmadd_ps(c0i, as, _mm256_mul_ps(c1i, bs)));
+        _mm256_storeu_ps(v[2*j], x);
+    }
+    if (j < n) pair_scalar(op, PAIR(state, 2*(p + j), 2*(p + j) + 1));
+}
+
+static const Kernel kernel_avx2 = {"avx2", run_avx2, adjacent_avx2};
+
+#elif defined(SIMD_X86) /* STATE_SOA */
+
+/// @brief The 2x2 complex product on separate real and imaginary parts
+#define SOA_PRODUCT(add, sub, mul, m, ar, ai, br, bi, xr, xi, yr, yi) \
+    xr = sub(add(mul(m[0], ar), mul(m[2], br)), add(mul(m[1], ai), mul(m[3], bi))); \
+    xi = add(add(mul(m[0], ai), mul(m[1], ar)), add(mul(m[2], bi), mul(m[3], br))); \
+    yr = sub(add(mul(m[4], ar), mul(m[6], br)), add(mul(m[5], ai), mul(m[7], bi))); \
+    yi = add(add(mul(m[4], ai), mul(m[5], ar)), add(mul(m[6], bi), mul(m[7], br)))
+
+#define SSE_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi) SOA_PRODUCT( \
+    _mm_add_ps, _mm_sub_ps, _mm_mul_ps, m, ar, ai, br, bi, xr, xi, yr, yi)
+
+#define AVX_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi) SOA_PRODUCT( \
+    _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, m, ar, ai, br, bi, xr, xi, yr, yi)
+
+/// Broadcast the matrix elements in the order m00r, m00i, m01r, m01i, ...
+#define BROADCAST(set1, m, op) \
+    for (int e = 0; e < 8; e++) m[e] = set1(op[e >> 2][(e >> 1) & 1][e & 1])
+
+__attribute__((target("sse3")))
+static void run_sse(const Complex op[2][2], StateVector * state,
+        size_t i, size_t bit, size_t n) {
+    Q15 * lo_re = state->re + i, * lo_im = state->im + i;
+    Q15 * hi_re = lo_re + bit, * hi_im = lo_im + bit;
+    __m128 m[8];
+    BROADCAST(_mm_set1_ps, m, op);
+    size_t j = 0;
+    /// Four pairs at a time
+    for (; j + 4 <= n; j += 4) {
+        __m128 ar = _mm_loadu_ps(lo_re + j), ai = _mm_loadu_ps(lo_im + j);
+        __m128 br = _mm_loadu_ps(hi_re + j), bi = _mm_loadu_ps(hi_im + j);
+        __m128 xr, xi, yr, yi;
+        SSE_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi);
+        _mm_storeu_ps(lo_re + j, xr);
+        _mm_storeu_ps(lo_im + j, xi);
+        _mm_storeu_ps(hi_re + j, yr);
+        _mm_storeu_ps(hi_im + j, yi);
+    }
+    /// Runs shorter than four (k < 2) and the remainder
+    for (; j < n; j++) pair_scalar(op, PAIR(state, i + j, i + j + bit));
+}
+
+__attribute__((target("sse3")))
+static void adjacent_sse(const Complex op[2][2], StateVector * state,
+        size_t p, size_t n) {
+    Q15 * re = state->re + 2*p, * im = state->im + 2*p;
+    __m128 m[8];
+    BROADCAST(_mm_set1_ps, m, op);
+    size_t j = 0;
+    /// Four pairs (eight amplitudes) at a time
+    for (; j + 4 <= n; j += 4) {
+        __m128 r0 = _mm_loadu_ps(re + 2*j), r1 = _mm_loadu_ps(re + 2*j + 4);
+        __m128 i0 = _mm_loadu_ps(im + 2*j), i1 = _mm_loadu_ps(im + 2*j + 4);
+        /// Separate the even (ZERO) and odd (ONE) amplitudes
+        __m128 ar = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 br = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 ai = _mm_shuffle_ps(i0, i1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 bi = _mm_shuffle_ps(i0, i1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 xr, xi, yr, yi;
+        SSE_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi);
+        /// Interleave them again
+        _mm_storeu_ps(re + 2*j, _mm_unpacklo_ps(xr, yr));
+        _mm_storeu_ps(re + 2*j + 4, _mm_unpackhi_ps(xr, yr));
+        _mm_storeu_ps(im + 2*j, _mm_unpacklo_ps(xi, yi));
+        _mm_storeu_ps(im + 2*j + 4, _mm_unpackhi_ps(xi, yi));
+    }
+    for (; j < n; j++) pair_scalar(op, PAIR(state, 2*(p + j), 2*(p + j) + 1));
+}
+
+static const Kernel kernel_sse = {"sse3", run_sse, adjacent_sse};
+
+__attribute__((target("avx2,fma")))
+static void run_avx2(const Complex op[2][2], StateVector * state,
+        size_t i, size_t bit, size_t n) {
+    Q15 * lo_re = state->re + i, * lo_im = state->im + i;
+    Q15 * hi_re = lo_re + bit, * hi_im = lo_im + bit;
+    __m256 m[8];
+    BROADCAST(_mm256_set1_ps, m, op);
+    size_t j = 0;
+    /// Eight pairs at a time
+    for (; j + 8 <= n; j += 8) {
+        __m256 ar = _mm256_loadu_ps(lo_re + j), ai = _mm256_loadu_ps(lo_im + j);
+        __m256 br = _mm256_loadu_ps(hi_re + j), bi = _mm256_loadu_ps(hi_im + j);
+        __m256 xr, xi, yr, yi;
+        AVX_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi);
+        _mm256_storeu_ps(lo_re + j, xr);
+        _mm256_storeu_ps(lo_im + j, xi);
+        _mm256_storeu_ps(hi_re + j, yr);
+        _mm256_storeu_ps(hi_im + j, yi);
+    }
+    /// Four pairs (k = 2) in the lower halves, without leaving AVX
+    for (; j + 4 <= n; j += 4) {
+        __m128 ar = _mm_loadu_ps(lo_re + j), ai = _mm_loadu_ps(lo_im + j);
+        __m128 br = _mm_loadu_ps(hi_re + j), bi = _mm_loadu_ps(hi_im + j);
+        __m128 h[8], xr, xi, yr, yi;
+        for (int e = 0; e < 8; e++) h[e] = _mm256_castps256_ps128(m[e]);
+        SSE_PRODUCT(h, ar, ai, br, bi, xr, xi, yr, yi);
+        _mm_storeu_ps(lo_re + j, xr);
+        _mm_storeu_ps(lo_im + j, xi);
+        _mm_storeu_ps(hi_re + j, yr);
+        _mm_storeu_ps(hi_im + j, yi);
+    }
+    for (; j < n; j++) pair_scalar(op, PAIR(state, i + j, i + j + bit));
+}
+
+__attribute__((target("avx2,fma")))
+static void adjacent_avx2(const Complex op[2][2], StateVector * state,
+        size_t p, size_t n) {
+    Q15 * re = state->re + 2*p, * im = state->im + 2*p;
+    __m256 m[8];
+    BROADCAST(_mm256_set1_ps, m, op);
+    size_t j = 0;
+    /// Eight pairs (sixteen amplitudes) at a time. The shuffles work inside
+    /// each 128 bit lane, so the pairs come out of order, but the unpacks
+    /// put them back in the same order
+    for (; j + 8 <= n; j += 8) {
+        __m256 r0 = _mm256_loadu_ps(re + 2*j), r1 = _mm256_loadu_ps(re + 2*j + 8);
+        __m256 i0 = _mm256_loadu_ps(im + 2*j), i1 = _mm256_loadu_ps(im + 2*j + 8);
+        __m256 ar = _mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 br = _mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 ai = _mm256_shuffle_ps(i0, i1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 bi = _mm256_shuffle_ps(i0, i1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 xr, xi, yr, yi;
+        AVX_PRODUCT(m, ar, ai, br, bi, xr, xi, yr, yi);
+        _mm256_storeu_ps(re + 2*j, _mm256_unpacklo_ps(xr, yr));
+        _mm256_storeu_ps(re + 2*j + 8, _mm256_unpackhi_ps(xr, yr));
+        _mm256_storeu_ps(im + 2*j, _mm256_unpacklo_ps(xi, yi));
+        _mm256_storeu_ps(im + 2*j + 8, _mm256_unpackhi_ps(xi, yi));
+    }
+    for (; j < n; j++) pair_scalar(op, PAIR(state, 2*(p + j), 2*(p + j) + 1));
+}
+
+static const Kernel kernel_avx2 = {"avx2", run_avx2, adjacent_avx2};
+
+#endif /* SIMD_X86 */
+
+/*
+ * Kernels for the special kinds of matrix (see classify_gate). They only
+ * move or negate amplitudes, or multiply one half of the pairs, so they
+ * are limited by memory rather than arithmetic and are written in plain C
+ * for both layouts. Each one works on the pairs (z, z + bit) for
+ * z = zero, zero + stride, ... (n pairs).
+ */
+
+/// Multiply amplitude i by mr + i*mi
+#define AMP_MUL(state, i, mr, mi) do { \
+        Q15 re_ = AMP_RE(state, i), im_ = AMP_IM(state, i); \
+        AMP_RE(state, i) = mr * re_ - mi * im_; \
+        AMP_IM(state, i) = mr * im_ + mi * re_; \
+    } while (0)
+
+/*
+ * The matrix elements are copied to locals first. Otherwise the compiler
+ * has to assume that writing to the state might change them.
+ */
+
+static inline void diagonal_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    Q15 ar = op[0][0][0], ai = op[0][0][1], br = op[1][1][0], bi = op[1][1][1];
+    SIMD_LOOP
+    for (size_t z = zero; z < zero + n * stride; z += stride) {
+        AMP_MUL(state, z, ar, ai);
+        AMP_MUL(state, z + bit, br, bi);
+    }
+}
+
+static inline void phase_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    Q15 br = op[1][1][0], bi = op[1][1][1];
+    SIMD_LOOP
+    for (size_t z = zero + bit; z < zero + bit + n * stride; z += stride) {
+        AMP_MUL(state, z, br, bi);
+    }
+}
+
+static inline void sign_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    (void)op; // The same arguments as the other kernels
+    SIMD_LOOP
+    for (size_t z = zero + bit; z < zero + bit + n * stride; z += stride) {
+        AMP_RE(state, z) = -AMP_RE(state, z);
+        AMP_IM(state, z) = -AMP_IM(state, z);
+    }
+}
+
+static inline void swap_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    (void)op; // The same arguments as the other kernels
+    SIMD_LOOP
+    for (size_t z = zero; z < zero + n * stride; z += stride) {
+        Q15 re = AMP_RE(state, z), im = AMP_IM(state, z);
+        AMP_RE(state, z) = AMP_RE(state, z + bit);
+        AMP_IM(state, z) = AMP_IM(state, z + bit);
+        AMP_RE(state, z + bit) = re;
+        AMP_IM(state, z + bit) = im;
+    }
+}
+
+static inline void antidiagonal_pairs(const Complex op[2][2], StateVector * state,
+        size_t zero, size_t bit, size_t stride, size_t n) {
+    Q15 cr = op[0][1][0], ci = op[0][1][1], dr = op[1][0][0], di = op[1][0][1];
+    SIMD_LOOP
+    for (size_t z = zero; z < zero + n * stride; z += stride) {
+        Q15 ar = AMP_RE(state, z), ai = AMP_IM(state, z);
+        Q15 br = AMP_RE(state, z + bit), bi = AMP_IM(state, z + bit);
+        AMP_RE(state, z) = cr * br - ci * bi;
+        AMP_IM(state, z) = cr * bi + ci * br;
+        AMP_RE(state, z + bit) = dr * ar - di * ai;
+        AMP_IM(state, z + bit) = dr * ai + di * ar;
+    }
+}
+
+/// Make a Kernel out of one of the functions above
+#define SPECIAL_KERNEL(kind) \
+    CLONES static void run_##kind(const Complex op[2][2], StateVector * state, \
+            size_t i, size_t bit, size_t n) { \
+        kind##_pairs(op, state, i, bit, 1, n); \
+    } \
+    CLONES static void adjacent_##kind(const Complex op[2][2], StateVector * state, \
+            size_t p, size_t n) { \
+        kind##_pairs(op, state, 2*p, 1, 2, n); \
+    } \
+    static const Kernel kernel_##kind = {#kind, run_##kind, adjacent_##kind}
+
+SPECIAL_KERNEL(diagonal);
+SPECIAL_KERNEL(phase);
+SPECIAL_KERNEL(sign);
+SPECIAL_KERNEL(swap);
+SPECIAL_KERNEL(antidiagonal);
+
+/// The amplitudes measured at a time: every pair for every measured qubit
+/// is inside a group, so a group can be gone over in fixed length loops
+enum { GROUP = 1 << MEASURE_QUBITS };
+
+/// The sums for the measurements of a block, for each setting of the 
+/// measured bits (see measure_sums)
+typedef struct {
+    Q15 lane[GROUP]; ///< |a|^2 of the amplitudes with those bits
+    long count[MEASURE_QUBITS]; ///< The pairs with a phase difference
+} GroupSums;
+
+/// @brief Add the sums to the measurements: the ZERO and ONE sums of a 
+/// qubit are the lanes with its bit clear and set
+static void measure_sums(const GroupSums * sums, Marginals * m) {
+    for (int k = 0; k < m->num_qubits; k++) {
+        int bit = 1 << k;
+        Q15 zero = 0, one = 0;
+        for (int j = 0; j < GROUP; j++) {
+            if (j & bit) one += sums->lane[j];
+            else zero += sums->lane[j];
+        }
+        m->zero[k] += zero;
+        m->one[k] += one;
+        m->phase[k] += sums->count[k];
+    }
+}
+
+/// An integer as wide as Q15, so that the loops which mix them are all one
+/// width and vectorise (for the double amplitudes too)
+#ifdef AMP_Q31
+typedef long long Flag;
+#else
+typedef int Flag;
+#endif
+
+/**
+ * @brief Add a block of amplitudes to the measurements, in plain C (see
+ * simd_measure_block)
+ * 
+ * The groups of the block are copied side by side, so that amplitude j of
+ * every group is in one row. Then the sums for j, and the pairs (j, j + 
+ * 2^k) for each qubit, are loops along the rows which the compiler 
+ * vectorises with no lanes wasted. The copy is padded with zeros to whole
+ * vectors of groups.
+ * 
+ * The rows are kept as they are (for the ZERO ends of the pairs) and with
+ * the amplitudes without the ctrl bits set to zero (the rest). A pair has
+ * a phase difference if the real or imaginary parts have opposite signs,
+ * which a zero never has, so it is only counted if its ONE end has the 
+ * ctrl bits set.
+ */
+CLONES static void measure_groups(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+    enum { VEC = 8, ROW = (1 << MEASURE_BLOCK_QUBITS) / GROUP };
+    const Q15 limit = -0.01; // Products below this are a sign change
+    Q15 re[GROUP][ROW], im[GROUP][ROW], in_re[GROUP][ROW], in_im[GROUP][ROW];
+    size_t groups = (block + GROUP - 1) / GROUP;
+    size_t row = (groups + VEC - 1) & ~(size_t)(VEC - 1);
+    /// Whether each amplitude of a group has the low ctrl bits
+    Q15 low_in[GROUP];
+    for (int j = 0; j < GROUP; j++) low_in[j] = (j & ctrl_mask) == (ctrl_mask & (GROUP - 1));
+    size_t high = ctrl_mask & ~(size_t)(GROUP - 1);
+    for (size_t g = 0; g < row; g++) {
+        size_t l = base + g * GROUP;
+        Q15 high_in = (l & high) == high;
+        if (g < block / GROUP) {
+            SIMD_LOOP
+            for (int j = 0; j < GROUP; j++) {
+                re[j][g] = AMP_RE(state, l + j);
+                im[j][g] = AMP_IM(state, l + j);
+                in_re[j][g] = re[j][g] * low_in[j] * high_in;
+                in_im[j][g] = im[j][g] * low_in[j] * high_in;
+            }
+        } else {
+            /// The part of a group left over, and the padding
+            for (int j = 0; j < GROUP; j++) {
+                bool have = g * GROUP + j < block;
+                re[j][g] = have ? AMP_RE(state, l + j) : 0;
+                im[j][g] = have ? AMP_IM(state, l + j) : 0;
+                in_re[j][g] = re[j][g] * low_in[j] * high_in;
+                in_im[j][g] = im[j][g] * low_in[j] * high_in;
+            }
+        }
+    }
+    /// Summed VEC groups at a time, and then across
+    Q15 lane[GROUP][VEC] = {{0}};
+    Flag count[MEASURE_QUBITS][VEC] = {{0}};
+    for (size_t g = 0; g < row; g += VEC) {
+        for (int j = 0; j < GROUP && sums; j++) {
+            SIMD_LOOP
+            for (int v = 0; v < VEC; v++) {
+                lane[j][v] += in_re[j][g + v] * in_re[j][g + v] 
+                        + in_im[j][g + v] * in_im[j][g + v];
+            }
+        }
+        for (int k = 0; k < MEASURE_QUBITS; k++) {
+            int bit = 1 << k;
+            for (int j = 0; j < GROUP; j++) {
+                if (j & bit) continue;
+                const Q15 * r0 = re[j] + g, * i0 = im[j] + g;
+                const Q15 * r1 = in_re[j + bit] + g, * i1 = in_im[j + bit] + g;
+                SIMD_LOOP
+                for (int v = 0; v < VEC; v++) {
+                    count[k][v] += (r0[v] * r1[v] < limit) | (i0[v] * i1[v] < limit);
+                }
+            }
+        }
+    }
+    GroupSums total;
+    for (int j = 0; j < GROUP; j++) {
+        total.lane[j] = 0;
+        for (int v = 0; v < VEC; v++) total.lane[j] += lane[j][v];
+    }
+    for (int k = 0; k < MEASURE_QUBITS; k++) {
+        total.count[k] = 0;
+        for (int v = 0; v < VEC; v++) total.count[k] += count[k][v];
+    }
+    measure_sums(&total, m);
+}
+
+#ifdef MEASURE_X86
+
+/*
+ * The AVX2 measurements take a group as registers of real parts and of 
+ * imaginary parts: two of eight floats (a and b, amplitudes 0-7 and 8-15)
+ * or four of four doubles. Then the pairs for a qubit are made with one 
+ * shuffle for each end, so that all the lanes are pairs (the plain C 
+ * version copies the block to get the same). The shuffles which separate
+ * the real and imaginary parts of an AOS state work inside each 128 bit 
+ * lane, and they swap two bits of the position of an amplitude in the 
+ * register: bits 1 and 2 for floats, 0 and 1 for doubles.
+ */
+#if defined(STATE_SOA)
+#define GROUP_BIT(k) (k)
+#elif defined(AMP_Q31)
+#define GROUP_BIT(k) ((k) == 0 ? 1 : (k) == 1 ? 0 : (k))
+#else
+#define GROUP_BIT(k) ((k) == 1 ? 2 : (k) == 2 ? 1 : (k))
+#endif
+
+/// @brief The amplitude of a group in position p of the registers
+static int group_index(int p) {
+    int j = 0;
+    for (int k = 0; k < MEASURE_QUBITS; k++) j |= ((p >> GROUP_BIT(k)) & 1) << k;
+    return j;
+}
+
+#ifndef AMP_Q31
+
+/// @brief The ZERO (x) and ONE (y) ends of the pairs which differ in a bit
+/// of the position (bit 3 is the register)
+__attribute__((target("avx2,fma")))
+static inline void pair_ends(__m256 a, __m256 b, int bit, __m256 * x, 
+        __m256 * y) {
+    switch (bit) {
+        case 0:
+            *x = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            *y = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            break;
+        case 1:
+            *x = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 0, 1, 0));
+            *y = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 2, 3, 2));
+            break;
+        case 2:
+            *x = _mm256_permute2f128_ps(a, b, 0x20);
+            *y = _mm256_permute2f128_ps(a, b, 0x31);
+            break;
+        default:
+            *x = a;
+            *y = b;
+    }
+}
+
+/// Count the pairs for qubit k with a phase difference (the sign test of 
+/// measure_groups, as min(re products, im products) < limit)
+#define COUNT_PAIRS(k) do { \
+        __m256 xr, yr, xi, yi; \
+        pair_ends(ra, rb, GROUP_BIT(k), &xr, &yr); \
+        pair_ends(ia, ib, GROUP_BIT(k), &xi, &yi); \
+        __m256 product = _mm256_min_ps(_mm256_mul_ps(xr, yr), _mm256_mul_ps(xi, yi)); \
+        __m256 hit = _mm256_and_ps(in_one[k], \
+                _mm256_cmp_ps(product, limit, _CMP_LT_OQ)); \
+        count[k] = _mm256_sub_epi32(count[k], _mm256_castps_si256(hit)); \
+    } while (0)
+
+/// @brief Add a block of whole groups to the measurements, with AVX2 (see
+/// simd_measure_block)
+__attribute__((target("avx2,fma")))
+static void measure_avx2(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+    const __m256 limit = _mm256_set1_ps(-0.01f);
+    /// The groups without the high ctrl bits are left out, and the low
+    /// ones are a mask for each position (all bits set if counted)
+    size_t high = ctrl_mask & ~(size_t)(GROUP - 1);
+    int low = ctrl_mask & (GROUP - 1);
+    int mask[GROUP];
+    for (int p = 0; p < GROUP; p++) {
+        mask[p] = ((group_index(p) & low) == low) ? -1 : 0;
+    }
+    __m256 in_a = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)mask));
+    __m256 in_b = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(mask + 8)));
+    __m256 in_one[MEASURE_QUBITS], unused;
+    for (int k = 0; k < MEASURE_QUBITS; k++) {
+        pair_ends(in_a, in_b, GROUP_BIT(k), &unused, &in_one[k]);
+    }
+    __m256 sum_a = _mm256_setzero_ps(), sum_b = _mm256_setzero_ps();
+    __m256i count[MEASURE_QUBITS];
+    for (int k = 0; k < MEASURE_QUBITS; k++) count[k] = _mm256_setzero_si256();
+    for (size_t l = base; l < base + block; l += GROUP) {
+        if ((l & high) != high) continue;
+#ifndef STATE_SOA
+        const float * v = state->amp[l];
+        __m256 v0 = _mm256_loadu_ps(v), v1 = _mm256_loadu_ps(v + 8);
+        __m256 v2 = _mm256_loadu_ps(v + 16), v3 = _mm256_loadu_ps(v + 24);
+        __m256 ra = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 ia = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 rb = _mm256_shuffle_ps(v2, v3, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 ib = _mm256_shuffle_ps(v2, v3, _MM_SHUFFLE(3, 1, 3, 1));
+#else
+        __m256 ra = _mm256_loadu_ps(state->re + l), rb = _mm256_loadu_ps(state->re + l + 8);
+        __m256 ia = _mm256_loadu_ps(state->im + l), ib = _mm256_loadu_ps(state->im + l + 8);
+#endif
+        if (sums) {
+            sum_a = _mm256_add_ps(sum_a, _mm256_and_ps(in_a, 
+                    _mm256_fmadd_ps(ra, ra, _mm256_mul_ps(ia, ia))));
+            sum_b = _mm256_add_ps(sum_b, _mm256_and_ps(in_b, 
+                    _mm256_fmadd_ps(rb, rb, _mm256_mul_ps(ib, ib))));
+        }
+        COUNT_PAIRS(0);
+        COUNT_PAIRS(1);
+        COUNT_PAIRS(2);
+        COUNT_PAIRS(3);
+    }
+    /// Back to the sums of measure_groups, in the order of the amplitudes
+    GroupSums total;
+    float lane[GROUP];
+    int counted[GROUP / 2];
+    _mm256_storeu_ps(lane, sum_a);
+    _mm256_storeu_ps(lane + 8, sum_b);
+    for (int p = 0; p < GROUP; p++) total.lane[group_index(p)] = lane[p];
+    for (int k = 0; k < MEASURE_QUBITS; k++) {
+        _mm256_storeu_si256((__m256i *)counted, count[k]);
+        total.count[k] = 0;
+        for (int p = 0; p < GROUP / 2; p++) total.count[k] += counted[p];
+    }
+    measure_sums(&total, m);
+}
+
+#else /* AMP_Q31 */
+
+/// @brief The ZERO (x) and ONE (y) ends of the pairs which differ in a bit
+/// of the position (bits 2 and 3 are the register), two registers of each
+__attribute__((target("avx2,fma")))
+static inline void pair_ends(const __m256d r[4], int bit, __m256d x[2], 
+        __m256d y[2]) {
+    for (int h = 0; h < 2; h++) {
+        /// The registers paired for bits 0-2, and for bit 3
+        __m256d a = (bit == 3) ? r[h] : r[2 * h];
+        __m256d b = (bit == 3) ? r[h + 2] : r[2 * h + 1];
+        switch (bit) {
+            case 0:
+                x[h] = _mm256_unpacklo_pd(a, b);
+                y[h] = _mm256_unpackhi_pd(a, b);
+                break;
+            case 1:
+                x[h] = _mm256_permute2f128_pd(a, b, 0x20);
+                y[h] = _mm256_permute2f128_pd(a, b, 0x31);
+                break;
+            default:
+                x[h] = a;
+                y[h] = b;
+        }
+    }
+}
+
+/// Count the pairs for qubit k with a phase difference (as for floats)
+#define COUNT_PAIRS(k) do { \
+        __m256d xr[2], yr[2], xi[2], yi[2]; \
+        pair_ends(re, GROUP_BIT(k), xr, yr); \
+        pair_ends(im, GROUP_BIT(k), xi, yi); \
+        for (int h = 0; h < 2; h++) { \
+            __m256d product = _mm256_min_pd(_mm256_mul_pd(xr[h], yr[h]), \
+                    _mm256_mul_pd(xi[h], yi[h])); \
+            __m256d hit = _mm256_and_pd(in_one[k][h], \
+                    _mm256_cmp_pd(product, limit, _CMP_LT_OQ)); \
+            count[k] = _mm256_sub_epi64(count[k], _mm256_castpd_si256(hit)); \
+        } \
+    } while (0)
+
+/// @brief Add a block of whole groups to the measurements, with AVX2 (see
+/// simd_measure_block)
+__attribute__((target("avx2,fma")))
+static void measure_avx2(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+    const __m256d limit = _mm256_set1_pd(-0.01);
+    /// The groups without the high ctrl bits are left out, and the low
+    /// ones are a mask for each position (all bits set if counted)
+    size_t high = ctrl_mask & ~(size_t)(GROUP - 1);
+    int low = ctrl_mask & (GROUP - 1);
+    long long mask[GROUP];
+    for (int p = 0; p < GROUP; p++) {
+        mask[p] = ((group_index(p) & low) == low) ? -1 : 0;
+    }
+    __m256d in[4], in_one[MEASURE_QUBITS][2], unused[2];
+    for (int r = 0; r < 4; r++) {
+        in[r] = _mm256_castsi256_pd(_mm256_loadu_si256((const __m256i *)(mask + 4 * r)));
+    }
+    for (int k = 0; k < MEASURE_QUBITS; k++) {
+        pair_ends(in, GROUP_BIT(k), unused, in_one[k]);
+    }
+    __m256d sum[4];
+    __m256i count[MEASURE_QUBITS];
+    for (int r = 0; r < 4; r++) sum[r] = _mm256_setzero_pd();
+    for (int k = 0; k < MEASURE_QUBITS; k++) count[k] = _mm256_setzero_si256();
+    for (size_t l = base; l < base + block; l += GROUP) {
+        if ((l & high) != high) continue;
+        __m256d re[4], im[4];
+        for (int r = 0; r < 4; r++) {
+#ifndef STATE_SOA
+            const double * v = state->amp[l + 4 * r];
+            __m256d v0 = _mm256_loadu_pd(v), v1 = _mm256_loadu_pd(v + 4);
+            re[r] = _mm256_unpacklo_pd(v0, v1);
+            im[r] = _mm256_unpackhi_pd(v0, v1);
+#else
+            re[r] = _mm256_loadu_pd(state->re + l + 4 * r);
+            im[r] = _mm256_loadu_pd(state->im + l + 4 * r);
+#endif
+        }
+        for (int r = 0; r < 4 && sums; r++) {
+            sum[r] = _mm256_add_pd(sum[r], _mm256_and_pd(in[r], 
+                    _mm256_fmadd_pd(re[r], re[r], _mm256_mul_pd(im[r], im[r]))));
+        }
+        COUNT_PAIRS(0);
+        COUNT_PAIRS(1);
+        COUNT_PAIRS(2);
+        COUNT_PAIRS(3);
+    }
+    /// Back to the sums of measure_groups, in the order of the amplitudes
+    GroupSums total;
+    double lane[GROUP];
+    long long counted[4];
+    for (int r = 0; r < 4; r++) _mm256_storeu_pd(lane + 4 * r, sum[r]);
+    for (int p = 0; p < GROUP; p++) total.lane[group_index(p)] = lane[p];
+    for (int k = 0; k < MEASURE_QUBITS; k++) {
+        _mm256_storeu_si256((__m256i *)counted, count[k]);
+        total.count[k] = 0;
+        for (int p = 0; p < 4; p++) total.count[k] += counted[p];
+    }
+    measure_sums(&total, m);
+}
+
+#endif /* AMP_Q31 */
+
+#endif /* MEASURE_X86 */
+
+/// The kernel in use. It is only set by simd_select, which runs when the
+/// program is loaded (see simd_init) and otherwise only between gates, so
+/// the threads of parallel_range just read it.
+static const Kernel * kernel = &kernel_scalar;
+
+#ifdef MEASURE_X86
+/// Whether the measurements use measure_avx2 (set with the kernel, even 
+/// for the double amplitudes which have no AVX2 kernel)
+static bool measure_wide = false;
+#endif
+
+/// @brief The kernel for a matrix: a special one, or the selected one for
+/// general matrices. NULL means there is nothing to do
+static const Kernel * kernel_for(const Complex op[2][2]) {
+    switch (classify_gate(op)) {
+        case GATE_IDENTITY: return NULL;
+        case GATE_DIAGONAL: return &kernel_diagonal;
+        case GATE_PHASE: return &kernel_phase;
+        case GATE_SIGN: return &kernel_sign;
+        case GATE_SWAP: return &kernel_swap;
+        case GATE_ANTIDIAGONAL: return &kernel_antidiagonal;
+        default: return kernel;
+    }
+}
+
+SIMD_LEVEL simd_select(SIMD_LEVEL level) {
+#ifdef MEASURE_X86
+    __builtin_cpu_init();
+    measure_wide = level >= SIMD_AVX2 && __builtin_cpu_supports("avx2")
+            && __builtin_cpu_supports("fma");
+#endif
+#ifdef SIMD_X86
+    if (measure_wide) {
+        kernel = &kernel_avx2;
+        return SIMD_AVX2;
+    }
+    if (level >= SIMD_SSE && __builtin_cpu_supports("sse3")) {
+        kernel = &kernel_sse;
+        return SIMD_SSE;
+    }
+#endif
+    kernel = &kernel_scalar;
+    return SIMD_SCALAR;
+}
+
+/// @brief Choose the best kernel for the CPU before main, so that it is 
+/// never chosen from inside a parallel region
+__attribute__((constructor)) static void simd_init(void) {
+    simd_select(SIMD_AUTO);
+}
+
+const char * simd_name(void) {
+    return kernel->name;
+}
+
+void simd_controlled_op(const Complex op[2][2], int targ, size_t ctrl_mask,
+        StateVector * state, size_t begin, size_t end) {
+    const Kernel * chosen = kernel_for(op);
+    if (chosen == NULL) return;
+    size_t targ_bit = (size_t)1 << targ;
+    size_t fixed = ctrl_mask | targ_bit;
+    if (targ == 0) {
+        /// Low stride: count in adjacent pairs p = i/2, where the target
+        /// bit has been shifted out. Runs end at the lowest control bit
+        size_t mask = ctrl_mask >> 1;
+        if (mask == 0) {
+            chosen->adjacent(op, state, begin, end - begin);
+            return;
+        }
+        size_t run = mask & (~mask + 1);
+        size_t q = begin;
+        while (q < end) {
+            size_t n = run - (q & (run - 1));
+            if (n > end - q) n = end - q;
+            chosen->adjacent(op, state, insert_zeros(q, mask) | mask, n);
+            q += n;
+        }
+        return;
+    }
+    /// High stride: runs end at the lowest of the target and control bits
+    size_t run = fixed & (~fixed + 1);
+    size_t q = begin;
+    while (q < end) {
+        size_t n = run - (q & (run - 1));
+        if (n > end - q) n = end - q;
+        chosen->run(op, state, insert_zeros(q, fixed) | ctrl_mask, targ_bit, n);
+        q += n;
+    }
+}
+
+/// On x86 with AVX2 the whole groups go to measure_avx2
+void simd_measure_block(const StateVector * state, size_t base, 
+        size_t block, size_t ctrl_mask, bool sums, Marginals * m) {
+#ifdef MEASURE_X86
+    if (measure_wide && block % GROUP == 0) {
+        measure_avx2(state, base, block, ctrl_mask, sums, m);
+        return;
+    }
+#endif
+    measure_groups(state, base, block, ctrl_mask, sums, m);
+}
+
+void simd_single_qubit_op(const Complex op[2][2], int k,
+        StateVector * state, size_t begin, size_t end) {
+    const Kernel * chosen = kernel_for(op);
+    if (chosen == NULL) return;
+    /// Low stride: the pairs are (2p, 2p + 1)
+    if (k == 0) {
+        chosen->adjacent(op, state, begin, end - begin);
+        return;
+    }
+    /// High stride: runs of 2^k pairs, (i, i + 2^k)
+    size_t bit = (size_t)1 << k;
+    size_t p = begin;
+    while (p < end) {
+        size_t offset = p & (bit - 1); // Position inside the run
+        size_t n = bit - offset; // Pairs left in the run
+        if (n > end - p) n = end - p;
+        size_t i = ((p >> k) << (k + 1)) + offset; // The ZERO index
+        chosen->run(op, state, i, bit, n);
+        p += n;
+    }
+}
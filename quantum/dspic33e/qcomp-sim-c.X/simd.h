@@ -0,0 +1,124 @@
+/**
+ * @file simd.h
+ *
+ * @brief Description: Vectorised gate kernels for the host build
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * Host only (not part of the MPLAB project). On the host the Q15 type is
+ * a float, so a Complex is two adjacent floats and the state vector can be
+ * processed several amplitudes at a time with SSE or AVX2. The kernel is
+ * chosen at runtime from what the CPU supports, with a plain C version as
+ * the fallback.
+ */
+
+#ifndef SIMD_H
+#define	SIMD_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include "quantum.h"
+
+    /// @brief The available kernel implementations
+    typedef enum {
+        SIMD_SCALAR, ///< Plain C
+        SIMD_SSE, ///< SSE3, two amplitudes per register
+        SIMD_AVX2, ///< AVX2 and FMA, four amplitudes per register
+        SIMD_AUTO, ///< The best one supported by the CPU
+    } SIMD_LEVEL;
+
+    /**
+     * @brief Choose the kernel used by simd_single_qubit_op
+     * @param level The requested kernel
+     * @return The kernel actually chosen
+     *
+     * If the CPU does not support the requested kernel, the best one below
+     * it is chosen instead. SIMD_AUTO is chosen when the program is loaded.
+     * It must not be called while a gate or measurement is running on 
+     * another thread.
+     */
+    SIMD_LEVEL simd_select(SIMD_LEVEL level);
+
+    /// @brief The name of the kernel currently in use
+    const char * simd_name(void);
+
+    /**
+     * @brief Apply a 2x2 matrix to a range of amplitude pairs
+     * @param op The 2x2 matrix
+     * @param k The qubit to apply it to
+     * @param state The state vector
+     * @param begin The first pair to modify
+     * @param end One past the last pair to modify
+     *
+     * There are length/2 pairs (i, i + 2^k), numbered in order of i. Pass
+     * begin = 0 and end = state->length/2 to apply the gate to the whole
+     * state. The pair number p corresponds to the ZERO index
+     *
+     *      i = ((p >> k) << (k+1)) + (p mod 2^k)
+     *
+     * so the pairs come in contiguous runs of 2^k, exactly like the inner
+     * loop of single_qubit_op_new. For k = 0 the pairs are adjacent in
+     * memory instead (the low stride case), which needs a different
+     * shuffle.
+     *
+     * Matrices with a special structure (see classify_gate) go to plain C
+     * kernels which only move, negate or scale the amplitudes they need.
+     */
+    void simd_single_qubit_op(const Complex op[2][2], int k,
+            StateVector * state, size_t begin, size_t end);
+
+    /**
+     * @brief Apply a 2x2 matrix to a range of controlled amplitude pairs
+     * @param op The 2x2 matrix
+     * @param targ The target qubit
+     * @param ctrl_mask The control qubits, one bit per qubit. It must not
+     * contain the target bit
+     * @param state The state vector
+     * @param begin The first pair to modify
+     * @param end One past the last pair to modify
+     *
+     * Only the pairs (i, i + 2^targ) where every control bit of i is set
+     * are visited, so there are length/2^(c+1) pairs for c controls. The
+     * pair number q is turned into the ZERO index by inserting a zero at
+     * each of the target and control positions (lowest first) and then
+     * setting the control bits. There are no branches on the control
+     * bits, and the pairs still come in contiguous runs, so the same
+     * kernels as simd_single_qubit_op are used.
+     */
+    void simd_controlled_op(const Complex op[2][2], int targ, size_t ctrl_mask,
+            StateVector * state, size_t begin, size_t end);
+
+    /// The most amplitudes simd_measure_block takes at once (the blocks of 
+    /// measure_state and measure_qubit_op on the host, which are small 
+    /// enough to stay in cache between a gate and the measurements)
+#define MEASURE_BLOCK_QUBITS 10
+
+    /**
+     * @brief Add a block of amplitudes to the measurements (see Marginals)
+     * @param state The state vector
+     * @param base The first amplitude, a multiple of 2^m->num_qubits
+     * @param block The number of amplitudes, a multiple of 2^m->num_qubits
+     * and at most 2^MEASURE_BLOCK_QUBITS
+     * @param ctrl_mask Only the amplitudes with these bits set are counted
+     * @param sums Whether to add the |a|^2 sums (if not, only the phase 
+     * differences are counted)
+     * @param m The measurements to add to
+     *
+     * The block is gone over in groups of 2^MEASURE_QUBITS amplitudes: 
+     * |a|^2 goes into one sum for each setting of the measured bits (the 
+     * ZERO and ONE sums are made from these at the end), and the pairs 
+     * with a phase difference are counted for each qubit. With AVX2 the 
+     * groups are shuffled into pairs in registers, and otherwise the block
+     * is copied so that the compiler can vectorise the same.
+     */
+    void simd_measure_block(const StateVector * state, size_t base, 
+            size_t block, size_t ctrl_mask, bool sums, Marginals * m);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SIMD_H */
+
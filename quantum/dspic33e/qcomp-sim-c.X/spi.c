@@ -7,7 +7,13 @@
 *
  */
 
+#include "xc.h"
 #include "spi.h"
+#include "hal.h"
+
+#ifdef SPI_DMA
+static void setup_spi_dma(void);
+#endif
 
 // Set up serial peripheral interface
 int setup_spi(void) {
@@ -53,6 +59,16 @@ int setup_spi(void) {
     // The clock pin also needs to be configured as an input
     RPINR29bits.SCK3R = 0x55; ///< Set SCK3 on J10:7 as input
     
+#ifdef SRAM_FITTED
+    /// Configure the SPI 2 pins (the 23A1024 SRAM). These have not been
+    /// checked against the board: RPI74 is J10:41 in the table above. So
+    /// they are only set up in a build with SRAM_FITTED defined (see sram.h)
+    RPOR7bits.RP96R = 0x09; ///< Put SCK2 on RP96
+    RPOR7bits.RP97R = 0x08; ///< Put SDO2 on RP97
+    RPINR22bits.SDI2R = 0x4A; ///< Put SDI2 on RPI74
+    RPINR22bits.SCK2R = 0x60; ///< Set SCK2 on RP96 as input
+#endif
+    
     // Lock pin remappings
     __builtin_write_OSCCONL(OSCCON | (1<<6));
    
@@ -108,6 +124,36 @@ int setup_spi(void) {
     // Enable SPI 3module
     SPI3STATbits.SPIEN = 1;  
     
+#ifdef SRAM_FITTED
+    // SPI 2 clock configuration
+    //
+    // The 23A1024 runs at up to 20MHz. Assuming that F_CY = 50MHz, and
+    // the prescalers are 4 and 1, the SPI clock frequency will be 12.5MHz.
+    //
+    SPI2CON1bits.PPRE = 0x2; // Primary Prescaler = 4
+    SPI2CON1bits.SPRE = 0x7; // Secondary Prescaler = 1
+    
+    // SPI2CON1 Register Settings (SPI mode 0, which the SRAM expects)
+    SPI2CON1bits.DISSCK = 0; // Internal serial clock is enabled
+    SPI2CON1bits.DISSDO = 0; // SDOx pin is controlled by the module
+    SPI2CON1bits.MODE16 = 0; // Communication is byte-wide (8 bits)
+    SPI2CON1bits.MSTEN = 1;  // Master mode enabled
+    SPI2CON1bits.SMP = 0;    // Input data is sampled at the middle of 
+                             // data output time
+    SPI2CON1bits.CKE = 1;    // Serial output data changes on transition from
+                             // active clock state to Idle clock state
+    SPI2CON1bits.CKP = 0;    // Idle state for clock is a low level;
+                             // active state is a high level
+    
+    // Enable SPI 2 module
+    SPI2STATbits.SPIEN = 1;
+#endif
+    
+#ifdef SPI_DMA
+    // DMA channels for SPI 1 and SPI 3
+    setup_spi_dma();
+#endif
+    
     return 0;
 }
 
@@ -161,3 +207,182 @@ int read_byte_spi_3() {
         return -1;
     }
 }
+
+// Exchange a byte with the SPI 2 peripheral (For the external SRAM)
+//
+// Like the functions above, this blocks until the byte has been clocked
+// out, and returns the byte clocked in at the same time.
+int exchange_byte_spi_2(int data) {
+    // Check that the transmit buffer is empty
+    if(SPI2STATbits.SPITBF == 0) {
+        // Write data to the SPI buffer
+        SPI2BUF = data;
+        // Wait for the operation to finish
+        while(SPI2STATbits.SPIRBF != 1)
+            ; // Do nothing
+        // Read the receive buffer
+        return SPI2BUF & 0xFF;
+    } else {
+        // Unable to transmit
+        return -1;
+    }
+}
+
+// DMA transfers for SPI 1 (display driver) and SPI 3 (button shift registers)
+//
+// In master mode the SPI module asks for a DMA transfer when a byte has been
+// received, i.e. when the last one has finished. So each module uses two
+// channels: one to write the bytes to SPIxBUF and one to read SPIxBUF back
+// (into a dummy byte for SPI 1). The read channel finishes last, after the
+// final byte has been clocked out, so its interrupt is the one that calls
+// the done function. The first byte has to be started by hand (FORCE).
+//
+//   DMA0: memory -> SPI1BUF    DMA1: SPI1BUF -> dummy (interrupt)
+//   DMA2: zero -> SPI3BUF      DMA3: SPI3BUF -> memory (interrupt)
+//
+// The buffers are in ordinary RAM (no space(dma) or EDS attributes).
+//
+// None of this has been built with XC16 or run on the board yet, so it is
+// off by default and only used in a build with SPI_DMA defined. Before it
+// can be turned on, these need checking against the DMA chapter of the 
+// reference manual and the data sheet for the dsPIC33EP512MU810:
+//   - the IRQSEL codes DMA_REQ_SPI1 (0x0A) and DMA_REQ_SPI3 (0x5B)
+//   - that the DMA controller can reach the buffers where the linker puts
+//     them (the dsPIC33E manual says all of RAM, but that is not tested)
+//   - the LE and SH pulses from the DMA interrupts, on a scope
+// Until then the transfers are done a byte at a time (with the functions
+// above) and the done function is called before they return, as on the 
+// host.
+
+#ifdef SPI_DMA
+
+#define DMA_REQ_SPI1 0x0A // SPI1 transfer done
+#define DMA_REQ_SPI3 0x5B // SPI3 transfer done
+
+static unsigned char spi_1_dummy = 0; // Bytes received from the display driver
+static unsigned char spi_3_zero = 0; // Bytes sent to the shift registers
+static SpiDone spi_1_done = NULL;
+static SpiDone spi_3_done = NULL;
+static volatile int spi_1_busy = 0;
+static volatile int spi_3_busy = 0;
+
+// Set up the DMA channels (called from setup_spi)
+static void setup_spi_dma(void) {
+    // Channel 0: display bytes to SPI1BUF
+    DMA0CON = 0x0000;
+    DMA0CONbits.SIZE = 1; // Byte transfers
+    DMA0CONbits.DIR = 1; // Read from RAM, write to the peripheral
+    DMA0CONbits.AMODE = 0; // Register indirect with post-increment
+    DMA0CONbits.MODE = 1; // One-shot, ping-pong disabled
+    DMA0REQbits.IRQSEL = DMA_REQ_SPI1;
+    DMA0PAD = (volatile unsigned int)&SPI1BUF;
+    
+    // Channel 1: SPI1BUF to a dummy byte
+    DMA1CON = 0x0000;
+    DMA1CONbits.SIZE = 1;
+    DMA1CONbits.DIR = 0; // Read from the peripheral, write to RAM
+    DMA1CONbits.AMODE = 1; // Register indirect without post-increment
+    DMA1CONbits.MODE = 1;
+    DMA1REQbits.IRQSEL = DMA_REQ_SPI1;
+    DMA1PAD = (volatile unsigned int)&SPI1BUF;
+    DMA1STAL = (unsigned int)&spi_1_dummy;
+    DMA1STAH = 0x0000;
+    IFS0bits.DMA1IF = 0; // Clear the interrupt flag
+    IEC0bits.DMA1IE = 1; // Enable the interrupt
+    
+    // Channel 2: zeros to SPI3BUF (to run the clock)
+    DMA2CON = 0x0000;
+    DMA2CONbits.SIZE = 1;
+    DMA2CONbits.DIR = 1;
+    DMA2CONbits.AMODE = 1;
+    DMA2CONbits.MODE = 1;
+    DMA2REQbits.IRQSEL = DMA_REQ_SPI3;
+    DMA2PAD = (volatile unsigned int)&SPI3BUF;
+    DMA2STAL = (unsigned int)&spi_3_zero;
+    DMA2STAH = 0x0000;
+    
+    // Channel 3: SPI3BUF to the button bytes
+    DMA3CON = 0x0000;
+    DMA3CONbits.SIZE = 1;
+    DMA3CONbits.DIR = 0;
+    DMA3CONbits.AMODE = 0;
+    DMA3CONbits.MODE = 1;
+    DMA3REQbits.IRQSEL = DMA_REQ_SPI3;
+    DMA3PAD = (volatile unsigned int)&SPI3BUF;
+    IFS2bits.DMA3IF = 0;
+    IEC2bits.DMA3IE = 1;
+}
+
+int send_spi_1_dma(const unsigned char * data, int count, SpiDone done) {
+    if(spi_1_busy) return -1;
+    spi_1_busy = 1;
+    spi_1_done = done;
+    DMA0STAL = (unsigned int)data;
+    DMA0STAH = 0x0000;
+    DMA0CNT = count - 1;
+    DMA1CNT = count - 1;
+    DMA1CONbits.CHEN = 1; // Enable the read channel first
+    DMA0CONbits.CHEN = 1;
+    DMA0REQbits.FORCE = 1; // Send the first byte
+    return 0;
+}
+
+int read_spi_3_dma(unsigned char * buffer, int count, SpiDone done) {
+    if(spi_3_busy) return -1;
+    spi_3_busy = 1;
+    spi_3_done = done;
+    DMA3STAL = (unsigned int)buffer;
+    DMA3STAH = 0x0000;
+    DMA2CNT = count - 1;
+    DMA3CNT = count - 1;
+    DMA3CONbits.CHEN = 1;
+    DMA2CONbits.CHEN = 1;
+    DMA2REQbits.FORCE = 1;
+    return 0;
+}
+
+int spi_1_dma_busy(void) {
+    return spi_1_busy;
+}
+
+int spi_3_dma_busy(void) {
+    return spi_3_busy;
+}
+
+// The last byte has been clocked out to the display driver
+void ISR _DMA1Interrupt(void) {
+    spi_1_busy = 0;
+    if(spi_1_done != NULL) spi_1_done();
+    IFS0bits.DMA1IF = 0; // Clear the interrupt flag
+}
+
+// The last byte has arrived from the button shift registers
+void ISR _DMA3Interrupt(void) {
+    spi_3_busy = 0;
+    if(spi_3_done != NULL) spi_3_done();
+    IFS2bits.DMA3IF = 0;
+}
+
+#else
+
+int send_spi_1_dma(const unsigned char * data, int count, SpiDone done) {
+    for(int n = 0; n < count; n++) send_byte_spi_1(data[n]);
+    if(done != NULL) done();
+    return 0;
+}
+
+int read_spi_3_dma(unsigned char * buffer, int count, SpiDone done) {
+    for(int n = 0; n < count; n++) buffer[n] = read_byte_spi_3();
+    if(done != NULL) done();
+    return 0;
+}
+
+int spi_1_dma_busy(void) {
+    return 0;
+}
+
+int spi_3_dma_busy(void) {
+    return 0;
+}
+
+#endif
@@ -14,7 +14,8 @@
 extern "C" {
 #endif
 
-#include "xc.h"
+/// @note The dsPIC implementation is in spi.c and the host implementation
+/// is in hal_host.c
 
 /// Set up serial peripheral interface
 int setup_spi(void);
@@ -26,6 +27,41 @@ int send_byte_spi_1(int data);
 /// Recieve a byte from the SPI3 peripheral
 int read_byte_spi_3();
 
+/// Called from the DMA interrupt when a transfer has finished (or before
+/// the transfer function returns, in a build without SPI_DMA, see spi.c)
+typedef void (*SpiDone)(void);
+
+/**
+ * @brief Start sending bytes to SPI1 with DMA (the display driver)
+ * @param data The bytes to send. They must not change until done is called
+ * @param count The number of bytes
+ * @param done Called from the interrupt when the last byte has been clocked
+ * out (may be NULL)
+ * @return 0 if the transfer was started, -1 if the last one is still going
+ */
+int send_spi_1_dma(const unsigned char * data, int count, SpiDone done);
+
+/**
+ * @brief Start reading bytes from SPI3 with DMA (the button shift registers)
+ * @param buffer Space for the bytes. It must not be used until done is called
+ * @param count The number of bytes
+ * @param done Called from the interrupt when the last byte has arrived (may
+ * be NULL)
+ * @return 0 if the transfer was started, -1 if the last one is still going
+ */
+int read_spi_3_dma(unsigned char * buffer, int count, SpiDone done);
+
+/// True while a DMA transfer on SPI1 is still going
+int spi_1_dma_busy(void);
+
+/// True while a DMA transfer on SPI3 is still going
+int spi_3_dma_busy(void);
+
+/// Exchange a byte with the SPI2 peripheral (the external SRAM, see sram.h)
+/// @param data byte to be sent to SPI2
+/// @return the byte received at the same time, or -1 if busy
+int exchange_byte_spi_2(int data);
+
 #ifdef	__cplusplus
 }
 #endif
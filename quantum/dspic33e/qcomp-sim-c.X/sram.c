@@ -0,0 +1,54 @@
+/**
+ * @file sram.c
+ *
+ * @brief Description: Driver for the 23A1024 SPI SRAM
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ */
+
+#include "sram.h"
+#include "spi.h"
+#include "hal.h"
+#include "io.h"
+
+/// Start a command: chip select low, then the instruction and address
+static void sram_command(int instruction, unsigned long address) {
+    hal_latd_clear(SRAM_CS);
+    exchange_byte_spi_2(instruction);
+    exchange_byte_spi_2((address >> 16) & 0xFF);
+    exchange_byte_spi_2((address >> 8) & 0xFF);
+    exchange_byte_spi_2(address & 0xFF);
+}
+
+int sram_setup(void) {
+    /// Make sure the chip is not part way through a command
+    hal_latd_set(SRAM_CS);
+    hal_latd_clear(SRAM_CS);
+    exchange_byte_spi_2(SRAM_WRMR);
+    exchange_byte_spi_2(SRAM_SEQUENTIAL);
+    hal_latd_set(SRAM_CS);
+    /// Read the mode back
+    hal_latd_clear(SRAM_CS);
+    exchange_byte_spi_2(SRAM_RDMR);
+    int mode = exchange_byte_spi_2(0);
+    hal_latd_set(SRAM_CS);
+    return (mode == SRAM_SEQUENTIAL) ? 0 : -1;
+}
+
+void sram_read(unsigned long address, void * buffer, size_t count) {
+    unsigned char * bytes = buffer;
+    sram_command(SRAM_READ, address);
+    for (size_t n = 0; n < count; n++) {
+        bytes[n] = exchange_byte_spi_2(0);
+    }
+    hal_latd_set(SRAM_CS);
+}
+
+void sram_write(unsigned long address, const void * buffer, size_t count) {
+    const unsigned char * bytes = buffer;
+    sram_command(SRAM_WRITE, address);
+    for (size_t n = 0; n < count; n++) {
+        exchange_byte_spi_2(bytes[n]);
+    }
+    hal_latd_set(SRAM_CS);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file sram.h
+ *
+ * @brief Description: Driver for the 23A1024 SPI SRAM
+ * @authors J Scott, O Thomas
+ * @date Nov 2018
+ *
+ * The 23A1024 holds 128 KiB. It is connected to SPI 2, with its chip select
+ * on port D (SRAM_CS in io.h). It is used in sequential mode, so a read or
+ * write of any length is one command, then a 24 bit address, then the
+ * data. On the host the chip is emulated in hal_host.c.
+ *
+ * The SPI 2 pin mappings in setup_spi have not been checked against the
+ * board yet, so on the dsPIC SPI 2 is only set up, and sram_setup only 
+ * called from main, in a build with SRAM_FITTED defined.
+ */
+
+#ifndef SRAM_H
+#define	SRAM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+    /// The size of the SRAM in bytes
+#define SRAM_SIZE 131072UL
+
+    /// Instructions
+#define SRAM_READ 0x03 ///< Read data from the address
+#define SRAM_WRITE 0x02 ///< Write data from the address
+#define SRAM_RDMR 0x05 ///< Read the mode register
+#define SRAM_WRMR 0x01 ///< Write the mode register
+
+    /// Modes (written to the mode register)
+#define SRAM_BYTE_MODE 0x00 ///< One byte per command
+#define SRAM_PAGE_MODE 0x80 ///< Wraps round at the end of a 32 byte page
+#define SRAM_SEQUENTIAL 0x40 ///< Carries on through the whole array
+
+    /**
+     * @brief Put the SRAM in sequential mode (run after setup_spi)
+     * @return 0 if the mode was read back correctly, -1 otherwise
+     */
+    int sram_setup(void);
+
+    /**
+     * @brief Read bytes from the SRAM
+     * @param address The first address
+     * @param buffer Space for count bytes
+     * @param count The number of bytes
+     */
+    void sram_read(unsigned long address, void * buffer, size_t count);
+
+    /**
+     * @brief Write bytes to the SRAM
+     * @param address The first address
+     * @param buffer The bytes to write
+     * @param count The number of bytes
+     */
+    void sram_write(unsigned long address, const void * buffer, size_t count);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SRAM_H */
+
@@ -7,6 +7,7 @@
 * 
  */
 
+#include "xc.h"
 #include "time.h"
 
 // Use this routine to set up the instruction cycle clock
@@ -91,11 +92,3 @@ unsigned long int read_timer() {
     return count;
 }
 
-
-/// @brief Delay function!
-void delay(){
-long int counter = 0;
-    while(counter <= 1000000){
-        counter++;
-    }
-}
@@ -14,9 +14,11 @@
 extern "C" {
 #endif
     
-//#include "xc.h"
 #include "spi.h"
 
+    // The dsPIC implementation is in time.c and the host implementation is
+    // in hal_host.c. On the host the timer counts nanoseconds.
+
     // Use this routine to set up the instruction cycle clock
     void setup_clock();
     
@@ -34,8 +36,6 @@ extern "C" {
     
     // Read the timer
     unsigned long int read_timer();
-    
-    void delay();
 
 #ifdef	__cplusplus
 }